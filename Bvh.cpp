@@ -0,0 +1,305 @@
+#include "Bvh.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace gps {
+
+	static const int BIN_COUNT = 16;
+	static const GLuint MAX_LEAF_PRIMITIVES = 4;
+	// subtrees at least this large are handed to the thread pool
+	static const GLuint PARALLEL_PRIMITIVES = 4096;
+	// below this depth nodes are split at the median instead, so the traversal stacks never overflow
+	static const int MAX_SAH_DEPTH = 32;
+
+	// Shared by the tasks building one hierarchy
+	struct BvhBuild {
+		const std::vector<glm::vec3>* boundsMin;
+		const std::vector<glm::vec3>* boundsMax;
+		std::vector<glm::vec3> centroids;
+		std::vector<BvhNode>* nodes;
+		std::vector<GLuint>* primitives;
+		std::atomic<GLuint> nodeCount;
+
+		std::mutex mutex;
+		std::condition_variable finished;
+		size_t pendingTasks;
+	};
+
+	static float SurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+		glm::vec3 size = boundsMax - boundsMin;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	static bool BoxesOverlap(const glm::vec3& aMin, const glm::vec3& aMax, const glm::vec3& bMin, const glm::vec3& bMax) {
+		return aMax.x >= bMin.x && aMax.y >= bMin.y && aMax.z >= bMin.z &&
+			aMin.x <= bMax.x && aMin.y <= bMax.y && aMin.z <= bMax.z;
+	}
+
+	static void BuildNode(BvhBuild* build, GLuint nodeIndex, GLuint first, GLuint count, int depth);
+
+	static void BuildSubtreeTask(BvhBuild* build, GLuint nodeIndex, GLuint first, GLuint count, int depth) {
+		BuildNode(build, nodeIndex, first, count, depth);
+
+		std::lock_guard<std::mutex> lock(build->mutex);
+		if (--build->pendingTasks == 0) {
+			build->finished.notify_all();
+		}
+	}
+
+	static void BuildNode(BvhBuild* build, GLuint nodeIndex, GLuint first, GLuint count, int depth) {
+		std::vector<GLuint>& primitives = *build->primitives;
+		BvhNode& node = (*build->nodes)[nodeIndex];
+
+		node.boundsMin = (*build->boundsMin)[primitives[first]];
+		node.boundsMax = (*build->boundsMax)[primitives[first]];
+		glm::vec3 centroidMin = build->centroids[primitives[first]];
+		glm::vec3 centroidMax = centroidMin;
+		for (GLuint i = first + 1; i < first + count; i++) {
+			node.boundsMin = glm::min(node.boundsMin, (*build->boundsMin)[primitives[i]]);
+			node.boundsMax = glm::max(node.boundsMax, (*build->boundsMax)[primitives[i]]);
+			centroidMin = glm::min(centroidMin, build->centroids[primitives[i]]);
+			centroidMax = glm::max(centroidMax, build->centroids[primitives[i]]);
+		}
+
+		node.leftOrFirst = first;
+		node.primitiveCount = count;
+		if (count <= MAX_LEAF_PRIMITIVES) {
+			return;
+		}
+
+		// best split plane over the bins of every axis
+		int bestAxis = -1;
+		int bestBin = 0;
+		float bestCost = (float)count;
+		glm::vec3 centroidExtent = centroidMax - centroidMin;
+		for (int axis = 0; axis < 3 && depth < MAX_SAH_DEPTH; axis++) {
+			if (centroidExtent[axis] <= 0.0f) {
+				continue;
+			}
+
+			glm::vec3 binMin[BIN_COUNT], binMax[BIN_COUNT];
+			GLuint binCount[BIN_COUNT] = { 0 };
+			float binScale = BIN_COUNT / centroidExtent[axis];
+			for (GLuint i = first; i < first + count; i++) {
+				GLuint primitive = primitives[i];
+				int bin = std::min(BIN_COUNT - 1, (int)((build->centroids[primitive][axis] - centroidMin[axis]) * binScale));
+				binMin[bin] = binCount[bin] == 0 ? (*build->boundsMin)[primitive] : glm::min(binMin[bin], (*build->boundsMin)[primitive]);
+				binMax[bin] = binCount[bin] == 0 ? (*build->boundsMax)[primitive] : glm::max(binMax[bin], (*build->boundsMax)[primitive]);
+				binCount[bin]++;
+			}
+
+			// areas and counts left of each plane, then sweep from the right
+			float leftArea[BIN_COUNT - 1];
+			GLuint leftCount[BIN_COUNT - 1];
+			glm::vec3 sweepMin(0.0f), sweepMax(0.0f);
+			GLuint sweepCount = 0;
+			for (int b = 0; b < BIN_COUNT - 1; b++) {
+				if (binCount[b] > 0) {
+					sweepMin = sweepCount == 0 ? binMin[b] : glm::min(sweepMin, binMin[b]);
+					sweepMax = sweepCount == 0 ? binMax[b] : glm::max(sweepMax, binMax[b]);
+					sweepCount += binCount[b];
+				}
+				leftArea[b] = sweepCount > 0 ? SurfaceArea(sweepMin, sweepMax) : 0.0f;
+				leftCount[b] = sweepCount;
+			}
+
+			float parentArea = SurfaceArea(node.boundsMin, node.boundsMax);
+			sweepCount = 0;
+			for (int b = BIN_COUNT - 1; b > 0; b--) {
+				if (binCount[b] > 0) {
+					sweepMin = sweepCount == 0 ? binMin[b] : glm::min(sweepMin, binMin[b]);
+					sweepMax = sweepCount == 0 ? binMax[b] : glm::max(sweepMax, binMax[b]);
+					sweepCount += binCount[b];
+				}
+				if (sweepCount == 0 || leftCount[b - 1] == 0) {
+					continue;
+				}
+				// traversal step plus the intersection tests of both children, relative to the parent
+				float cost = 0.125f + (leftArea[b - 1] * leftCount[b - 1] + SurfaceArea(sweepMin, sweepMax) * sweepCount) /
+					std::max(parentArea, 1e-20f);
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+
+		GLuint leftCount;
+		if (bestAxis >= 0) {
+			float binScale = BIN_COUNT / centroidExtent[bestAxis];
+			GLuint* middle = std::partition(&primitives[first], &primitives[first] + count, [&](GLuint primitive) {
+				int bin = std::min(BIN_COUNT - 1, (int)((build->centroids[primitive][bestAxis] - centroidMin[bestAxis]) * binScale));
+				return bin < bestBin;
+			});
+			leftCount = (GLuint)(middle - &primitives[first]);
+		}
+		else if (count <= 4 * MAX_LEAF_PRIMITIVES && depth < MAX_SAH_DEPTH) {
+			// no split beats a leaf
+			return;
+		}
+		else {
+			// identical centroids or too deep: median along the longest centroid axis
+			int axis = 0;
+			if (centroidExtent.y > centroidExtent[axis]) axis = 1;
+			if (centroidExtent.z > centroidExtent[axis]) axis = 2;
+			leftCount = count / 2;
+			std::nth_element(&primitives[first], &primitives[first] + leftCount, &primitives[first] + count,
+				[&](GLuint a, GLuint b) { return build->centroids[a][axis] < build->centroids[b][axis]; });
+		}
+
+		GLuint left = build->nodeCount.fetch_add(2);
+		node.leftOrFirst = left;
+		node.primitiveCount = 0;
+
+		GLuint rightCount = count - leftCount;
+		if (rightCount >= PARALLEL_PRIMITIVES) {
+			{
+				std::lock_guard<std::mutex> lock(build->mutex);
+				build->pendingTasks++;
+			}
+			ThreadPool::GetShared().Enqueue(std::bind(BuildSubtreeTask, build, left + 1, first + leftCount, rightCount, depth + 1));
+		}
+		else {
+			BuildNode(build, left + 1, first + leftCount, rightCount, depth + 1);
+		}
+		BuildNode(build, left, first, leftCount, depth + 1);
+	}
+
+	void Bvh::Build(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax) {
+		nodes.clear();
+		primitives.clear();
+		primitivesMin.clear();
+		primitivesMax.clear();
+		if (boundsMin.empty()) {
+			return;
+		}
+
+		BvhBuild build;
+		build.boundsMin = &boundsMin;
+		build.boundsMax = &boundsMax;
+		build.centroids.resize(boundsMin.size());
+		for (size_t i = 0; i < boundsMin.size(); i++) {
+			build.centroids[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+			primitives.push_back((GLuint)i);
+		}
+		// a binary tree with one primitive per leaf at most has 2n - 1 nodes
+		nodes.resize(boundsMin.size() * 2);
+		build.nodes = &nodes;
+		build.primitives = &primitives;
+		build.nodeCount = 1;
+		build.pendingTasks = 0;
+
+		BuildNode(&build, 0, 0, (GLuint)primitives.size(), 0);
+
+		// the pool workers finish the subtrees they were given, the build state lives on this stack
+		std::unique_lock<std::mutex> lock(build.mutex);
+		while (build.pendingTasks > 0) {
+			build.finished.wait(lock);
+		}
+		nodes.resize(build.nodeCount);
+
+		for (size_t i = 0; i < primitives.size(); i++) {
+			primitivesMin.push_back(boundsMin[primitives[i]]);
+			primitivesMax.push_back(boundsMax[primitives[i]]);
+		}
+	}
+
+	bool Bvh::IsEmpty() const {
+		return nodes.empty();
+	}
+
+	const std::vector<BvhNode>& Bvh::GetNodes() const {
+		return nodes;
+	}
+
+	const std::vector<GLuint>& Bvh::GetPrimitives() const {
+		return primitives;
+	}
+
+	void Bvh::CollectPrimitives(GLuint node, std::vector<GLuint>& result) const {
+		if (nodes[node].primitiveCount > 0) {
+			result.insert(result.end(), primitives.begin() + nodes[node].leftOrFirst,
+				primitives.begin() + nodes[node].leftOrFirst + nodes[node].primitiveCount);
+			return;
+		}
+		CollectPrimitives(nodes[node].leftOrFirst, result);
+		CollectPrimitives(nodes[node].leftOrFirst + 1, result);
+	}
+
+	void Bvh::QueryFrustum(const Frustum& frustum, std::vector<GLuint>& result) const {
+		if (nodes.empty()) {
+			return;
+		}
+
+		GLuint stack[64];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const GLuint nodeIndex = stack[--stackSize];
+			const BvhNode& node = nodes[nodeIndex];
+
+			bool inside;
+			if (!frustum.IntersectsBox(node.boundsMin, node.boundsMax, &inside)) {
+				continue;
+			}
+			if (inside) {
+				CollectPrimitives(nodeIndex, result);
+				continue;
+			}
+			if (node.primitiveCount > 0) {
+				for (GLuint i = node.leftOrFirst; i < node.leftOrFirst + node.primitiveCount; i++) {
+					if (frustum.IntersectsBox(primitivesMin[i], primitivesMax[i])) {
+						result.push_back(primitives[i]);
+					}
+				}
+				continue;
+			}
+			stack[stackSize++] = node.leftOrFirst;
+			stack[stackSize++] = node.leftOrFirst + 1;
+		}
+	}
+
+	void Bvh::QueryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<GLuint>& result) const {
+		if (nodes.empty()) {
+			return;
+		}
+
+		GLuint stack[64];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const BvhNode& node = nodes[stack[--stackSize]];
+			if (!BoxesOverlap(node.boundsMin, node.boundsMax, boundsMin, boundsMax)) {
+				continue;
+			}
+			if (node.primitiveCount > 0) {
+				for (GLuint i = node.leftOrFirst; i < node.leftOrFirst + node.primitiveCount; i++) {
+					if (BoxesOverlap(primitivesMin[i], primitivesMax[i], boundsMin, boundsMax)) {
+						result.push_back(primitives[i]);
+					}
+				}
+				continue;
+			}
+			stack[stackSize++] = node.leftOrFirst;
+			stack[stackSize++] = node.leftOrFirst + 1;
+		}
+	}
+
+	bool Bvh::IntersectRay(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin,
+		const glm::vec3& inverseDirection, float maxDistance, float* entry) {
+		// slabs
+		glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+		glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+		*entry = enter;
+		return enter <= exit;
+	}
+}
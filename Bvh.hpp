@@ -0,0 +1,122 @@
+#ifndef Bvh_hpp
+#define Bvh_hpp
+
+#include "Frustum.hpp"
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // 32 byte node of a flat BVH array. The children of an inner node are next to each other,
+    // so one index is enough
+    struct BvhNode
+    {
+        glm::vec3 boundsMin;
+        // inner node: index of the left child (the right one follows it), leaf: first primitive
+        GLuint leftOrFirst;
+        glm::vec3 boundsMax;
+        // primitives of a leaf, 0 for an inner node
+        GLuint primitiveCount;
+    };
+
+    // Bounding volume hierarchy over primitives given by their boxes, built with the surface area
+    // heuristic over binned centroids. Large subtrees are built on the shared thread pool
+    class Bvh
+    {
+    public:
+        // Replaces the hierarchy with one over the boxes [boundsMin[i], boundsMax[i]].
+        // Waits for the pool, so it must not run inside a pool job
+        void Build(const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax);
+
+        bool IsEmpty() const;
+        const std::vector<BvhNode>& GetNodes() const;
+        // Primitive indices, each leaf owns the range [leftOrFirst, leftOrFirst + primitiveCount)
+        const std::vector<GLuint>& GetPrimitives() const;
+
+        // Primitives whose box is not completely outside the frustum. Subtrees fully inside are
+        // taken without testing their nodes
+        void QueryFrustum(const Frustum& frustum, std::vector<GLuint>& primitives) const;
+
+        // Primitives whose box overlaps the given box
+        void QueryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<GLuint>& primitives) const;
+
+        // Visits the leaves hit by the ray nearest first. `intersect(primitive, maxDistance)` returns the
+        // distance of a hit closer than maxDistance, or maxDistance. Returns the closest distance found
+        template <typename Intersect>
+        float Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Intersect& intersect) const;
+
+        // Entry distance of the ray into the box, false if it misses it before maxDistance
+        static bool IntersectRay(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin,
+                                 const glm::vec3& inverseDirection, float maxDistance, float* entry);
+
+    private:
+        std::vector<BvhNode> nodes;
+        // primitive indices, each leaf owns a range
+        std::vector<GLuint> primitives;
+        // boxes of the primitives in the same order, for the tests inside the leaves
+        std::vector<glm::vec3> primitivesMin;
+        std::vector<glm::vec3> primitivesMax;
+
+        // pushes the primitives of a whole subtree
+        void CollectPrimitives(GLuint node, std::vector<GLuint>& result) const;
+    };
+
+    template <typename Intersect>
+    float Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Intersect& intersect) const {
+        if (nodes.empty()) {
+            return maxDistance;
+        }
+
+        glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        float entry;
+        if (!IntersectRay(nodes[0].boundsMin, nodes[0].boundsMax, origin, inverseDirection, maxDistance, &entry)) {
+            return maxDistance;
+        }
+
+        // nodes to visit with their entry distances, the nearer child is visited first
+        GLuint stack[64];
+        float stackEntry[64];
+        int stackSize = 0;
+        stack[stackSize] = 0;
+        stackEntry[stackSize++] = entry;
+
+        while (stackSize > 0) {
+            stackSize--;
+            if (stackEntry[stackSize] >= maxDistance) {
+                continue;
+            }
+            const BvhNode& node = nodes[stack[stackSize]];
+
+            if (node.primitiveCount > 0) {
+                for (GLuint i = 0; i < node.primitiveCount; i++) {
+                    maxDistance = intersect(primitives[node.leftOrFirst + i], maxDistance);
+                }
+                continue;
+            }
+
+            float leftEntry, rightEntry;
+            bool left = IntersectRay(nodes[node.leftOrFirst].boundsMin, nodes[node.leftOrFirst].boundsMax,
+                                     origin, inverseDirection, maxDistance, &leftEntry);
+            bool right = IntersectRay(nodes[node.leftOrFirst + 1].boundsMin, nodes[node.leftOrFirst + 1].boundsMax,
+                                      origin, inverseDirection, maxDistance, &rightEntry);
+            if (left && right) {
+                // the far child goes below the near one
+                bool leftFirst = leftEntry <= rightEntry;
+                stack[stackSize] = node.leftOrFirst + (leftFirst ? 1 : 0);
+                stackEntry[stackSize++] = leftFirst ? rightEntry : leftEntry;
+                stack[stackSize] = node.leftOrFirst + (leftFirst ? 0 : 1);
+                stackEntry[stackSize++] = leftFirst ? leftEntry : rightEntry;
+            }
+            else if (left || right) {
+                stack[stackSize] = node.leftOrFirst + (left ? 0 : 1);
+                stackEntry[stackSize++] = left ? leftEntry : rightEntry;
+            }
+        }
+        return maxDistance;
+    }
+}
+
+#endif /* Bvh_hpp */
@@ -10,6 +10,7 @@ namespace gps {
 		this->cameraFrontDirection = glm::normalize(cameraPosition - cameraTarget);
 		this->cameraRightDirection = glm::normalize(glm::cross(cameraUp, cameraFrontDirection));
 		this->cameraUpDirection = glm::cross(cameraFrontDirection, cameraRightDirection);
+		this->projection = glm::mat4(1.0f);
 	}
 
 	//return the view matrix, using the glm::lookAt() function
@@ -25,6 +26,20 @@ namespace gps {
 		return this->cameraTarget;
 	}
 
+	//set the projection matrix the camera renders with
+	void Camera::setProjectionMatrix(glm::mat4 projection) {
+		this->projection = projection;
+	}
+
+	glm::mat4 Camera::getProjectionMatrix() {
+		return this->projection;
+	}
+
+	//return the clip planes of the projection and the current view, in world space
+	Frustum Camera::getFrustum() {
+		return Frustum(projection * getViewMatrix());
+	}
+
 	//update the camera internal parameters following a camera move event
 	void Camera::move(MOVE_DIRECTION direction, float speed) {
 		switch (direction)
@@ -4,6 +4,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include "Frustum.hpp"
+
 #include <string>
 
 namespace gps {
@@ -21,6 +23,11 @@ namespace gps {
         glm::vec3 getCameraPosition();
         //returns the camera target
         glm::vec3 getCameraTarget();
+        //set the projection matrix the camera renders with
+        void setProjectionMatrix(glm::mat4 projection);
+        glm::mat4 getProjectionMatrix();
+        //return the clip planes of the projection and the current view, in world space
+        Frustum getFrustum();
         //update the camera internal parameters following a camera move event
         void move(MOVE_DIRECTION direction, float speed);
         //update the camera internal parameters following a camera rotate event
@@ -34,6 +41,7 @@ namespace gps {
         glm::vec3 cameraFrontDirection;
         glm::vec3 cameraRightDirection;
         glm::vec3 cameraUpDirection;
+        glm::mat4 projection;
     };
     
 }
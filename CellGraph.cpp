@@ -0,0 +1,256 @@
+#include "CellGraph.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+	// portal chains longer than this are not followed
+	static const size_t MAX_PORTAL_DEPTH = 32;
+
+	static float DistanceToBox(const glm::vec3& point, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+		glm::vec3 offset = glm::max(glm::max(boundsMin - point, point - boundsMax), glm::vec3(0.0f));
+		return glm::length(offset);
+	}
+
+	bool CellGraph::Load(const std::string& fileName) {
+		cells.clear();
+		portals.clear();
+
+		std::ifstream file(fileName.c_str());
+		if (!file.is_open()) {
+			return false;
+		}
+
+		// portals name cells that may come later in the file
+		std::vector<std::string> portalCellNames;
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line)) {
+			lineNumber++;
+			std::istringstream tokens(line);
+			std::string keyword;
+			if (!(tokens >> keyword) || keyword[0] == '#') {
+				continue;
+			}
+
+			bool valid = false;
+			if (keyword == "cell") {
+				Cell cell;
+				valid = (bool)(tokens >> cell.name >> cell.boundsMin.x >> cell.boundsMin.y >> cell.boundsMin.z
+					>> cell.boundsMax.x >> cell.boundsMax.y >> cell.boundsMax.z);
+				cells.push_back(cell);
+			}
+			else if (keyword == "mesh") {
+				std::string meshName;
+				valid = !cells.empty() && (bool)(tokens >> meshName);
+				if (valid) {
+					cells.back().meshNames.push_back(meshName);
+				}
+			}
+			else if (keyword == "portal") {
+				std::string first, second;
+				CellPortal portal;
+				valid = (bool)(tokens >> first >> second);
+				for (int c = 0; c < 4 && valid; c++) {
+					valid = (bool)(tokens >> portal.corners[c].x >> portal.corners[c].y >> portal.corners[c].z);
+				}
+				portal.boundsMin = portal.boundsMax = portal.corners[0];
+				for (int c = 1; c < 4; c++) {
+					portal.boundsMin = glm::min(portal.boundsMin, portal.corners[c]);
+					portal.boundsMax = glm::max(portal.boundsMax, portal.corners[c]);
+				}
+				portals.push_back(portal);
+				portalCellNames.push_back(first);
+				portalCellNames.push_back(second);
+			}
+
+			if (!valid) {
+				std::cerr << "ERROR: " << fileName << ":" << lineNumber << " : malformed line" << std::endl;
+				cells.clear();
+				portals.clear();
+				return false;
+			}
+		}
+
+		for (size_t p = 0; p < portals.size(); p++) {
+			for (int side = 0; side < 2; side++) {
+				const std::string& cellName = portalCellNames[p * 2 + side];
+				portals[p].cells[side] = -1;
+				for (size_t c = 0; c < cells.size(); c++) {
+					if (cells[c].name == cellName) {
+						portals[p].cells[side] = (int)c;
+					}
+				}
+				if (portals[p].cells[side] < 0) {
+					std::cerr << "ERROR: " << fileName << " : portal to unknown cell " << cellName << std::endl;
+					cells.clear();
+					portals.clear();
+					return false;
+				}
+				cells[portals[p].cells[side]].portals.push_back(p);
+			}
+		}
+
+		std::cout << "Loaded " << cells.size() << " cells and " << portals.size() << " portals from " << fileName << std::endl;
+		return true;
+	}
+
+	bool CellGraph::IsEmpty() const {
+		return cells.empty();
+	}
+
+	size_t CellGraph::GetCellCount() const {
+		return cells.size();
+	}
+
+	const Cell& CellGraph::GetCell(size_t cell) const {
+		return cells[cell];
+	}
+
+	int CellGraph::FindCell(const glm::vec3& point) const {
+		int found = -1;
+		float foundVolume = 0.0f;
+		for (size_t c = 0; c < cells.size(); c++) {
+			if (DistanceToBox(point, cells[c].boundsMin, cells[c].boundsMax) > 0.0f) {
+				continue;
+			}
+			glm::vec3 size = cells[c].boundsMax - cells[c].boundsMin;
+			float volume = size.x * size.y * size.z;
+			if (found < 0 || volume < foundVolume) {
+				found = (int)c;
+				foundVolume = volume;
+			}
+		}
+		return found;
+	}
+
+	int CellGraph::FindMeshCell(const std::string& meshName, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+		for (size_t c = 0; c < cells.size(); c++) {
+			if (!meshName.empty() && std::find(cells[c].meshNames.begin(), cells[c].meshNames.end(), meshName) != cells[c].meshNames.end()) {
+				return (int)c;
+			}
+		}
+		return FindCell((boundsMin + boundsMax) * 0.5f);
+	}
+
+	void CellGraph::ComputeVisibleCells(const glm::mat4& viewProjection, const glm::vec3& eye, std::vector<unsigned char>& visible) const {
+		int start = FindCell(eye);
+		visible.assign(cells.size(), start < 0 ? 1 : 0);
+		if (start < 0) {
+			return;
+		}
+
+		ScreenRect screen = { -1.0f, -1.0f, 1.0f, 1.0f };
+		std::vector<int> path;
+		VisitCell(start, screen, viewProjection, eye, path, visible);
+	}
+
+	void CellGraph::VisitCell(int cell, const ScreenRect& rect, const glm::mat4& viewProjection, const glm::vec3& eye,
+		std::vector<int>& path, std::vector<unsigned char>& visible) const {
+		visible[cell] = 1;
+		if (path.size() >= MAX_PORTAL_DEPTH) {
+			return;
+		}
+		path.push_back(cell);
+
+		for (size_t i = 0; i < cells[cell].portals.size(); i++) {
+			const CellPortal& portal = portals[cells[cell].portals[i]];
+			int next = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+			if (std::find(path.begin(), path.end(), next) != path.end()) {
+				continue;
+			}
+
+			// standing in the doorway, the portal is seen through the whole rectangle
+			ScreenRect portalRect = rect;
+			glm::vec3 margin = (portal.boundsMax - portal.boundsMin) * 0.01f;
+			if (DistanceToBox(eye, portal.boundsMin - margin, portal.boundsMax + margin) > 0.0f &&
+				!ProjectPortal(portal, viewProjection, &portalRect)) {
+				continue;
+			}
+
+			ScreenRect narrowed;
+			narrowed.minX = std::max(rect.minX, portalRect.minX);
+			narrowed.minY = std::max(rect.minY, portalRect.minY);
+			narrowed.maxX = std::min(rect.maxX, portalRect.maxX);
+			narrowed.maxY = std::min(rect.maxY, portalRect.maxY);
+			if (narrowed.minX < narrowed.maxX && narrowed.minY < narrowed.maxY) {
+				VisitCell(next, narrowed, viewProjection, eye, path, visible);
+			}
+		}
+
+		path.pop_back();
+	}
+
+	bool CellGraph::ProjectPortal(const CellPortal& portal, const glm::mat4& viewProjection, ScreenRect* rect) const {
+		glm::vec4 clip[4];
+		float distances[4];
+		for (int c = 0; c < 4; c++) {
+			clip[c] = viewProjection * glm::vec4(portal.corners[c], 1.0f);
+			// to the near plane z = -w
+			distances[c] = clip[c].z + clip[c].w;
+		}
+
+		// the part of the quad in front of the near plane
+		glm::vec4 clipped[8];
+		int clippedCount = 0;
+		for (int c = 0; c < 4; c++) {
+			int next = (c + 1) % 4;
+			if (distances[c] >= 0.0f) {
+				clipped[clippedCount++] = clip[c];
+			}
+			if ((distances[c] >= 0.0f) != (distances[next] >= 0.0f)) {
+				float t = distances[c] / (distances[c] - distances[next]);
+				clipped[clippedCount++] = clip[c] + (clip[next] - clip[c]) * t;
+			}
+		}
+
+		bool first = true;
+		for (int c = 0; c < clippedCount; c++) {
+			if (clipped[c].w <= 0.0f) {
+				continue;
+			}
+			float x = clipped[c].x / clipped[c].w;
+			float y = clipped[c].y / clipped[c].w;
+			rect->minX = first ? x : std::min(rect->minX, x);
+			rect->minY = first ? y : std::min(rect->minY, y);
+			rect->maxX = first ? x : std::max(rect->maxX, x);
+			rect->maxY = first ? y : std::max(rect->maxY, y);
+			first = false;
+		}
+		return !first;
+	}
+
+	void CellGraph::ComputeLitCells(const glm::vec3& lightPosition, float range, std::vector<unsigned char>& lit) const {
+		int start = FindCell(lightPosition);
+		lit.assign(cells.size(), start < 0 ? 1 : 0);
+		if (start < 0) {
+			return;
+		}
+
+		std::vector<int> path;
+		VisitLitCell(start, lightPosition, range, path, lit);
+	}
+
+	void CellGraph::VisitLitCell(int cell, const glm::vec3& lightPosition, float range,
+		std::vector<int>& path, std::vector<unsigned char>& lit) const {
+		lit[cell] = 1;
+		if (path.size() >= MAX_PORTAL_DEPTH) {
+			return;
+		}
+		path.push_back(cell);
+
+		for (size_t i = 0; i < cells[cell].portals.size(); i++) {
+			const CellPortal& portal = portals[cells[cell].portals[i]];
+			int next = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+			if (std::find(path.begin(), path.end(), next) == path.end() &&
+				DistanceToBox(lightPosition, portal.boundsMin, portal.boundsMax) <= range) {
+				VisitLitCell(next, lightPosition, range, path, lit);
+			}
+		}
+
+		path.pop_back();
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef CellGraph_hpp
+#define CellGraph_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // A room of the scene: a box, the shapes it owns and the portals out of it
+    struct Cell
+    {
+        std::string name;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        // shape names of the source file (Mesh::name) placed in this cell
+        std::vector<std::string> meshNames;
+        // indices of the portals touching this cell
+        std::vector<size_t> portals;
+    };
+
+    // A door or window between two cells, as a quad
+    struct CellPortal
+    {
+        glm::vec3 corners[4];
+        int cells[2];
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    // Cells and portals read from a text file next to the model:
+    //
+    //   # comment
+    //   cell <name> <min x> <min y> <min z> <max x> <max y> <max z>
+    //   mesh <shape name>                  (owned by the last cell)
+    //   portal <cell> <cell> <x y z of the 4 corners, in order around the quad>
+    //
+    // The visible cells are found by walking the portals from the cell of the camera, each one
+    // narrowing the screen rectangle the next cells can be seen through
+    class CellGraph
+    {
+    public:
+        // Returns false if the file is missing or malformed, the graph is then empty
+        bool Load(const std::string& fileName);
+
+        bool IsEmpty() const;
+        size_t GetCellCount() const;
+        const Cell& GetCell(size_t cell) const;
+
+        // Smallest cell containing the point, -1 outside all of them
+        int FindCell(const glm::vec3& point) const;
+
+        // Cell a mesh belongs to: the one listing its name, otherwise the one containing the
+        // center of its box, -1 for meshes outside the cells (always drawn)
+        int FindMeshCell(const std::string& meshName, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+        // Sets visible[c] for the cells seen from `eye` through the portals. From outside all cells
+        // everything is visible
+        void ComputeVisibleCells(const glm::mat4& viewProjection, const glm::vec3& eye, std::vector<unsigned char>& visible) const;
+
+        // Sets lit[c] for the cells a point light reaches through portals closer than `range`
+        void ComputeLitCells(const glm::vec3& lightPosition, float range, std::vector<unsigned char>& lit) const;
+
+    private:
+        std::vector<Cell> cells;
+        std::vector<CellPortal> portals;
+
+        // normalized device coordinates
+        struct ScreenRect
+        {
+            float minX, minY, maxX, maxY;
+        };
+
+        void VisitCell(int cell, const ScreenRect& rect, const glm::mat4& viewProjection, const glm::vec3& eye,
+                       std::vector<int>& path, std::vector<unsigned char>& visible) const;
+        void VisitLitCell(int cell, const glm::vec3& lightPosition, float range,
+                          std::vector<int>& path, std::vector<unsigned char>& lit) const;
+
+        // Screen rectangle of the portal clipped by the near plane, false if nothing of it is in front
+        bool ProjectPortal(const CellPortal& portal, const glm::mat4& viewProjection, ScreenRect* rect) const;
+    };
+}
+
+#endif /* CellGraph_hpp */
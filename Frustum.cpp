@@ -0,0 +1,140 @@
+#include "Frustum.hpp"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+namespace gps {
+
+	Frustum::Frustum() {
+		for (int i = 0; i < 6; i++) {
+			planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+
+	Frustum::Frustum(const glm::mat4& matrix) {
+		glm::vec4 row0(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+		glm::vec4 row1(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+		glm::vec4 row2(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+		glm::vec4 row3(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+
+		planes[0] = row3 + row0;
+		planes[1] = row3 - row0;
+		planes[2] = row3 + row1;
+		planes[3] = row3 - row1;
+		planes[4] = row3 + row2;
+		planes[5] = row3 - row2;
+
+		Normalize();
+	}
+
+	Frustum Frustum::Transformed(const glm::mat4& modelMatrix) const {
+		// a point x of the model is inside when dot(plane, modelMatrix * x) >= 0
+		Frustum transformed;
+		glm::mat4 transposed = glm::transpose(modelMatrix);
+		for (int i = 0; i < 6; i++) {
+			transformed.planes[i] = transposed * planes[i];
+		}
+		transformed.Normalize();
+		return transformed;
+	}
+
+	// unit normals, so the plane equations give distances
+	void Frustum::Normalize() {
+		for (int i = 0; i < 6; i++) {
+			float length = glm::length(glm::vec3(planes[i]));
+			if (length > 0.0f) {
+				planes[i] /= length;
+			}
+		}
+	}
+
+	bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const {
+		for (int i = 0; i < 6; i++) {
+			if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Frustum::IntersectsBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, bool* inside) const {
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+		bool allInside = true;
+		for (int i = 0; i < 6; i++) {
+			float distance = glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
+			float radius = fabsf(planes[i].x) * extent.x + fabsf(planes[i].y) * extent.y + fabsf(planes[i].z) * extent.z;
+			if (distance < -radius) {
+				return false;
+			}
+			allInside = allInside && distance >= radius;
+		}
+		if (inside) {
+			*inside = allInside;
+		}
+		return true;
+	}
+
+	void Frustum::TestBoxes(const float* centerX, const float* centerY, const float* centerZ,
+		const float* extentX, const float* extentY, const float* extentZ,
+		size_t count, unsigned char* visible) const {
+		// a box is outside a plane when its center is further behind it than the
+		// projection of its half extents on the normal
+		size_t i = 0;
+
+#ifdef FRUSTUM_SSE
+		__m128 normalX[6], normalY[6], normalZ[6], distance[6];
+		__m128 absNormalX[6], absNormalY[6], absNormalZ[6];
+		for (int p = 0; p < 6; p++) {
+			normalX[p] = _mm_set1_ps(planes[p].x);
+			normalY[p] = _mm_set1_ps(planes[p].y);
+			normalZ[p] = _mm_set1_ps(planes[p].z);
+			distance[p] = _mm_set1_ps(planes[p].w);
+			absNormalX[p] = _mm_set1_ps(fabsf(planes[p].x));
+			absNormalY[p] = _mm_set1_ps(fabsf(planes[p].y));
+			absNormalZ[p] = _mm_set1_ps(fabsf(planes[p].z));
+		}
+		const __m128 zero = _mm_setzero_ps();
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 cx = _mm_loadu_ps(centerX + i);
+			__m128 cy = _mm_loadu_ps(centerY + i);
+			__m128 cz = _mm_loadu_ps(centerZ + i);
+			__m128 ex = _mm_loadu_ps(extentX + i);
+			__m128 ey = _mm_loadu_ps(extentY + i);
+			__m128 ez = _mm_loadu_ps(extentZ + i);
+
+			__m128 outside = zero;
+			for (int p = 0; p < 6; p++) {
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[p], cx), _mm_mul_ps(normalY[p], cy)),
+					_mm_add_ps(_mm_mul_ps(normalZ[p], cz), distance[p]));
+				__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absNormalX[p], ex), _mm_mul_ps(absNormalY[p], ey)),
+					_mm_mul_ps(absNormalZ[p], ez));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+			}
+
+			int mask = _mm_movemask_ps(outside);
+			visible[i + 0] = (mask & 1) == 0;
+			visible[i + 1] = (mask & 2) == 0;
+			visible[i + 2] = (mask & 4) == 0;
+			visible[i + 3] = (mask & 8) == 0;
+		}
+#endif
+
+		for (; i < count; i++) {
+			visible[i] = 1;
+			for (int p = 0; p < 6; p++) {
+				float d = planes[p].x * centerX[i] + planes[p].y * centerY[i] + planes[p].z * centerZ[i] + planes[p].w;
+				float r = fabsf(planes[p].x) * extentX[i] + fabsf(planes[p].y) * extentY[i] + fabsf(planes[p].z) * extentZ[i];
+				if (d + r < 0.0f) {
+					visible[i] = 0;
+					break;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    // The six clip planes of a projection (left, right, bottom, top, near, far), normals pointing inside
+    class Frustum
+    {
+    public:
+        // Planes that keep everything
+        Frustum();
+        // Planes of the clip volume of `matrix` (Gribb & Hartmann) - for projection * view they are in
+        // world space, with a model matrix appended in the space of the model
+        explicit Frustum(const glm::mat4& matrix);
+
+        // The same planes in the space of a model drawn with `modelMatrix`
+        Frustum Transformed(const glm::mat4& modelMatrix) const;
+
+        // False only if the sphere is completely outside one of the planes
+        bool IntersectsSphere(const glm::vec3& center, float radius) const;
+
+        // False only if the box is completely outside one of the planes. `inside` is set when
+        // it is completely inside all of them
+        bool IntersectsBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, bool* inside = NULL) const;
+
+        // Axis aligned boxes given by their centers and half extents, one array per coordinate.
+        // Sets visible[i] to 1 if box i is not completely outside a plane, otherwise to 0.
+        // Four boxes are tested at once with SSE when the compiler targets it
+        void TestBoxes(const float* centerX, const float* centerY, const float* centerZ,
+                       const float* extentX, const float* extentY, const float* extentZ,
+                       size_t count, unsigned char* visible) const;
+
+        glm::vec4 planes[6];
+
+    private:
+        void Normalize();
+    };
+}
+
+#endif /* Frustum_hpp */
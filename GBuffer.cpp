@@ -0,0 +1,82 @@
+#include "GBuffer.hpp"
+
+namespace gps {
+
+	GBuffer::GBuffer() : width(0), height(0), framebuffer(0), albedoSpecularTexture(0), normalTexture(0), depthTexture(0) {
+	}
+
+	// screen sized texture, sampled with nearest filtering
+	static GLuint CreateTarget(int width, int height, GLenum internalFormat, GLenum format, GLenum type) {
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return id;
+	}
+
+	void GBuffer::Resize(int width, int height) {
+		if (framebuffer != 0 && width == this->width && height == this->height) {
+			return;
+		}
+		Release();
+		this->width = width;
+		this->height = height;
+
+		albedoSpecularTexture = CreateTarget(width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+		normalTexture = CreateTarget(width, height, GL_RG16F, GL_RG, GL_HALF_FLOAT);
+		depthTexture = CreateTarget(width, height, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecularTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void GBuffer::Release() {
+		if (framebuffer == 0) {
+			return;
+		}
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &albedoSpecularTexture);
+		glDeleteTextures(1, &normalTexture);
+		glDeleteTextures(1, &depthTexture);
+		framebuffer = 0;
+	}
+
+	void GBuffer::BindForWriting() {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, width, height);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	void GBuffer::BindTextures(gps::Shader shader, GLint firstTextureUnit) const {
+		const char* samplers[3] = { "gAlbedoSpecular", "gNormal", "gDepth" };
+		GLuint textures[3] = { albedoSpecularTexture, normalTexture, depthTexture };
+		for (int t = 0; t < 3; t++) {
+			glActiveTexture(GL_TEXTURE0 + firstTextureUnit + t);
+			glBindTexture(GL_TEXTURE_2D, textures[t]);
+			glUniform1i(glGetUniformLocation(shader.shaderProgram, samplers[t]), firstTextureUnit + t);
+		}
+	}
+
+	int GBuffer::GetWidth() const {
+		return width;
+	}
+
+	int GBuffer::GetHeight() const {
+		return height;
+	}
+
+	size_t GBuffer::GetMemorySize() const {
+		return (size_t)width * height * (4 + 4 + 4);
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef GBuffer_hpp
+#define GBuffer_hpp
+
+#include "Shader.hpp"
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    // Render targets of the deferred path, 12 bytes per pixel: albedo and specular intensity (RGBA8),
+    // octahedral eye space normal (RG16F) and depth with stencil. The targets have one sample per pixel,
+    // unlike the 4x multisampled window, so the depth cannot be blitted to it: the lighting pass writes it
+    // back through gl_FragDepth for the forward draws that follow
+    class GBuffer
+    {
+    public:
+        GBuffer();
+
+        // (Re)creates the targets when the size changed
+        void Resize(int width, int height);
+
+        // Binds the framebuffer with both color targets, sets the viewport and clears it
+        void BindForWriting();
+        // Binds the targets to three units from `firstTextureUnit` on, for the DEFERRED permutation of shaderStart.frag
+        void BindTextures(gps::Shader shader, GLint firstTextureUnit) const;
+
+        int GetWidth() const;
+        int GetHeight() const;
+        size_t GetMemorySize() const;
+
+    private:
+        int width;
+        int height;
+        GLuint framebuffer;
+        GLuint albedoSpecularTexture;
+        GLuint normalTexture;
+        GLuint depthTexture;
+
+        void Release();
+    };
+}
+
+#endif /* GBuffer_hpp */
@@ -0,0 +1,294 @@
+#include "GeometryArena.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace gps {
+
+	RangeAllocator::RangeAllocator(GLuint capacity) {
+		if (capacity > 0) {
+			freeRanges[0] = capacity;
+		}
+	}
+
+	bool RangeAllocator::Allocate(GLuint size, GLuint* offset) {
+		for (std::map<GLuint, GLuint>::iterator range = freeRanges.begin(); range != freeRanges.end(); ++range) {
+			if (range->second < size) {
+				continue;
+			}
+
+			*offset = range->first;
+			GLuint remaining = range->second - size;
+			freeRanges.erase(range);
+			if (remaining > 0) {
+				freeRanges[*offset + size] = remaining;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	void RangeAllocator::Free(GLuint offset, GLuint size) {
+		if (size == 0) {
+			return;
+		}
+
+		std::map<GLuint, GLuint>::iterator next = freeRanges.lower_bound(offset);
+
+		// merge with the following free range
+		if (next != freeRanges.end() && offset + size == next->first) {
+			size += next->second;
+			next = freeRanges.erase(next);
+		}
+
+		// merge with the preceding free range
+		if (next != freeRanges.begin()) {
+			std::map<GLuint, GLuint>::iterator previous = next;
+			--previous;
+			if (previous->first + previous->second == offset) {
+				previous->second += size;
+				return;
+			}
+		}
+
+		freeRanges[offset] = size;
+	}
+
+	GeometryArena& GeometryArena::GetShared() {
+		// never destroyed: the global models release into it from their destructors at exit
+		static GeometryArena* sharedArena = new GeometryArena();
+		return *sharedArena;
+	}
+
+	GLuint GeometryArena::GetVertexArray(int block) const {
+		return blocks[block].VAO;
+	}
+
+	// Byte offset of the first index, for the glDrawElements* calls
+	GLvoid* GeometryArena::GetIndexOffset(const GeometryAllocation& allocation, GLuint firstIndex) {
+		size_t indexSize = allocation.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		return (GLvoid*)((allocation.firstIndex + firstIndex) * indexSize);
+	}
+
+	// Rounds to the nearest half float (ties to even), out of range values become infinities
+	static GLushort FloatToHalf(float value) {
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		unsigned int sign = (bits >> 16) & 0x8000;
+		unsigned int mantissa = bits & 0x7fffff;
+		int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+
+		if (((bits >> 23) & 0xff) == 0xff) {
+			return (GLushort)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+		}
+		if (exponent >= 31) {
+			return (GLushort)(sign | 0x7c00);
+		}
+
+		// subnormal halves keep fewer mantissa bits
+		unsigned int shift = 13;
+		unsigned int half = ((unsigned int)std::max(exponent, 0) << 10);
+		if (exponent <= 0) {
+			if (exponent < -10) {
+				return (GLushort)sign;
+			}
+			mantissa |= 0x800000;
+			shift = 14 - exponent;
+		}
+
+		unsigned int rest = mantissa & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		half += mantissa >> shift;
+		// a carry out of the mantissa correctly moves on to the next exponent
+		if (rest > halfway || (rest == halfway && (half & 1))) {
+			half++;
+		}
+		return (GLushort)(sign | half);
+	}
+
+	static GLshort FloatToSnorm16(float value) {
+		return (GLshort)floor(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f + 0.5f);
+	}
+
+	// Converts a vertex to the compressed layout
+	PackedVertex GeometryArena::PackVertex(const Vertex& vertex, const VertexFormat& format) {
+		PackedVertex packed;
+
+		// positions in [0, 1] inside the bounds, a flat axis maps to 0
+		for (int i = 0; i < 3; i++) {
+			float extent = format.boundsMax[i] - format.boundsMin[i];
+			float position = extent > 0.0f ? (vertex.Position[i] - format.boundsMin[i]) / extent : 0.0f;
+			packed.Position[i] = (GLushort)floor(std::min(std::max(position, 0.0f), 1.0f) * 65535.0f + 0.5f);
+		}
+
+		// octahedral mapping: project on the |x| + |y| + |z| = 1 octahedron, fold the lower half over
+		float x = vertex.Normal.x;
+		float y = vertex.Normal.y;
+		float z = vertex.Normal.z;
+		float length = fabs(x) + fabs(y) + fabs(z);
+		float u = 0.0f;
+		float v = 0.0f;
+		if (length > 0.0f) {
+			u = x / length;
+			v = y / length;
+			if (z < 0.0f) {
+				float foldedU = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+				float foldedV = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+				u = foldedU;
+				v = foldedV;
+			}
+		}
+		packed.Normal[0] = FloatToSnorm16(u);
+		packed.Normal[1] = FloatToSnorm16(v);
+
+		packed.TexCoords[0] = FloatToHalf(vertex.TexCoords.x);
+		packed.TexCoords[1] = FloatToHalf(vertex.TexCoords.y);
+		packed.Padding = 0;
+
+		return packed;
+	}
+
+	// Creates the buffers of a block and the vertex array describing its vertex layout
+	int GeometryArena::CreateBlock(GLuint vertexCount, GLuint indexCount, bool compressed, GLenum indexType) {
+		Block block;
+		block.vertexRanges = RangeAllocator(vertexCount);
+		block.indexRanges = RangeAllocator(indexCount);
+		block.compressed = compressed;
+		block.indexType = indexType;
+
+		size_t vertexSize = compressed ? sizeof(PackedVertex) : sizeof(Vertex);
+		size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+		glGenVertexArrays(1, &block.VAO);
+		glGenBuffers(1, &block.VBO);
+		glGenBuffers(1, &block.EBO);
+
+		glBindVertexArray(block.VAO);
+
+		// immutable storage needs ARB_buffer_storage (core in 4.4), the context is 4.1
+		glBindBuffer(GL_ARRAY_BUFFER, block.VBO);
+		if (GLEW_ARB_buffer_storage) {
+			glBufferStorage(GL_ARRAY_BUFFER, vertexCount * vertexSize, NULL, GL_DYNAMIC_STORAGE_BIT);
+		}
+		else {
+			glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexSize, NULL, GL_STATIC_DRAW);
+		}
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.EBO);
+		if (GLEW_ARB_buffer_storage) {
+			glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, NULL, GL_DYNAMIC_STORAGE_BIT);
+		}
+		else {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, NULL, GL_STATIC_DRAW);
+		}
+
+		// Set the vertex attribute pointers
+		if (compressed) {
+			// the shaders get positions in [0, 1], the octahedral xy in vNormal.xy and plain texture coordinates
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+		}
+		else {
+			// Vertex Positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+			// Vertex Normals
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		}
+
+		glBindVertexArray(0);
+
+		blocks.push_back(block);
+		return (int)blocks.size() - 1;
+	}
+
+	GeometryAllocation GeometryArena::Allocate(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+		const VertexFormat& format) {
+		GeometryAllocation allocation;
+		allocation.block = -1;
+		allocation.baseVertex = 0;
+		allocation.firstIndex = 0;
+		allocation.vertexCount = (GLuint)vertices.size();
+		allocation.indexCount = (GLuint)indices.size();
+		allocation.compressed = format.compressed;
+		// indices are relative to the base vertex, so they fit 16 bits up to 65536 vertices
+		allocation.indexType = format.compressed && vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+		if (vertices.empty() || indices.empty()) {
+			return allocation;
+		}
+
+		GLuint firstVertex = 0;
+		for (size_t b = 0; b < blocks.size() && allocation.block < 0; b++) {
+			if (blocks[b].compressed != allocation.compressed || blocks[b].indexType != allocation.indexType) {
+				continue;
+			}
+			if (!blocks[b].vertexRanges.Allocate(allocation.vertexCount, &firstVertex)) {
+				continue;
+			}
+			if (!blocks[b].indexRanges.Allocate(allocation.indexCount, &allocation.firstIndex)) {
+				blocks[b].vertexRanges.Free(firstVertex, allocation.vertexCount);
+				continue;
+			}
+			allocation.block = (int)b;
+		}
+
+		// meshes larger than a block get a block of their own
+		if (allocation.block < 0) {
+			allocation.block = CreateBlock(std::max(BLOCK_VERTEX_COUNT, allocation.vertexCount),
+				std::max(BLOCK_INDEX_COUNT, allocation.indexCount), allocation.compressed, allocation.indexType);
+			blocks[allocation.block].vertexRanges.Allocate(allocation.vertexCount, &firstVertex);
+			blocks[allocation.block].indexRanges.Allocate(allocation.indexCount, &allocation.firstIndex);
+		}
+		allocation.baseVertex = (GLint)firstVertex;
+
+		// the copy targets do not touch the element buffer binding of the bound vertex array
+		const Block& block = blocks[allocation.block];
+		glBindBuffer(GL_COPY_WRITE_BUFFER, block.VBO);
+		if (allocation.compressed) {
+			std::vector<PackedVertex> packedVertices(vertices.size());
+			for (size_t i = 0; i < vertices.size(); i++) {
+				packedVertices[i] = PackVertex(vertices[i], format);
+			}
+			glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * sizeof(PackedVertex),
+				packedVertices.size() * sizeof(PackedVertex), &packedVertices[0]);
+		}
+		else {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * sizeof(Vertex), vertices.size() * sizeof(Vertex), &vertices[0]);
+		}
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, block.EBO);
+		if (allocation.indexType == GL_UNSIGNED_SHORT) {
+			std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+			glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstIndex * sizeof(GLushort),
+				shortIndices.size() * sizeof(GLushort), &shortIndices[0]);
+		}
+		else {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstIndex * sizeof(GLuint), indices.size() * sizeof(GLuint), &indices[0]);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		return allocation;
+	}
+
+	void GeometryArena::Free(const GeometryAllocation& allocation) {
+		if (allocation.block < 0) {
+			return;
+		}
+
+		Block& block = blocks[allocation.block];
+		block.vertexRanges.Free((GLuint)allocation.baseVertex, allocation.vertexCount);
+		block.indexRanges.Free(allocation.firstIndex, allocation.indexCount);
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#include "Mesh.hpp"
+
+#include <map>
+#include <vector>
+
+namespace gps {
+
+    // First-fit allocator of element ranges inside a buffer, freed ranges are merged with their neighbours
+    class RangeAllocator
+    {
+    public:
+        explicit RangeAllocator(GLuint capacity = 0);
+
+        // Returns false when there is no free range large enough
+        bool Allocate(GLuint size, GLuint* offset);
+        void Free(GLuint offset, GLuint size);
+
+    private:
+        // offset -> size of the free ranges
+        std::map<GLuint, GLuint> freeRanges;
+    };
+
+    // Vertex and index buffers shared by all the meshes. The meshes are suballocated from a few
+    // large blocks, each block having one vertex array object, so consecutive meshes of a block are
+    // drawn without switching vertex arrays and can be batched in a single multi draw call
+    class GeometryArena
+    {
+    public:
+        // Copies the mesh data into a block of the same format with enough free space
+        // (creating a new block if needed), packing the vertices for compressed formats
+        GeometryAllocation Allocate(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+                                    const VertexFormat& format);
+        void Free(const GeometryAllocation& allocation);
+
+        GLuint GetVertexArray(int block) const;
+
+        // Byte offset of the first index (or of `firstIndex` within the allocation), for the glDrawElements* calls
+        static GLvoid* GetIndexOffset(const GeometryAllocation& allocation, GLuint firstIndex = 0);
+
+        // Converts a vertex to the compressed layout
+        static PackedVertex PackVertex(const Vertex& vertex, const VertexFormat& format);
+
+        static GeometryArena& GetShared();
+
+    private:
+        static const GLuint BLOCK_VERTEX_COUNT = 1 << 20;
+        static const GLuint BLOCK_INDEX_COUNT = 1 << 22;
+
+        struct Block {
+            GLuint VAO;
+            GLuint VBO;
+            GLuint EBO;
+            RangeAllocator vertexRanges;
+            RangeAllocator indexRanges;
+            bool compressed;
+            GLenum indexType;
+        };
+
+        std::vector<Block> blocks;
+
+        int CreateBlock(GLuint vertexCount, GLuint indexCount, bool compressed, GLenum indexType);
+    };
+}
+
+#endif /* GeometryArena_hpp */
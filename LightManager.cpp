@@ -0,0 +1,232 @@
+#include "LightManager.hpp"
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+	LightManager::LightManager() : clusterProjection(0.0f), nearPlane(0.1f), farPlane(100.0f), tileSize(1.0f), visibleLights(0),
+		lightBuffer(0), lightTexture(0), clusterBuffer(0), clusterTexture(0), indexBuffer(0), indexTexture(0) {
+	}
+
+	// texture buffer of `format` over a new buffer object
+	static void CreateTextureBuffer(GLenum format, GLuint& buffer, GLuint& texture) {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	static void UploadBuffer(GLuint buffer, const void* data, size_t size) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		// orphaned every frame, so the driver does not wait for the draws still reading the old data
+		glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+		if (size > 0) {
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void LightManager::Init() {
+		CreateTextureBuffer(GL_RGBA32F, lightBuffer, lightTexture);
+		CreateTextureBuffer(GL_RG32UI, clusterBuffer, clusterTexture);
+		CreateTextureBuffer(GL_R32UI, indexBuffer, indexTexture);
+	}
+
+	int LightManager::AddPointLight(const glm::vec3& position, const glm::vec3& color, float range) {
+		LightSource light;
+		light.type = POINT_LIGHT;
+		light.enabled = true;
+		light.position = position;
+		light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+		light.color = color;
+		light.range = range;
+		light.innerAngle = light.outerAngle = 3.14159265f;
+		light.shadowIndex = -1;
+		lights.push_back(light);
+		return (int)lights.size() - 1;
+	}
+
+	int LightManager::AddSpotLight(const glm::vec3& position, const glm::vec3& direction, const glm::vec3& color, float range,
+		float innerAngle, float outerAngle) {
+		int index = AddPointLight(position, color, range);
+		lights[index].type = SPOT_LIGHT;
+		lights[index].direction = glm::normalize(direction);
+		lights[index].innerAngle = innerAngle;
+		lights[index].outerAngle = outerAngle;
+		return index;
+	}
+
+	LightSource& LightManager::GetLight(int index) {
+		return lights[index];
+	}
+
+	int LightManager::GetLightCount() const {
+		return (int)lights.size();
+	}
+
+	void LightManager::BuildClusterBounds(const glm::mat4& projection) {
+		clusterProjection = projection;
+		nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+		farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+
+		clusterBounds.resize(CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z);
+		for (int z = 0; z < CLUSTERS_Z; z++) {
+			float sliceNear = nearPlane * powf(farPlane / nearPlane, (float)z / CLUSTERS_Z);
+			float sliceFar = nearPlane * powf(farPlane / nearPlane, (float)(z + 1) / CLUSTERS_Z);
+			for (int y = 0; y < CLUSTERS_Y; y++) {
+				float y0 = -1.0f + 2.0f * y / CLUSTERS_Y;
+				float y1 = -1.0f + 2.0f * (y + 1) / CLUSTERS_Y;
+				for (int x = 0; x < CLUSTERS_X; x++) {
+					float x0 = -1.0f + 2.0f * x / CLUSTERS_X;
+					float x1 = -1.0f + 2.0f * (x + 1) / CLUSTERS_X;
+					// the tile widens with the depth, the box holds it at both ends of the slice
+					ClusterBounds& bounds = clusterBounds[(z * CLUSTERS_Y + y) * CLUSTERS_X + x];
+					bounds.boundsMin = glm::vec3(std::min(x0 * sliceNear, x0 * sliceFar) / projection[0][0],
+						std::min(y0 * sliceNear, y0 * sliceFar) / projection[1][1], -sliceFar);
+					bounds.boundsMax = glm::vec3(std::max(x1 * sliceNear, x1 * sliceFar) / projection[0][0],
+						std::max(y1 * sliceNear, y1 * sliceFar) / projection[1][1], -sliceNear);
+				}
+			}
+		}
+	}
+
+	void LightManager::Update(const glm::mat4& view, const glm::mat4& projection, int viewportWidth, int viewportHeight) {
+		if (clusterBounds.empty() || projection != clusterProjection) {
+			BuildClusterBounds(projection);
+		}
+		tileSize = glm::vec2((float)viewportWidth / CLUSTERS_X, (float)viewportHeight / CLUSTERS_Y);
+		float sliceScale = CLUSTERS_Z / logf(farPlane / nearPlane);
+
+		lightTexels.clear();
+		visibleLights = 0;
+		// (cluster, light) pairs, sorted by cluster below
+		std::vector<GLuint> pairs;
+		std::vector<GLuint> clusterCounts(clusterBounds.size(), 0);
+
+		for (size_t l = 0; l < lights.size(); l++) {
+			const LightSource& light = lights[l];
+			if (!light.enabled) {
+				continue;
+			}
+			glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+			float depthMin = std::max(-center.z - light.range, nearPlane);
+			float depthMax = std::min(-center.z + light.range, farPlane);
+			if (depthMin > depthMax) {
+				continue;
+			}
+			int sliceMin = std::max((int)(logf(depthMin / nearPlane) * sliceScale), 0);
+			int sliceMax = std::min((int)(logf(depthMax / nearPlane) * sliceScale), CLUSTERS_Z - 1);
+
+			// tiles covered by the box around the sphere, projected at both ends of its depths
+			float ndcMin[2] = { 1.0f, 1.0f };
+			float ndcMax[2] = { -1.0f, -1.0f };
+			for (int axis = 0; axis < 2; axis++) {
+				for (int side = 0; side < 2; side++) {
+					float coordinate = center[axis] + (side ? light.range : -light.range);
+					for (int end = 0; end < 2; end++) {
+						float ndc = projection[axis][axis] * coordinate / (end ? depthMax : depthMin);
+						ndcMin[axis] = std::min(ndcMin[axis], ndc);
+						ndcMax[axis] = std::max(ndcMax[axis], ndc);
+					}
+				}
+			}
+			if (ndcMax[0] < -1.0f || ndcMin[0] > 1.0f || ndcMax[1] < -1.0f || ndcMin[1] > 1.0f) {
+				continue;
+			}
+			int tileMinX = std::max((int)floorf((ndcMin[0] * 0.5f + 0.5f) * CLUSTERS_X), 0);
+			int tileMaxX = std::min((int)floorf((ndcMax[0] * 0.5f + 0.5f) * CLUSTERS_X), CLUSTERS_X - 1);
+			int tileMinY = std::max((int)floorf((ndcMin[1] * 0.5f + 0.5f) * CLUSTERS_Y), 0);
+			int tileMaxY = std::min((int)floorf((ndcMax[1] * 0.5f + 0.5f) * CLUSTERS_Y), CLUSTERS_Y - 1);
+
+			glm::vec3 direction = glm::normalize(glm::mat3(view) * light.direction);
+			float cosOuter = cosf(light.outerAngle);
+			float sinOuter = sinf(light.outerAngle);
+			GLuint index = (GLuint)(lightTexels.size() / 4);
+			size_t firstPair = pairs.size();
+			for (int z = sliceMin; z <= sliceMax; z++) {
+				for (int y = tileMinY; y <= tileMaxY; y++) {
+					for (int x = tileMinX; x <= tileMaxX; x++) {
+						GLuint cluster = (GLuint)((z * CLUSTERS_Y + y) * CLUSTERS_X + x);
+						const ClusterBounds& bounds = clusterBounds[cluster];
+						glm::vec3 closest = glm::clamp(center, bounds.boundsMin, bounds.boundsMax);
+						if (glm::dot(closest - center, closest - center) > light.range * light.range) {
+							continue;
+						}
+						if (light.type == SPOT_LIGHT) {
+							// cone against the bounding sphere of the cluster
+							glm::vec3 sphereCenter = (bounds.boundsMin + bounds.boundsMax) * 0.5f;
+							float sphereRadius = glm::length(bounds.boundsMax - sphereCenter);
+							glm::vec3 toSphere = sphereCenter - center;
+							float alongAxis = glm::dot(toSphere, direction);
+							float fromAxis = sqrtf(std::max(glm::dot(toSphere, toSphere) - alongAxis * alongAxis, 0.0f));
+							if (cosOuter * fromAxis - sinOuter * alongAxis > sphereRadius || alongAxis < -sphereRadius) {
+								continue;
+							}
+						}
+						pairs.push_back(cluster);
+						pairs.push_back(index);
+						clusterCounts[cluster]++;
+					}
+				}
+			}
+			if (pairs.size() == firstPair) {
+				continue;
+			}
+
+			visibleLights++;
+			lightTexels.push_back(glm::vec4(center, light.range));
+			lightTexels.push_back(glm::vec4(light.color, light.type == SPOT_LIGHT ? 1.0f : 0.0f));
+			lightTexels.push_back(glm::vec4(direction, cosOuter));
+			lightTexels.push_back(glm::vec4(cosf(light.innerAngle), (float)light.shadowIndex, 0.0f, 0.0f));
+		}
+
+		// the lists of the clusters one after the other
+		clusterTexels.resize(clusterBounds.size() * 2);
+		GLuint offset = 0;
+		for (size_t c = 0; c < clusterBounds.size(); c++) {
+			clusterTexels[c * 2] = offset;
+			clusterTexels[c * 2 + 1] = 0;
+			offset += clusterCounts[c];
+		}
+		lightIndices.resize(offset);
+		for (size_t p = 0; p < pairs.size(); p += 2) {
+			GLuint* range = &clusterTexels[pairs[p] * 2];
+			lightIndices[range[0] + range[1]++] = pairs[p + 1];
+		}
+
+		UploadBuffer(lightBuffer, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+		UploadBuffer(clusterBuffer, clusterTexels.data(), clusterTexels.size() * sizeof(GLuint));
+		UploadBuffer(indexBuffer, lightIndices.data(), lightIndices.size() * sizeof(GLuint));
+	}
+
+	int LightManager::GetVisibleLightCount() const {
+		return visibleLights;
+	}
+
+	int LightManager::GetClusterEntryCount() const {
+		return (int)lightIndices.size();
+	}
+
+	void LightManager::SetUniforms(gps::Shader shader, GLint firstTextureUnit) const {
+		const char* samplers[3] = { "lightData", "clusterGrid", "clusterLightIndices" };
+		GLuint textures[3] = { lightTexture, clusterTexture, indexTexture };
+		for (int t = 0; t < 3; t++) {
+			glActiveTexture(GL_TEXTURE0 + firstTextureUnit + t);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[t]);
+			glUniform1i(glGetUniformLocation(shader.shaderProgram, samplers[t]), firstTextureUnit + t);
+		}
+
+		float sliceScale = CLUSTERS_Z / logf(farPlane / nearPlane);
+		glUniform3i(glGetUniformLocation(shader.shaderProgram, "clusterCounts"), CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+		glUniform2fv(glGetUniformLocation(shader.shaderProgram, "clusterTileSize"), 1, glm::value_ptr(tileSize));
+		glUniform1f(glGetUniformLocation(shader.shaderProgram, "clusterDepthScale"), sliceScale);
+		glUniform1f(glGetUniformLocation(shader.shaderProgram, "clusterDepthBias"), -logf(nearPlane) * sliceScale);
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef LightManager_hpp
+#define LightManager_hpp
+
+#include "Shader.hpp"
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    enum LightType { POINT_LIGHT, SPOT_LIGHT };
+
+    // A point or spot light in world space, shaded by computePointLight in shaderStart.frag
+    struct LightSource
+    {
+        LightType type;
+        bool enabled;
+        glm::vec3 position;
+        // spot lights only, the direction the light shines in
+        glm::vec3 direction;
+        glm::vec3 color;
+        // nothing is lit past it
+        float range;
+        // spot lights only, full intensity inside the inner angle and none outside the outer one (radians)
+        float innerAngle;
+        float outerAngle;
+        // tile set of the light in PointShadowAtlas, -1 for a light without shadows
+        int shadowIndex;
+    };
+
+    // Clustered forward shading: the view frustum is cut into a 16 x 9 x 24 grid (exponential depth
+    // slices) and each cluster gets the list of the lights reaching into it, so a fragment only loops
+    // over the lights that can touch it. The lights are moved to eye space and culled on the CPU once
+    // per frame, the lights, the grid and the lists go to the shader as texture buffers
+    class LightManager
+    {
+    public:
+        static const int CLUSTERS_X = 16;
+        static const int CLUSTERS_Y = 9;
+        static const int CLUSTERS_Z = 24;
+
+        LightManager();
+
+        // Creates the texture buffers
+        void Init();
+
+        // Returns the index of the new light
+        int AddPointLight(const glm::vec3& position, const glm::vec3& color, float range);
+        int AddSpotLight(const glm::vec3& position, const glm::vec3& direction, const glm::vec3& color, float range,
+                         float innerAngle, float outerAngle);
+        LightSource& GetLight(int index);
+        int GetLightCount() const;
+
+        // Moves the lights to eye space, builds the light list of every cluster and uploads them
+        void Update(const glm::mat4& view, const glm::mat4& projection, int viewportWidth, int viewportHeight);
+
+        // Lights that reached at least one cluster in the last Update
+        int GetVisibleLightCount() const;
+        // Length of all the cluster lists together
+        int GetClusterEntryCount() const;
+
+        // Binds the three texture buffers from `firstTextureUnit` on and sets the uniforms read by
+        // computeClusteredLights in shaderStart.frag
+        void SetUniforms(gps::Shader shader, GLint firstTextureUnit) const;
+
+    private:
+        struct ClusterBounds
+        {
+            glm::vec3 boundsMin;
+            glm::vec3 boundsMax;
+        };
+
+        std::vector<LightSource> lights;
+
+        // eye space boxes of the clusters, rebuilt when the projection changes
+        std::vector<ClusterBounds> clusterBounds;
+        glm::mat4 clusterProjection;
+        float nearPlane;
+        float farPlane;
+        glm::vec2 tileSize;
+
+        // 4 RGBA32F texels per light: eye position and range, color and type,
+        // eye direction and cosine of the outer angle, cosine of the inner angle and shadow index
+        std::vector<glm::vec4> lightTexels;
+        // RG32UI per cluster: first entry in clusterLightIndices and count
+        std::vector<GLuint> clusterTexels;
+        std::vector<GLuint> lightIndices;
+        int visibleLights;
+
+        GLuint lightBuffer;
+        GLuint lightTexture;
+        GLuint clusterBuffer;
+        GLuint clusterTexture;
+        GLuint indexBuffer;
+        GLuint indexTexture;
+
+        // Eye space boxes of the clusters for `projection`
+        void BuildClusterBounds(const glm::mat4& projection);
+    };
+}
+
+#endif /* LightManager_hpp */
@@ -0,0 +1,121 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+#ifdef _WIN32
+	MappedFile::MappedFile() : data(NULL), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL) {
+	}
+#else
+	MappedFile::MappedFile() : data(NULL), size(0), fileDescriptor(-1) {
+	}
+#endif
+
+	MappedFile::~MappedFile() {
+		Close();
+	}
+
+	// Maps the file, returns false if it does not exist or cannot be mapped. An empty file opens as an empty range
+	bool MappedFile::Open(const std::string& fileName) {
+		Close();
+
+#ifdef _WIN32
+		fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (fileHandle == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize)) {
+			Close();
+			return false;
+		}
+		if (fileSize.QuadPart == 0) {
+			return true;
+		}
+		size = (size_t)fileSize.QuadPart;
+
+		mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mappingHandle == NULL) {
+			Close();
+			return false;
+		}
+
+		data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		if (data == NULL) {
+			Close();
+			return false;
+		}
+#else
+		fileDescriptor = open(fileName.c_str(), O_RDONLY);
+		if (fileDescriptor < 0) {
+			return false;
+		}
+
+		struct stat fileStat;
+		if (fstat(fileDescriptor, &fileStat) != 0) {
+			Close();
+			return false;
+		}
+		if (fileStat.st_size == 0) {
+			return true;
+		}
+		size = (size_t)fileStat.st_size;
+
+		void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (mapped == MAP_FAILED) {
+			Close();
+			return false;
+		}
+		// the files are read front to back by the parsers and the hashes
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		data = (const unsigned char*)mapped;
+#endif
+		return true;
+	}
+
+	void MappedFile::Close() {
+#ifdef _WIN32
+		if (data) {
+			UnmapViewOfFile(data);
+		}
+		if (mappingHandle) {
+			CloseHandle(mappingHandle);
+		}
+		if (fileHandle != INVALID_HANDLE_VALUE) {
+			CloseHandle(fileHandle);
+		}
+		mappingHandle = NULL;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (data) {
+			munmap((void*)data, size);
+		}
+		if (fileDescriptor >= 0) {
+			close(fileDescriptor);
+		}
+		fileDescriptor = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	const unsigned char* MappedFile::GetData() const {
+		return data;
+	}
+
+	size_t MappedFile::GetSize() const {
+		return size;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <string>
+
+namespace gps {
+
+    // Read-only view of a whole file mapped into the address space, also used by the tinyobj loader
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        // Maps the file, returns false if it does not exist or cannot be mapped. An empty file
+        // opens as an empty range, with no data
+        bool Open(const std::string& fileName);
+        void Close();
+
+        const unsigned char* GetData() const;
+        size_t GetSize() const;
+
+    private:
+        const unsigned char* data;
+        size_t size;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#else
+        int fileDescriptor;
+#endif
+
+        // a mapping owns OS handles, so it is not copyable
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+    };
+}
+
+#endif /* MappedFile_hpp */
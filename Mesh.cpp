@@ -1,18 +1,49 @@
 #include "Mesh.hpp"
+#include "GeometryArena.hpp"
+#include "MeshletBuilder.hpp"
+
+#include <utility>
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		const VertexFormat& format, std::vector<MeshLod> lods, std::vector<Meshlet> meshlets)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->lods = std::move(lods);
+		this->meshlets = std::move(meshlets);
+
+		if (this->lods.empty()) {
+			MeshLod lod;
+			lod.firstIndex = 0;
+			lod.indexCount = (GLuint)this->indices.size();
+			lod.error = 0.0f;
+			lod.firstMeshlet = 0;
+			lod.meshletCount = 0;
+			this->lods.push_back(lod);
+		}
+		if (this->meshlets.empty()) {
+			MeshletBuilder::Build(this->vertices, this->indices, this->lods, this->meshlets);
+		}
+
+		// the sphere goes around the box, good enough for the level of detail selection
+		this->boundsMin = glm::vec3(0.0f);
+		this->boundsMax = glm::vec3(0.0f);
+		for (size_t v = 0; v < this->vertices.size(); v++) {
+			this->boundsMin = v == 0 ? this->vertices[v].Position : glm::min(this->boundsMin, this->vertices[v].Position);
+			this->boundsMax = v == 0 ? this->vertices[v].Position : glm::max(this->boundsMax, this->vertices[v].Position);
+		}
+		this->boundsCenter = (this->boundsMin + this->boundsMax) * 0.5f;
+		this->boundsRadius = glm::length(this->boundsMax - this->boundsMin) * 0.5f;
 
-		this->setupMesh();
+		this->setupMesh(format);
 	}
 
-	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+	const GeometryAllocation& Mesh::getAllocation() const {
+	    return this->allocation;
 	}
 
 	/* Mesh drawing function - also applies associated textures */
@@ -28,9 +59,12 @@ namespace gps {
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		if (this->allocation.block >= 0) {
+			glBindVertexArray(GeometryArena::GetShared().GetVertexArray(this->allocation.block));
+			glDrawElementsBaseVertex(GL_TRIANGLES, this->lods[0].indexCount, this->allocation.indexType,
+				GeometryArena::GetIndexOffset(this->allocation, this->lods[0].firstIndex), this->allocation.baseVertex);
+			glBindVertexArray(0);
+		}
 
         for(GLuint i = 0; i < this->textures.size(); i++)
         {
@@ -40,32 +74,14 @@ namespace gps {
 
     }
 
-	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh(){
-		// Create buffers/arrays
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
-
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+	// Returns the vertices and indices to the geometry arena
+	void Mesh::releaseBuffers() {
+		GeometryArena::GetShared().Free(this->allocation);
+		this->allocation.block = -1;
+	}
 
-		glBindVertexArray(0);
+	// Copies the vertices and indices into the geometry arena
+	void Mesh::setupMesh(const VertexFormat& format){
+		this->allocation = GeometryArena::GetShared().Allocate(this->vertices, this->indices, format);
 	}
 }
@@ -19,6 +19,29 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// Compressed vertex layout (16 bytes instead of 32): positions as unorm16 inside the
+// bounds of the model, octahedral normals in 2 x snorm16 and half float texture coordinates
+struct PackedVertex
+{
+    GLushort Position[3];
+    GLshort Normal[2];
+    GLushort TexCoords[2];
+    GLushort Padding;
+};
+
+// How the vertices of a mesh are stored on the GPU
+struct VertexFormat
+{
+    // PackedVertex and 16 bit indices (for meshes of up to 65536 vertices) instead of Vertex
+    bool compressed;
+    // box the compressed positions are quantized to - shared by all the meshes of a model,
+    // so its draws can use the same decoding uniforms
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    VertexFormat() : compressed(false), boundsMin(0.0f), boundsMax(0.0f) {}
+};
+
 struct Texture
 {
     GLuint id;
@@ -34,31 +57,79 @@ struct Material
         glm::vec3 specular;
     };
 
-struct Buffers {
-    GLuint VAO;
-    GLuint VBO;
-    GLuint EBO;
+// Place of a mesh in the shared geometry arena
+struct GeometryAllocation {
+    // arena block holding the data, -1 for an empty mesh
+    int block;
+    GLint baseVertex;
+    GLuint firstIndex;
+    GLuint vertexCount;
+    GLuint indexCount;
+    // GL_UNSIGNED_INT, or GL_UNSIGNED_SHORT for compressed meshes
+    GLenum indexType;
+    bool compressed;
+};
+
+// A level of detail of a mesh: a range of its index buffer, all the levels share the vertices
+struct MeshLod {
+    GLuint firstIndex;
+    GLuint indexCount;
+    // object space distance the level may be off from the full detail mesh
+    float error;
+    // the meshlets splitting the range
+    GLuint firstMeshlet;
+    GLuint meshletCount;
+};
+
+// Cluster of up to 64 vertices and 124 triangles (see MeshletBuilder), a range of a level's indices
+// with the bounds used to cull it
+struct Meshlet {
+    GLuint firstIndex;
+    GLuint indexCount;
+    glm::vec3 center;
+    float radius;
+    // all the triangles face away from a viewer at p when dot(center - p, coneAxis) >= coneCutoff * |center - p| + radius
+    glm::vec3 coneAxis;
+    float coneCutoff;
 };
 
 class Mesh
 {
 public:
     std::vector<Vertex> vertices;
+    // the indices of all the levels of detail, the full detail level first
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
-
-	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
-
-	Buffers getBuffers();
-
+    // name of the shape in the source file, empty for merged meshes
+    std::string name;
+    // ranges of `indices`, from the full detail level to the coarsest one
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    // bounding box and sphere of the vertices
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+
+	// Without `lods` all the indices are a single level, without `meshlets` they are built here
+	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		const VertexFormat& format = VertexFormat(), std::vector<MeshLod> lods = std::vector<MeshLod>(),
+		std::vector<Meshlet> meshlets = std::vector<Meshlet>());
+
+	const GeometryAllocation& getAllocation() const;
+
+	// Draws the full detail level
 	void Draw(gps::Shader shader);
 
+	// Returns the vertices and indices to the geometry arena
+	void releaseBuffers();
+
 private:
     /*  Render data  */
-    Buffers buffers;
+    GeometryAllocation allocation;
 
-	// Initializes all the buffer objects/arrays
-	void setupMesh();
+	// Copies the vertices and indices into the geometry arena
+	void setupMesh(const VertexFormat& format);
 
 };
 
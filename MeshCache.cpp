@@ -0,0 +1,562 @@
+#include "MeshCache.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+	// bump whenever the layout below, gps::Vertex or the import processing changes
+	// (2: meshes reordered by MeshOptimizer, 3: levels of detail, 4: meshlets, 5: shape names,
+	// 6: .mtl files and base path in the key)
+	static const unsigned int CACHE_VERSION = 6;
+	static const char CACHE_MAGIC[4] = { 'G', 'P', 'S', 'M' };
+
+	// File layout:
+	//   CacheHeader
+	//   CacheDependency[dependencyCount] (the .obj file, then its .mtl files)
+	//   CacheShape[shapeCount]
+	//   CacheLod[lodCount]
+	//   CacheMeshlet[meshletCount]
+	//   CacheTexture[textureCount]
+	//   string table (base path, dependency paths, shape names, texture types and paths)
+	//   vertex data (16 byte aligned)
+	//   index data
+	struct CacheHeader {
+		char magic[4];
+		unsigned int version;
+		unsigned int vertexSize;
+		unsigned int dependencyCount;
+		unsigned int shapeCount;
+		unsigned int lodCount;
+		unsigned int meshletCount;
+		unsigned int textureCount;
+		unsigned int stringTableSize;
+		// the textures paths were resolved against it
+		unsigned int basePathOffset;
+		unsigned int basePathLength;
+		unsigned long long vertexDataOffset;
+		unsigned long long indexDataOffset;
+		unsigned long long fileSize;
+	};
+
+	// A file the cached content was built from, the cache is stale as soon as one of them changes
+	struct CacheDependency {
+		unsigned int pathOffset;
+		unsigned int pathLength;
+		// MISSING_FILE_SIZE if the file did not exist
+		unsigned long long size;
+		long long modificationTime;
+		unsigned long long hash;
+	};
+
+	static const unsigned long long MISSING_FILE_SIZE = ~0ull;
+
+	struct CacheShape {
+		unsigned long long firstVertex;
+		unsigned long long firstIndex;
+		unsigned int vertexCount;
+		unsigned int indexCount;
+		unsigned int firstTexture;
+		unsigned int textureCount;
+		unsigned int firstLod;
+		unsigned int lodCount;
+		unsigned int firstMeshlet;
+		unsigned int meshletCount;
+		unsigned int nameOffset;
+		unsigned int nameLength;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	struct CacheLod {
+		unsigned int firstIndex;
+		unsigned int indexCount;
+		float error;
+		unsigned int firstMeshlet;
+		unsigned int meshletCount;
+	};
+
+	struct CacheMeshlet {
+		unsigned int firstIndex;
+		unsigned int indexCount;
+		float center[3];
+		float radius;
+		float coneAxis[3];
+		float coneCutoff;
+	};
+
+	struct CacheTexture {
+		unsigned int typeOffset;
+		unsigned int typeLength;
+		unsigned int pathOffset;
+		unsigned int pathLength;
+	};
+
+	// FNV-1a over the whole file content
+	static unsigned long long HashBytes(const unsigned char* data, size_t size) {
+		unsigned long long hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ data[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	static bool HashFile(const std::string& fileName, unsigned long long* hash) {
+		MappedFile source;
+		if (!source.Open(fileName)) {
+			return false;
+		}
+		*hash = HashBytes(source.GetData(), source.GetSize());
+		return true;
+	}
+
+	static bool StatFile(const std::string& fileName, unsigned long long* size, long long* modificationTime) {
+		struct stat fileStat;
+		if (stat(fileName.c_str(), &fileStat) != 0) {
+			return false;
+		}
+		*size = (unsigned long long)fileStat.st_size;
+		*modificationTime = (long long)fileStat.st_mtime;
+		return true;
+	}
+
+	static unsigned long long AlignTo(unsigned long long offset, unsigned long long alignment) {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// `count` items from `first` fit in `total`
+	static bool InRange(unsigned long long first, unsigned long long count, unsigned long long total) {
+		return first <= total && count <= total - first;
+	}
+
+	// The size, mtime and hash of a dependency, or MISSING_FILE_SIZE if it does not exist
+	static bool DescribeFile(const std::string& fileName, CacheDependency* dependency) {
+		dependency->size = MISSING_FILE_SIZE;
+		dependency->modificationTime = 0;
+		dependency->hash = 0;
+		if (!StatFile(fileName, &dependency->size, &dependency->modificationTime)) {
+			dependency->size = MISSING_FILE_SIZE;
+			return true;
+		}
+		return HashFile(fileName, &dependency->hash);
+	}
+
+	// The .mtl files named by the mtllib lines of an .obj, resolved as tinyobj does
+	static std::vector<std::string> FindMaterialFiles(const std::string& fileName, const std::string& basePath) {
+		std::vector<std::string> materialFiles;
+		MappedFile source;
+		if (!source.Open(fileName)) {
+			return materialFiles;
+		}
+		const char* data = (const char*)source.GetData();
+		size_t size = source.GetSize();
+		for (size_t lineStart = 0; lineStart < size; ) {
+			size_t lineEnd = lineStart;
+			while (lineEnd < size && data[lineEnd] != '\n') {
+				lineEnd++;
+			}
+			size_t c = lineStart;
+			while (c < lineEnd && (data[c] == ' ' || data[c] == '\t')) {
+				c++;
+			}
+			if (lineEnd - c > 7 && strncmp(data + c, "mtllib", 6) == 0 && (data[c + 6] == ' ' || data[c + 6] == '\t')) {
+				c += 7;
+				while (c < lineEnd && (data[c] == ' ' || data[c] == '\t')) {
+					c++;
+				}
+				size_t nameEnd = c;
+				while (nameEnd < lineEnd && !isspace((unsigned char)data[nameEnd])) {
+					nameEnd++;
+				}
+				if (nameEnd > c) {
+					materialFiles.push_back(basePath + std::string(data + c, nameEnd - c));
+				}
+			}
+			lineStart = lineEnd + 1;
+		}
+		return materialFiles;
+	}
+
+	std::string MeshCache::GetCacheFileName(const std::string& sourceFileName) {
+		return sourceFileName + ".meshcache";
+	}
+
+	// Maps the cache file and checks that it belongs to the current version of the source file
+	bool MeshCache::Open(const std::string& cacheFileName, const std::string& sourceFileName, const std::string& basePath) {
+		shapes.clear();
+
+		if (!file.Open(cacheFileName) || file.GetSize() < sizeof(CacheHeader)) {
+			return false;
+		}
+
+		CacheHeader header;
+		memcpy(&header, file.GetData(), sizeof(CacheHeader));
+
+		if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+			header.version != CACHE_VERSION ||
+			header.vertexSize != sizeof(gps::Vertex) ||
+			header.fileSize != file.GetSize()) {
+			std::cout << "Mesh cache " << cacheFileName << " has an unknown format, rebuilding" << std::endl;
+			file.Close();
+			return false;
+		}
+
+		// every table has to fit before the vertex data, and the vertex and index data in the file
+		unsigned long long tablesSize = sizeof(CacheHeader) +
+			(unsigned long long)header.dependencyCount * sizeof(CacheDependency) +
+			(unsigned long long)header.shapeCount * sizeof(CacheShape) +
+			(unsigned long long)header.lodCount * sizeof(CacheLod) +
+			(unsigned long long)header.meshletCount * sizeof(CacheMeshlet) +
+			(unsigned long long)header.textureCount * sizeof(CacheTexture);
+		if (header.dependencyCount == 0 ||
+			!InRange(tablesSize, header.stringTableSize, header.vertexDataOffset) ||
+			header.vertexDataOffset % 16 != 0 ||
+			header.indexDataOffset < header.vertexDataOffset || header.indexDataOffset > header.fileSize ||
+			(header.indexDataOffset - header.vertexDataOffset) % sizeof(gps::Vertex) != 0 ||
+			(header.fileSize - header.indexDataOffset) % sizeof(GLuint) != 0 ||
+			!InRange(header.basePathOffset, header.basePathLength, header.stringTableSize)) {
+			std::cout << "Mesh cache " << cacheFileName << " is corrupt, rebuilding" << std::endl;
+			file.Close();
+			return false;
+		}
+
+		const char* stringTable = (const char*)(file.GetData() + tablesSize);
+		if (std::string(stringTable + header.basePathOffset, header.basePathLength) != basePath) {
+			file.Close();
+			return false;
+		}
+
+		// the cache is valid as long as the .obj and .mtl files are unchanged - a different mtime alone
+		// (e.g. after a checkout) only forces a content hash comparison, and is then written back
+		std::vector<CacheDependency> dependencies(header.dependencyCount);
+		memcpy(&dependencies[0], file.GetData() + sizeof(CacheHeader), dependencies.size() * sizeof(CacheDependency));
+		bool modificationTimesChanged = false;
+		for (size_t d = 0; d < dependencies.size(); d++) {
+			CacheDependency& dependency = dependencies[d];
+			if (!InRange(dependency.pathOffset, dependency.pathLength, header.stringTableSize)) {
+				std::cout << "Mesh cache " << cacheFileName << " is corrupt, rebuilding" << std::endl;
+				file.Close();
+				return false;
+			}
+			std::string path(stringTable + dependency.pathOffset, dependency.pathLength);
+			if (d == 0 && path != sourceFileName) {
+				file.Close();
+				return false;
+			}
+
+			unsigned long long size = MISSING_FILE_SIZE;
+			long long modificationTime = 0;
+			if (!StatFile(path, &size, &modificationTime)) {
+				size = MISSING_FILE_SIZE;
+			}
+			if (size != dependency.size) {
+				file.Close();
+				return false;
+			}
+			if (size != MISSING_FILE_SIZE && modificationTime != dependency.modificationTime) {
+				unsigned long long hash;
+				if (!HashFile(path, &hash) || hash != dependency.hash) {
+					file.Close();
+					return false;
+				}
+				dependency.modificationTime = modificationTime;
+				modificationTimesChanged = true;
+			}
+		}
+
+		// the next runs compare the mtimes again instead of hashing the files
+		if (modificationTimesChanged) {
+			file.Close();
+			FILE* out = fopen(cacheFileName.c_str(), "r+b");
+			if (out) {
+				if (fseek(out, sizeof(CacheHeader), SEEK_SET) != 0 ||
+					fwrite(&dependencies[0], sizeof(CacheDependency), dependencies.size(), out) != dependencies.size()) {
+					std::cerr << "WARNING: could not update the mesh cache " << cacheFileName << std::endl;
+				}
+				fclose(out);
+			}
+			if (!file.Open(cacheFileName) || file.GetSize() != header.fileSize) {
+				file.Close();
+				return false;
+			}
+			stringTable = (const char*)(file.GetData() + tablesSize);
+		}
+
+		const unsigned char* data = file.GetData();
+		const CacheShape* cacheShapes = (const CacheShape*)(data + sizeof(CacheHeader) + dependencies.size() * sizeof(CacheDependency));
+		const CacheLod* cacheLods = (const CacheLod*)(cacheShapes + header.shapeCount);
+		const CacheMeshlet* cacheMeshlets = (const CacheMeshlet*)(cacheLods + header.lodCount);
+		const CacheTexture* cacheTextures = (const CacheTexture*)(cacheMeshlets + header.meshletCount);
+		const gps::Vertex* vertexData = (const gps::Vertex*)(data + header.vertexDataOffset);
+		const GLuint* indexData = (const GLuint*)(data + header.indexDataOffset);
+		unsigned long long totalVertexCount = (header.indexDataOffset - header.vertexDataOffset) / sizeof(gps::Vertex);
+		unsigned long long totalIndexCount = (header.fileSize - header.indexDataOffset) / sizeof(GLuint);
+
+		shapes.resize(header.shapeCount);
+		for (unsigned int s = 0; s < header.shapeCount; s++) {
+			const CacheShape& cacheShape = cacheShapes[s];
+			CachedShape& shape = shapes[s];
+
+			bool valid = InRange(cacheShape.firstVertex, cacheShape.vertexCount, totalVertexCount) &&
+				InRange(cacheShape.firstIndex, cacheShape.indexCount, totalIndexCount) &&
+				InRange(cacheShape.firstLod, cacheShape.lodCount, header.lodCount) &&
+				InRange(cacheShape.firstMeshlet, cacheShape.meshletCount, header.meshletCount) &&
+				InRange(cacheShape.firstTexture, cacheShape.textureCount, header.textureCount) &&
+				InRange(cacheShape.nameOffset, cacheShape.nameLength, header.stringTableSize);
+
+			for (unsigned int l = 0; valid && l < cacheShape.lodCount; l++) {
+				const CacheLod& cacheLod = cacheLods[cacheShape.firstLod + l];
+				valid = InRange(cacheLod.firstIndex, cacheLod.indexCount, cacheShape.indexCount) &&
+					InRange(cacheLod.firstMeshlet, cacheLod.meshletCount, cacheShape.meshletCount);
+			}
+			for (unsigned int m = 0; valid && m < cacheShape.meshletCount; m++) {
+				const CacheMeshlet& cacheMeshlet = cacheMeshlets[cacheShape.firstMeshlet + m];
+				valid = InRange(cacheMeshlet.firstIndex, cacheMeshlet.indexCount, cacheShape.indexCount);
+			}
+			for (unsigned int t = 0; valid && t < cacheShape.textureCount; t++) {
+				const CacheTexture& cacheTexture = cacheTextures[cacheShape.firstTexture + t];
+				valid = InRange(cacheTexture.typeOffset, cacheTexture.typeLength, header.stringTableSize) &&
+					InRange(cacheTexture.pathOffset, cacheTexture.pathLength, header.stringTableSize);
+			}
+			// the indices end up reading the vertex buffer
+			const GLuint* indices = indexData + (valid ? cacheShape.firstIndex : 0);
+			for (unsigned int i = 0; valid && i < cacheShape.indexCount; i++) {
+				valid = indices[i] < cacheShape.vertexCount;
+			}
+			if (!valid) {
+				std::cout << "Mesh cache " << cacheFileName << " is corrupt, rebuilding" << std::endl;
+				shapes.clear();
+				file.Close();
+				return false;
+			}
+
+			shape.vertices = vertexData + cacheShape.firstVertex;
+			shape.vertexCount = cacheShape.vertexCount;
+			shape.indices = indices;
+			shape.indexCount = cacheShape.indexCount;
+			shape.boundsMin = glm::vec3(cacheShape.boundsMin[0], cacheShape.boundsMin[1], cacheShape.boundsMin[2]);
+			shape.boundsMax = glm::vec3(cacheShape.boundsMax[0], cacheShape.boundsMax[1], cacheShape.boundsMax[2]);
+			shape.name = std::string(stringTable + cacheShape.nameOffset, cacheShape.nameLength);
+
+			for (unsigned int l = 0; l < cacheShape.lodCount; l++) {
+				const CacheLod& cacheLod = cacheLods[cacheShape.firstLod + l];
+				gps::MeshLod lod;
+				lod.firstIndex = cacheLod.firstIndex;
+				lod.indexCount = cacheLod.indexCount;
+				lod.error = cacheLod.error;
+				lod.firstMeshlet = cacheLod.firstMeshlet;
+				lod.meshletCount = cacheLod.meshletCount;
+				shape.lods.push_back(lod);
+			}
+
+			for (unsigned int m = 0; m < cacheShape.meshletCount; m++) {
+				const CacheMeshlet& cacheMeshlet = cacheMeshlets[cacheShape.firstMeshlet + m];
+				gps::Meshlet meshlet;
+				meshlet.firstIndex = cacheMeshlet.firstIndex;
+				meshlet.indexCount = cacheMeshlet.indexCount;
+				meshlet.center = glm::vec3(cacheMeshlet.center[0], cacheMeshlet.center[1], cacheMeshlet.center[2]);
+				meshlet.radius = cacheMeshlet.radius;
+				meshlet.coneAxis = glm::vec3(cacheMeshlet.coneAxis[0], cacheMeshlet.coneAxis[1], cacheMeshlet.coneAxis[2]);
+				meshlet.coneCutoff = cacheMeshlet.coneCutoff;
+				shape.meshlets.push_back(meshlet);
+			}
+
+			for (unsigned int t = 0; t < cacheShape.textureCount; t++) {
+				const CacheTexture& cacheTexture = cacheTextures[cacheShape.firstTexture + t];
+				gps::Texture texture;
+				texture.id = 0;
+				texture.type = std::string(stringTable + cacheTexture.typeOffset, cacheTexture.typeLength);
+				texture.path = std::string(stringTable + cacheTexture.pathOffset, cacheTexture.pathLength);
+				shape.textures.push_back(texture);
+			}
+		}
+
+		return true;
+	}
+
+	const std::vector<CachedShape>& MeshCache::GetShapes() const {
+		return shapes;
+	}
+
+	// Writes the meshes of a freshly parsed model into the cache file
+	bool MeshCache::Write(const std::string& cacheFileName, const std::string& sourceFileName, const std::string& basePath,
+		const std::vector<gps::Mesh>& meshes) {
+		CacheHeader header;
+		memset(&header, 0, sizeof(CacheHeader));
+		memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		header.version = CACHE_VERSION;
+		header.vertexSize = sizeof(gps::Vertex);
+		header.shapeCount = (unsigned int)meshes.size();
+
+		std::string stringTable;
+		header.basePathOffset = (unsigned int)stringTable.size();
+		header.basePathLength = (unsigned int)basePath.size();
+		stringTable += basePath;
+
+		// the .obj file first, then the .mtl files the textures come from
+		std::vector<std::string> dependencyPaths(1, sourceFileName);
+		std::vector<std::string> materialFiles = FindMaterialFiles(sourceFileName, basePath);
+		dependencyPaths.insert(dependencyPaths.end(), materialFiles.begin(), materialFiles.end());
+		std::vector<CacheDependency> cacheDependencies(dependencyPaths.size());
+		for (size_t d = 0; d < dependencyPaths.size(); d++) {
+			CacheDependency& dependency = cacheDependencies[d];
+			if (!DescribeFile(dependencyPaths[d], &dependency) || (d == 0 && dependency.size == MISSING_FILE_SIZE)) {
+				return false;
+			}
+			dependency.pathOffset = (unsigned int)stringTable.size();
+			dependency.pathLength = (unsigned int)dependencyPaths[d].size();
+			stringTable += dependencyPaths[d];
+		}
+		header.dependencyCount = (unsigned int)cacheDependencies.size();
+
+		std::vector<CacheShape> cacheShapes(meshes.size());
+		std::vector<CacheLod> cacheLods;
+		std::vector<CacheMeshlet> cacheMeshlets;
+		std::vector<CacheTexture> cacheTextures;
+		unsigned long long vertexCount = 0;
+		unsigned long long indexCount = 0;
+
+		for (size_t s = 0; s < meshes.size(); s++) {
+			const gps::Mesh& mesh = meshes[s];
+			CacheShape& cacheShape = cacheShapes[s];
+
+			cacheShape.firstVertex = vertexCount;
+			cacheShape.firstIndex = indexCount;
+			cacheShape.vertexCount = (unsigned int)mesh.vertices.size();
+			cacheShape.indexCount = (unsigned int)mesh.indices.size();
+			cacheShape.firstTexture = (unsigned int)cacheTextures.size();
+			cacheShape.textureCount = (unsigned int)mesh.textures.size();
+			cacheShape.firstLod = (unsigned int)cacheLods.size();
+			cacheShape.lodCount = (unsigned int)mesh.lods.size();
+			cacheShape.firstMeshlet = (unsigned int)cacheMeshlets.size();
+			cacheShape.meshletCount = (unsigned int)mesh.meshlets.size();
+			cacheShape.nameOffset = (unsigned int)stringTable.size();
+			cacheShape.nameLength = (unsigned int)mesh.name.size();
+			stringTable += mesh.name;
+			vertexCount += mesh.vertices.size();
+			indexCount += mesh.indices.size();
+
+			glm::vec3 boundsMin(0.0f);
+			glm::vec3 boundsMax(0.0f);
+			if (!mesh.vertices.empty()) {
+				boundsMin = boundsMax = mesh.vertices[0].Position;
+			}
+			for (size_t v = 1; v < mesh.vertices.size(); v++) {
+				boundsMin = glm::min(boundsMin, mesh.vertices[v].Position);
+				boundsMax = glm::max(boundsMax, mesh.vertices[v].Position);
+			}
+			for (int i = 0; i < 3; i++) {
+				cacheShape.boundsMin[i] = boundsMin[i];
+				cacheShape.boundsMax[i] = boundsMax[i];
+			}
+
+			for (size_t l = 0; l < mesh.lods.size(); l++) {
+				CacheLod cacheLod;
+				cacheLod.firstIndex = mesh.lods[l].firstIndex;
+				cacheLod.indexCount = mesh.lods[l].indexCount;
+				cacheLod.error = mesh.lods[l].error;
+				cacheLod.firstMeshlet = mesh.lods[l].firstMeshlet;
+				cacheLod.meshletCount = mesh.lods[l].meshletCount;
+				cacheLods.push_back(cacheLod);
+			}
+
+			for (size_t m = 0; m < mesh.meshlets.size(); m++) {
+				const gps::Meshlet& meshlet = mesh.meshlets[m];
+				CacheMeshlet cacheMeshlet;
+				cacheMeshlet.firstIndex = meshlet.firstIndex;
+				cacheMeshlet.indexCount = meshlet.indexCount;
+				cacheMeshlet.radius = meshlet.radius;
+				cacheMeshlet.coneCutoff = meshlet.coneCutoff;
+				for (int i = 0; i < 3; i++) {
+					cacheMeshlet.center[i] = meshlet.center[i];
+					cacheMeshlet.coneAxis[i] = meshlet.coneAxis[i];
+				}
+				cacheMeshlets.push_back(cacheMeshlet);
+			}
+
+			for (size_t t = 0; t < mesh.textures.size(); t++) {
+				CacheTexture cacheTexture;
+				cacheTexture.typeOffset = (unsigned int)stringTable.size();
+				cacheTexture.typeLength = (unsigned int)mesh.textures[t].type.size();
+				stringTable += mesh.textures[t].type;
+				cacheTexture.pathOffset = (unsigned int)stringTable.size();
+				cacheTexture.pathLength = (unsigned int)mesh.textures[t].path.size();
+				stringTable += mesh.textures[t].path;
+				cacheTextures.push_back(cacheTexture);
+			}
+		}
+
+		header.lodCount = (unsigned int)cacheLods.size();
+		header.meshletCount = (unsigned int)cacheMeshlets.size();
+		header.textureCount = (unsigned int)cacheTextures.size();
+		header.stringTableSize = (unsigned int)stringTable.size();
+		header.vertexDataOffset = AlignTo(sizeof(CacheHeader) + cacheDependencies.size() * sizeof(CacheDependency) +
+			cacheShapes.size() * sizeof(CacheShape) +
+			cacheLods.size() * sizeof(CacheLod) + cacheMeshlets.size() * sizeof(CacheMeshlet) +
+			cacheTextures.size() * sizeof(CacheTexture) + stringTable.size(), 16);
+		header.indexDataOffset = header.vertexDataOffset + vertexCount * sizeof(gps::Vertex);
+		header.fileSize = header.indexDataOffset + indexCount * sizeof(GLuint);
+
+		// write to a temporary file first, so an interrupted run never leaves a truncated cache behind
+		std::string temporaryFileName = cacheFileName + ".tmp";
+		FILE* out = fopen(temporaryFileName.c_str(), "wb");
+		if (!out) {
+			return false;
+		}
+
+		static const char padding[16] = { 0 };
+		size_t headerBytes = sizeof(CacheHeader) + cacheDependencies.size() * sizeof(CacheDependency) +
+			cacheShapes.size() * sizeof(CacheShape) +
+			cacheLods.size() * sizeof(CacheLod) + cacheMeshlets.size() * sizeof(CacheMeshlet) +
+			cacheTextures.size() * sizeof(CacheTexture) + stringTable.size();
+
+		bool ok = fwrite(&header, sizeof(CacheHeader), 1, out) == 1;
+		if (ok) {
+			ok = fwrite(&cacheDependencies[0], sizeof(CacheDependency), cacheDependencies.size(), out) == cacheDependencies.size();
+		}
+		if (ok && !cacheShapes.empty()) {
+			ok = fwrite(&cacheShapes[0], sizeof(CacheShape), cacheShapes.size(), out) == cacheShapes.size();
+		}
+		if (ok && !cacheLods.empty()) {
+			ok = fwrite(&cacheLods[0], sizeof(CacheLod), cacheLods.size(), out) == cacheLods.size();
+		}
+		if (ok && !cacheMeshlets.empty()) {
+			ok = fwrite(&cacheMeshlets[0], sizeof(CacheMeshlet), cacheMeshlets.size(), out) == cacheMeshlets.size();
+		}
+		if (ok && !cacheTextures.empty()) {
+			ok = fwrite(&cacheTextures[0], sizeof(CacheTexture), cacheTextures.size(), out) == cacheTextures.size();
+		}
+		if (ok && !stringTable.empty()) {
+			ok = fwrite(stringTable.data(), 1, stringTable.size(), out) == stringTable.size();
+		}
+		if (ok) {
+			size_t paddingBytes = (size_t)(header.vertexDataOffset - headerBytes);
+			ok = fwrite(padding, 1, paddingBytes, out) == paddingBytes;
+		}
+		for (size_t s = 0; ok && s < meshes.size(); s++) {
+			if (!meshes[s].vertices.empty()) {
+				ok = fwrite(&meshes[s].vertices[0], sizeof(gps::Vertex), meshes[s].vertices.size(), out) == meshes[s].vertices.size();
+			}
+		}
+		for (size_t s = 0; ok && s < meshes.size(); s++) {
+			if (!meshes[s].indices.empty()) {
+				ok = fwrite(&meshes[s].indices[0], sizeof(GLuint), meshes[s].indices.size(), out) == meshes[s].indices.size();
+			}
+		}
+		ok = (fclose(out) == 0) && ok;
+
+		// rename does not replace an existing file on every platform
+		remove(cacheFileName.c_str());
+		if (!ok || rename(temporaryFileName.c_str(), cacheFileName.c_str()) != 0) {
+			remove(temporaryFileName.c_str());
+			return false;
+		}
+
+		return true;
+	}
+}
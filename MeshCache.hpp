@@ -0,0 +1,55 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // A shape stored in the cache - the vertex and index arrays point into the mapped file
+    struct CachedShape
+    {
+        const Vertex* vertices;
+        GLuint vertexCount;
+        const GLuint* indices;
+        GLuint indexCount;
+        // only the type and the path of the textures are stored, ids are assigned when loading
+        std::vector<Texture> textures;
+        std::string name;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        // ranges of `indices`, from the full detail level to the coarsest one
+        std::vector<MeshLod> lods;
+        std::vector<Meshlet> meshlets;
+    };
+
+    // Binary cache written next to an .obj file after it was parsed once.
+    // The cache is memory mapped on the next runs, so no text parsing is needed.
+    // It is rebuilt when the .obj file, one of its .mtl files or the base path of the textures changes
+    // (size and mtime, or content hash if only the mtime changed)
+    class MeshCache
+    {
+    public:
+        // Maps the cache file and checks that it belongs to the current version of the source files,
+        // rejecting caches whose tables do not fit in the file
+        bool Open(const std::string& cacheFileName, const std::string& sourceFileName, const std::string& basePath);
+
+        const std::vector<CachedShape>& GetShapes() const;
+
+        // Writes the meshes of a freshly parsed model into the cache file
+        static bool Write(const std::string& cacheFileName, const std::string& sourceFileName, const std::string& basePath,
+                          const std::vector<gps::Mesh>& meshes);
+
+        // Name of the cache file used for the given source file
+        static std::string GetCacheFileName(const std::string& sourceFileName);
+
+    private:
+        MappedFile file;
+        std::vector<CachedShape> shapes;
+    };
+}
+
+#endif /* MeshCache_hpp */
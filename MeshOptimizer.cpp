@@ -0,0 +1,258 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+	void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+		if (indices.size() < 3 || vertices.empty()) {
+			return;
+		}
+
+		OptimizeIndices(vertices, indices);
+		OptimizeVertexFetch(vertices, indices);
+	}
+
+	void MeshOptimizer::OptimizeIndices(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+		if (indices.size() < 3 || vertices.empty()) {
+			return;
+		}
+
+		std::vector<GLuint> triangleOrder;
+		std::vector<GLuint> clusterStarts;
+		Tipsify(indices, vertices.size(), triangleOrder, clusterStarts);
+
+		std::vector<GLuint> reordered(triangleOrder.size() * 3);
+		for (size_t t = 0; t < triangleOrder.size(); t++) {
+			for (int c = 0; c < 3; c++) {
+				reordered[t * 3 + c] = indices[triangleOrder[t] * 3 + c];
+			}
+		}
+
+		// already well ordered meshes (e.g. small strips) keep their order
+		size_t originalMisses = CountCacheMisses(indices, vertices.size());
+		size_t tipsifyMisses = CountCacheMisses(reordered, vertices.size());
+		if (tipsifyMisses < originalMisses) {
+			indices.swap(reordered);
+
+			// the overdraw order may cost at most 5% more cache misses
+			std::vector<GLuint> sorted(indices);
+			SortClustersForOverdraw(vertices, sorted, clusterStarts);
+			if (CountCacheMisses(sorted, vertices.size()) * 100 <= tipsifyMisses * 105) {
+				indices.swap(sorted);
+			}
+		}
+	}
+
+	void MeshOptimizer::Tipsify(const std::vector<GLuint>& indices, size_t vertexCount,
+		std::vector<GLuint>& triangleOrder, std::vector<GLuint>& clusterStarts) {
+		size_t triangleCount = indices.size() / 3;
+
+		// triangles around each vertex, as offsets into one flat array
+		std::vector<GLuint> adjacencyOffsets(vertexCount + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacencyOffsets[indices[i] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		std::vector<GLuint> adjacency(triangleCount * 3);
+		std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[indices[i]]++] = (GLuint)(i / 3);
+		}
+
+		// live triangles of each vertex and the time it last entered the cache
+		std::vector<int> liveTriangles(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			liveTriangles[v] = (int)(adjacencyOffsets[v + 1] - adjacencyOffsets[v]);
+		}
+		std::vector<int> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<GLuint> deadEnd;
+		std::vector<GLuint> candidates;
+
+		int time = CACHE_SIZE + 1;
+		size_t cursor = 0;
+		int fanningVertex = 0;
+		bool clusterStart = true;
+
+		triangleOrder.clear();
+		clusterStarts.clear();
+
+		while (fanningVertex >= 0) {
+			candidates.clear();
+
+			// emit all the live triangles around the fanning vertex
+			for (GLuint a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; a++) {
+				GLuint triangle = adjacency[a];
+				if (emitted[triangle]) {
+					continue;
+				}
+				if (clusterStart) {
+					clusterStarts.push_back((GLuint)triangleOrder.size());
+					clusterStart = false;
+				}
+				for (int c = 0; c < 3; c++) {
+					GLuint v = indices[triangle * 3 + c];
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					liveTriangles[v]--;
+					if (time - cacheTime[v] > (int)CACHE_SIZE) {
+						cacheTime[v] = time;
+						time++;
+					}
+				}
+				emitted[triangle] = true;
+				triangleOrder.push_back(triangle);
+			}
+
+			// next fanning vertex: the one that stays in the cache the longest once its triangles are emitted
+			int best = -1;
+			int bestPriority = -1;
+			for (size_t i = 0; i < candidates.size(); i++) {
+				GLuint v = candidates[i];
+				if (liveTriangles[v] <= 0) {
+					continue;
+				}
+				int priority = 0;
+				if (time - cacheTime[v] + 2 * liveTriangles[v] <= (int)CACHE_SIZE) {
+					priority = time - cacheTime[v];
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					best = (int)v;
+				}
+			}
+
+			if (best < 0) {
+				// dead end: go back to a recently used vertex, or on to the next vertex with live triangles
+				while (!deadEnd.empty() && best < 0) {
+					GLuint v = deadEnd.back();
+					deadEnd.pop_back();
+					if (liveTriangles[v] > 0) {
+						best = (int)v;
+					}
+				}
+				while (best < 0 && cursor < vertexCount) {
+					if (liveTriangles[cursor] > 0) {
+						best = (int)cursor;
+					}
+					cursor++;
+				}
+			}
+
+			// triangles fanned around a vertex that left the cache start a new cluster,
+			// clusters can then be reordered without a large cache penalty
+			if (best >= 0 && time - cacheTime[best] > (int)CACHE_SIZE) {
+				clusterStart = true;
+			}
+			fanningVertex = best;
+		}
+	}
+
+	void MeshOptimizer::SortClustersForOverdraw(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+		const std::vector<GLuint>& clusterStarts) {
+		size_t triangleCount = indices.size() / 3;
+		size_t clusterCount = clusterStarts.size();
+		if (clusterCount < 2) {
+			return;
+		}
+
+		// area weighted centroid and normal of every cluster
+		std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+		std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+		std::vector<float> clusterAreas(clusterCount, 0.0f);
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+
+		for (size_t c = 0; c < clusterCount; c++) {
+			size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+			for (size_t t = clusterStarts[c]; t < end; t++) {
+				const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+				const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+				const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(normal);
+				glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+				clusterCentroids[c] += centroid * area;
+				clusterNormals[c] += normal;
+				clusterAreas[c] += area;
+			}
+			meshCentroid += clusterCentroids[c];
+			meshArea += clusterAreas[c];
+		}
+		if (meshArea > 0.0f) {
+			meshCentroid /= meshArea;
+		}
+
+		// clusters far out and facing away from the center are likely to hide the rest, so they go first
+		std::vector<std::pair<float, GLuint> > order(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++) {
+			float key = 0.0f;
+			float normalLength = glm::length(clusterNormals[c]);
+			if (clusterAreas[c] > 0.0f && normalLength > 0.0f) {
+				glm::vec3 centroid = clusterCentroids[c] / clusterAreas[c];
+				key = glm::dot(centroid - meshCentroid, clusterNormals[c] / normalLength);
+			}
+			order[c] = std::make_pair(-key, (GLuint)c);
+		}
+		std::stable_sort(order.begin(), order.end());
+
+		std::vector<GLuint> reordered;
+		reordered.reserve(indices.size());
+		for (size_t i = 0; i < clusterCount; i++) {
+			GLuint c = order[i].second;
+			size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+			reordered.insert(reordered.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + end * 3);
+		}
+		indices.swap(reordered);
+	}
+
+	void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+		const GLuint unused = 0xffffffffu;
+		std::vector<GLuint> remap(vertices.size(), unused);
+		std::vector<Vertex> reordered;
+		reordered.reserve(vertices.size());
+
+		for (size_t i = 0; i < indices.size(); i++) {
+			GLuint& newIndex = remap[indices[i]];
+			if (newIndex == unused) {
+				newIndex = (GLuint)reordered.size();
+				reordered.push_back(vertices[indices[i]]);
+			}
+			indices[i] = newIndex;
+		}
+
+		vertices.swap(reordered);
+	}
+
+	size_t MeshOptimizer::CountCacheMisses(const std::vector<GLuint>& indices, size_t vertexCount) {
+		// FIFO cache: a vertex stays cached for the next CACHE_SIZE misses
+		std::vector<size_t> cachedAt(vertexCount, 0);
+		size_t misses = 0;
+		for (size_t i = 0; i < indices.size(); i++) {
+			size_t& time = cachedAt[indices[i]];
+			if (time == 0 || misses - time >= CACHE_SIZE) {
+				misses++;
+				time = misses;
+			}
+		}
+		return misses;
+	}
+
+	float MeshOptimizer::ComputeACMR(const std::vector<GLuint>& indices, size_t vertexCount) {
+		if (indices.size() < 3) {
+			return 0.0f;
+		}
+		return (float)CountCacheMisses(indices, vertexCount) / (float)(indices.size() / 3);
+	}
+
+	float MeshOptimizer::ComputeATVR(const std::vector<GLuint>& indices, size_t vertexCount) {
+		if (vertexCount == 0) {
+			return 0.0f;
+		}
+		return (float)CountCacheMisses(indices, vertexCount) / (float)vertexCount;
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Import time reordering of indexed triangle meshes, so the GPU transforms and shades fewer vertices/fragments
+    class MeshOptimizer
+    {
+    public:
+        // Size of the post-transform cache assumed by the optimizer and the statistics
+        static const unsigned int CACHE_SIZE = 16;
+
+        // Tipsify (Sander et al. 2007) for the post-transform vertex cache, then the resulting
+        // clusters of triangles are sorted to draw outward facing parts first (less overdraw),
+        // then the vertices are renumbered in order of first use (better fetch locality).
+        // A reordering that makes the cache behaviour worse is skipped
+        static void Optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+        // Only the triangle order part of Optimize, for index lists that share their vertices
+        // with others (the levels of detail of a mesh)
+        static void OptimizeIndices(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+        // Average cache miss ratio: transformed vertices per triangle (0.5 at best, 3 at worst)
+        static float ComputeACMR(const std::vector<GLuint>& indices, size_t vertexCount);
+        // Average transform to vertex ratio: transformed vertices per vertex (1 at best)
+        static float ComputeATVR(const std::vector<GLuint>& indices, size_t vertexCount);
+
+    private:
+        // Returns the new triangle order and the triangles where a cluster starts
+        static void Tipsify(const std::vector<GLuint>& indices, size_t vertexCount,
+                            std::vector<GLuint>& triangleOrder, std::vector<GLuint>& clusterStarts);
+        static void SortClustersForOverdraw(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+                                            const std::vector<GLuint>& clusterStarts);
+        static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+        // Number of vertices transformed with a FIFO cache of CACHE_SIZE entries
+        static size_t CountCacheMisses(const std::vector<GLuint>& indices, size_t vertexCount);
+    };
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -0,0 +1,383 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+namespace gps {
+
+	// Exact position match, vertices on either side of a seam share their position
+	struct PositionHash {
+		size_t operator()(const glm::vec3& position) const {
+			const unsigned int* words = reinterpret_cast<const unsigned int*>(&position);
+			return ((words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u));
+		}
+	};
+
+	struct PositionEqual {
+		bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+			return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+		}
+	};
+
+	// Symmetric 4x4 matrix of the squared distances to a set of planes
+	struct Quadric {
+		double a00, a01, a02, a11, a12, a22;
+		double b0, b1, b2;
+		double c;
+
+		Quadric() : a00(0), a01(0), a02(0), a11(0), a12(0), a22(0), b0(0), b1(0), b2(0), c(0) {}
+
+		void AddPlane(double nx, double ny, double nz, double d) {
+			a00 += nx * nx; a01 += nx * ny; a02 += nx * nz;
+			a11 += ny * ny; a12 += ny * nz; a22 += nz * nz;
+			b0 += nx * d; b1 += ny * d; b2 += nz * d;
+			c += d * d;
+		}
+
+		void Add(const Quadric& q) {
+			a00 += q.a00; a01 += q.a01; a02 += q.a02;
+			a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+		}
+
+		double Evaluate(const glm::vec3& p) const {
+			double x = p.x, y = p.y, z = p.z;
+			return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + a11 * y * y + 2 * a12 * y * z + a22 * z * z
+				+ 2 * (b0 * x + b1 * y + b2 * z) + c;
+		}
+	};
+
+	// Moving the vertices at position `from` onto the ones at position `to`
+	struct Collapse {
+		double cost;
+		GLuint from;
+		GLuint to;
+		unsigned int fromVersion;
+		unsigned int toVersion;
+
+		bool operator<(const Collapse& other) const {
+			// std::priority_queue pops the largest element first
+			return cost > other.cost;
+		}
+	};
+
+	// Works on positions: the vertices that only differ by their normal or texture coordinates
+	// (the sides of a seam) move together, each onto the vertex of the target on the same side
+	class Simplification {
+	public:
+		Simplification(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, double maxCost);
+
+		// Collapses edges until at most `targetTriangles` are left, returns false when nothing can be collapsed
+		bool Simplify(size_t targetTriangles);
+		void GetIndices(std::vector<GLuint>& indices) const;
+		float GetError() const;
+
+	private:
+		const std::vector<Vertex>& vertices;
+		// first vertex with the same position, which stands for all of them
+		std::vector<GLuint> positions;
+		std::vector<GLuint> triangles;
+		std::vector<bool> triangleAlive;
+		size_t aliveTriangles;
+		// by position
+		std::vector<std::vector<GLuint> > positionTriangles;
+		std::vector<Quadric> quadrics;
+		std::vector<bool> locked;
+		std::vector<unsigned int> versions;
+		std::priority_queue<Collapse> collapses;
+		double maxCost;
+		double collapsedCost;
+
+		void PushCollapse(GLuint from, GLuint to);
+		bool TryCollapse(GLuint from, GLuint to);
+	};
+
+	Simplification::Simplification(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, double maxCost)
+		: vertices(vertices), positions(vertices.size()), triangles(indices), triangleAlive(indices.size() / 3, true),
+		aliveTriangles(indices.size() / 3), positionTriangles(vertices.size()), quadrics(vertices.size()),
+		locked(vertices.size(), false), versions(vertices.size(), 0), maxCost(maxCost), collapsedCost(0.0) {
+
+		std::unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual> firstVertices;
+		for (size_t v = 0; v < vertices.size(); v++) {
+			positions[v] = firstVertices.insert(std::make_pair(vertices[v].Position, (GLuint)v)).first->second;
+		}
+
+		// an edge with a single triangle is a border, one with more than two is not a surface: their vertices never move
+		std::unordered_map<unsigned long long, int> edgeUses;
+		for (size_t t = 0; t < aliveTriangles; t++) {
+			for (int e = 0; e < 3; e++) {
+				GLuint a = positions[triangles[t * 3 + e]];
+				GLuint b = positions[triangles[t * 3 + (e + 1) % 3]];
+				unsigned long long key = ((unsigned long long)std::min(a, b) << 32) | std::max(a, b);
+				edgeUses[key]++;
+			}
+		}
+		for (std::unordered_map<unsigned long long, int>::iterator edge = edgeUses.begin(); edge != edgeUses.end(); ++edge) {
+			if (edge->second != 2) {
+				locked[(GLuint)(edge->first >> 32)] = true;
+				locked[(GLuint)(edge->first & 0xffffffffu)] = true;
+			}
+		}
+
+		// unweighted planes, so the square root of a cost is roughly a distance
+		for (size_t t = 0; t < aliveTriangles; t++) {
+			const glm::vec3& p0 = vertices[triangles[t * 3 + 0]].Position;
+			const glm::vec3& p1 = vertices[triangles[t * 3 + 1]].Position;
+			const glm::vec3& p2 = vertices[triangles[t * 3 + 2]].Position;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f) {
+				normal /= length;
+			}
+			double d = -glm::dot(normal, p0);
+			for (int c = 0; c < 3; c++) {
+				GLuint position = positions[triangles[t * 3 + c]];
+				quadrics[position].AddPlane(normal.x, normal.y, normal.z, d);
+				positionTriangles[position].push_back((GLuint)t);
+			}
+		}
+
+		for (size_t t = 0; t < aliveTriangles; t++) {
+			for (int e = 0; e < 3; e++) {
+				GLuint a = positions[triangles[t * 3 + e]];
+				GLuint b = positions[triangles[t * 3 + (e + 1) % 3]];
+				PushCollapse(a, b);
+				PushCollapse(b, a);
+			}
+		}
+	}
+
+	void Simplification::PushCollapse(GLuint from, GLuint to) {
+		if (locked[from] || from == to) {
+			return;
+		}
+		Quadric q = quadrics[from];
+		q.Add(quadrics[to]);
+
+		Collapse collapse;
+		collapse.cost = std::max(0.0, q.Evaluate(vertices[to].Position));
+		if (collapse.cost > maxCost) {
+			return;
+		}
+		collapse.from = from;
+		collapse.to = to;
+		collapse.fromVersion = versions[from];
+		collapse.toVersion = versions[to];
+		collapses.push(collapse);
+	}
+
+	bool Simplification::TryCollapse(GLuint from, GLuint to) {
+		const std::vector<GLuint>& around = positionTriangles[from];
+		const glm::vec3& target = vertices[to].Position;
+
+		// the triangles on the edge tell which vertex at `to` each vertex at `from` becomes
+		std::vector<std::pair<GLuint, GLuint> > moves;
+		for (size_t i = 0; i < around.size(); i++) {
+			GLuint t = around[i];
+			if (!triangleAlive[t]) {
+				continue;
+			}
+			GLuint moved = 0;
+			GLuint kept = 0;
+			bool onEdge = false;
+			for (int c = 0; c < 3; c++) {
+				GLuint vertex = triangles[t * 3 + c];
+				if (positions[vertex] == from) {
+					moved = vertex;
+				}
+				else if (positions[vertex] == to) {
+					kept = vertex;
+					onEdge = true;
+				}
+			}
+			if (!onEdge) {
+				continue;
+			}
+			for (size_t m = 0; m < moves.size(); m++) {
+				if (moves[m].first == moved && moves[m].second != kept) {
+					return false;
+				}
+			}
+			moves.push_back(std::make_pair(moved, kept));
+		}
+		if (moves.empty()) {
+			return false;
+		}
+
+		// link condition: the two positions may only share the neighbours of the triangles on the edge,
+		// otherwise the collapse pinches the surface into a fin
+		std::vector<GLuint> fromNeighbours;
+		for (size_t i = 0; i < around.size(); i++) {
+			if (triangleAlive[around[i]]) {
+				for (int c = 0; c < 3; c++) {
+					fromNeighbours.push_back(positions[triangles[around[i] * 3 + c]]);
+				}
+			}
+		}
+		std::sort(fromNeighbours.begin(), fromNeighbours.end());
+		fromNeighbours.erase(std::unique(fromNeighbours.begin(), fromNeighbours.end()), fromNeighbours.end());
+
+		std::vector<GLuint> shared;
+		const std::vector<GLuint>& aroundTarget = positionTriangles[to];
+		for (size_t i = 0; i < aroundTarget.size(); i++) {
+			if (!triangleAlive[aroundTarget[i]]) {
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				GLuint position = positions[triangles[aroundTarget[i] * 3 + c]];
+				if (position != from && position != to &&
+					std::binary_search(fromNeighbours.begin(), fromNeighbours.end(), position)) {
+					shared.push_back(position);
+				}
+			}
+		}
+		std::sort(shared.begin(), shared.end());
+		if ((size_t)(std::unique(shared.begin(), shared.end()) - shared.begin()) > moves.size()) {
+			return false;
+		}
+
+		// every remaining triangle needs a target for its vertex - there is none when the collapse
+		// would leave a seam, and no triangle may flip over
+		for (size_t i = 0; i < around.size(); i++) {
+			GLuint t = around[i];
+			if (!triangleAlive[t]) {
+				continue;
+			}
+			const GLuint* corners = &triangles[t * 3];
+			if (positions[corners[0]] == to || positions[corners[1]] == to || positions[corners[2]] == to) {
+				continue;
+			}
+
+			glm::vec3 p[3];
+			glm::vec3 moved[3];
+			for (int c = 0; c < 3; c++) {
+				p[c] = vertices[corners[c]].Position;
+				moved[c] = p[c];
+				if (positions[corners[c]] == from) {
+					size_t m = 0;
+					while (m < moves.size() && moves[m].first != corners[c]) {
+						m++;
+					}
+					if (m == moves.size()) {
+						return false;
+					}
+					moved[c] = target;
+				}
+			}
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+			if (glm::dot(before, after) <= 0.0f) {
+				return false;
+			}
+		}
+
+		for (size_t i = 0; i < around.size(); i++) {
+			GLuint t = around[i];
+			if (!triangleAlive[t]) {
+				continue;
+			}
+			GLuint* corners = &triangles[t * 3];
+			if (positions[corners[0]] == to || positions[corners[1]] == to || positions[corners[2]] == to) {
+				triangleAlive[t] = false;
+				aliveTriangles--;
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				for (size_t m = 0; m < moves.size(); m++) {
+					if (corners[c] == moves[m].first) {
+						corners[c] = moves[m].second;
+						break;
+					}
+				}
+			}
+			positionTriangles[to].push_back(t);
+		}
+		positionTriangles[from].clear();
+
+		quadrics[to].Add(quadrics[from]);
+		versions[from]++;
+		versions[to]++;
+
+		// the costs of all the edges around the kept position changed
+		const std::vector<GLuint>& kept = positionTriangles[to];
+		for (size_t i = 0; i < kept.size(); i++) {
+			GLuint t = kept[i];
+			if (!triangleAlive[t]) {
+				continue;
+			}
+			for (int c = 0; c < 3; c++) {
+				GLuint other = positions[triangles[t * 3 + c]];
+				if (other != to) {
+					PushCollapse(other, to);
+					PushCollapse(to, other);
+				}
+			}
+		}
+		return true;
+	}
+
+	bool Simplification::Simplify(size_t targetTriangles) {
+		size_t startTriangles = aliveTriangles;
+		while (aliveTriangles > targetTriangles && !collapses.empty()) {
+			Collapse collapse = collapses.top();
+			collapses.pop();
+
+			// skip collapses computed before one of the positions changed
+			if (collapse.fromVersion != versions[collapse.from] || collapse.toVersion != versions[collapse.to]) {
+				continue;
+			}
+			if (TryCollapse(collapse.from, collapse.to)) {
+				collapsedCost = std::max(collapsedCost, collapse.cost);
+			}
+		}
+		return aliveTriangles < startTriangles;
+	}
+
+	void Simplification::GetIndices(std::vector<GLuint>& indices) const {
+		indices.clear();
+		for (size_t t = 0; t < triangleAlive.size(); t++) {
+			if (triangleAlive[t]) {
+				indices.insert(indices.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+			}
+		}
+	}
+
+	float Simplification::GetError() const {
+		return (float)sqrt(collapsedCost);
+	}
+
+	void MeshSimplifier::BuildLods(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, int levelCount,
+		std::vector<std::vector<GLuint> >& lodIndices, std::vector<float>& lodErrors) {
+		if (indices.size() < 3 || vertices.empty()) {
+			return;
+		}
+
+		// collapses that move the surface by more than 2% of the mesh size would only
+		// give levels that are never picked
+		glm::vec3 boundsMin = vertices[0].Position;
+		glm::vec3 boundsMax = vertices[0].Position;
+		for (size_t v = 1; v < vertices.size(); v++) {
+			boundsMin = glm::min(boundsMin, vertices[v].Position);
+			boundsMax = glm::max(boundsMax, vertices[v].Position);
+		}
+		double maxError = 0.02 * glm::length(boundsMax - boundsMin);
+
+		// every level continues from the previous one, so the errors only grow
+		Simplification simplification(vertices, indices, maxError * maxError);
+		size_t targetTriangles = indices.size() / 3;
+		for (int level = 0; level < levelCount; level++) {
+			targetTriangles /= 2;
+			if (targetTriangles == 0 || !simplification.Simplify(targetTriangles)) {
+				break;
+			}
+
+			lodIndices.push_back(std::vector<GLuint>());
+			simplification.GetIndices(lodIndices.back());
+			lodErrors.push_back(simplification.GetError());
+		}
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Quadric error metric simplification (Garland & Heckbert 1997) for the levels of detail of a mesh.
+    // Edges are collapsed onto one of their vertices, so all the levels share the vertex buffer and
+    // only need their own indices
+    class MeshSimplifier
+    {
+    public:
+        // Appends up to `levelCount` coarser index lists, each with about half the triangles of the
+        // previous one, and the object space error of each. Stops early when nothing more can be
+        // collapsed within 2% of the mesh size. Border vertices never move and the vertices of a UV
+        // or normal seam only move along the seam, so the texture and shading stay continuous
+        static void BuildLods(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, int levelCount,
+                              std::vector<std::vector<GLuint> >& lodIndices, std::vector<float>& lodErrors);
+    };
+}
+
+#endif /* MeshSimplifier_hpp */
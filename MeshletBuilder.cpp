@@ -0,0 +1,111 @@
+#include "MeshletBuilder.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+	void MeshletBuilder::Build(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+		std::vector<MeshLod>& lods, std::vector<Meshlet>& meshlets) {
+		meshlets.clear();
+
+		// meshlet (plus one) that last used each vertex
+		std::vector<GLuint> usedBy(vertices.size(), 0);
+
+		for (size_t l = 0; l < lods.size(); l++) {
+			MeshLod& lod = lods[l];
+			lod.firstMeshlet = (GLuint)meshlets.size();
+
+			Meshlet meshlet;
+			meshlet.firstIndex = lod.firstIndex;
+			meshlet.indexCount = 0;
+			GLuint vertexCount = 0;
+
+			for (GLuint i = lod.firstIndex; i + 2 < lod.firstIndex + lod.indexCount; i += 3) {
+				GLuint stamp = (GLuint)meshlets.size() + 1;
+				GLuint newVertices = 0;
+				for (int c = 0; c < 3; c++) {
+					GLuint vertex = indices[i + c];
+					if (usedBy[vertex] != stamp && (c < 1 || vertex != indices[i]) && (c < 2 || vertex != indices[i + 1])) {
+						newVertices++;
+					}
+				}
+
+				if (meshlet.indexCount > 0 && (vertexCount + newVertices > MAX_VERTICES ||
+					meshlet.indexCount / 3 + 1 > MAX_TRIANGLES)) {
+					ComputeBounds(vertices, indices, meshlet);
+					meshlets.push_back(meshlet);
+
+					meshlet.firstIndex = i;
+					meshlet.indexCount = 0;
+					vertexCount = 0;
+					stamp++;
+				}
+
+				for (int c = 0; c < 3; c++) {
+					if (usedBy[indices[i + c]] != stamp) {
+						usedBy[indices[i + c]] = stamp;
+						vertexCount++;
+					}
+				}
+				meshlet.indexCount += 3;
+			}
+
+			if (meshlet.indexCount > 0) {
+				ComputeBounds(vertices, indices, meshlet);
+				meshlets.push_back(meshlet);
+			}
+			lod.meshletCount = (GLuint)meshlets.size() - lod.firstMeshlet;
+		}
+	}
+
+	void MeshletBuilder::ComputeBounds(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, Meshlet& meshlet) {
+		glm::vec3 boundsMin = vertices[indices[meshlet.firstIndex]].Position;
+		glm::vec3 boundsMax = boundsMin;
+		glm::vec3 normalSum(0.0f);
+		for (GLuint i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+			const glm::vec3& p0 = vertices[indices[i]].Position;
+			const glm::vec3& p1 = vertices[indices[i + 1]].Position;
+			const glm::vec3& p2 = vertices[indices[i + 2]].Position;
+			boundsMin = glm::min(boundsMin, glm::min(p0, glm::min(p1, p2)));
+			boundsMax = glm::max(boundsMax, glm::max(p0, glm::max(p1, p2)));
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f) {
+				normalSum += normal / length;
+			}
+		}
+
+		meshlet.center = (boundsMin + boundsMax) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (GLuint i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i++) {
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+		}
+
+		// the cone holds every face normal, a cutoff of 1 is never passed (the meshlet is never back facing)
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneCutoff = 1.0f;
+		float axisLength = glm::length(normalSum);
+		if (axisLength <= 0.0f) {
+			return;
+		}
+		glm::vec3 axis = normalSum / axisLength;
+
+		float minDot = 1.0f;
+		for (GLuint i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+			const glm::vec3& p0 = vertices[indices[i]].Position;
+			glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f) {
+				minDot = std::min(minDot, glm::dot(normal / length, axis));
+			}
+		}
+
+		// wider than about 84 degrees off the axis the test would hardly ever cull anything
+		if (minDot > 0.1f) {
+			meshlet.coneAxis = axis;
+			meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+		}
+	}
+}
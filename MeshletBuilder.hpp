@@ -0,0 +1,30 @@
+#ifndef MeshletBuilder_hpp
+#define MeshletBuilder_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Splits the levels of a mesh into meshlets, the units of the per frame cluster culling
+    class MeshletBuilder
+    {
+    public:
+        static const unsigned int MAX_VERTICES = 64;
+        static const unsigned int MAX_TRIANGLES = 124;
+
+        // Cuts the index range of every level into runs of consecutive triangles, starting a new
+        // meshlet when the next triangle would exceed MAX_VERTICES or MAX_TRIANGLES. The indices
+        // are already in vertex cache order, so consecutive triangles are close together and each
+        // meshlet stays a plain index range that can be drawn without a separate index list
+        static void Build(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+                          std::vector<MeshLod>& lods, std::vector<Meshlet>& meshlets);
+
+    private:
+        // Bounding sphere and normal cone of the triangles in the meshlet's range
+        static void ComputeBounds(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, Meshlet& meshlet);
+    };
+}
+
+#endif /* MeshletBuilder_hpp */
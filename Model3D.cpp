@@ -1,23 +1,1040 @@
 #include "Model3D.hpp"
+#include "GeometryArena.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "TextureRegistry.hpp"
+#include "TextureUploader.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 
 namespace gps {
 
+	// Coarser levels of detail generated for every imported mesh, each with about half the triangles of the previous one
+	static const int LOD_LEVELS = 3;
+
+	// Models with at least this many meshes are culled through their BVH, smaller ones with one linear SIMD pass
+	static const size_t BVH_CULLING_MESHES = 32;
+
+	// Side of the grid cells BuildStaticBatches groups meshes by, about a room of the scene, so the
+	// batches stay small enough to be culled and drawn at a coarser level of detail on their own
+	static const float STATIC_BATCH_REGION_SIZE = 6.0f;
+
+	// Hashes a vertex by the bit pattern of all its attributes, so that only
+	// exactly identical face corners are welded together
+	struct VertexHash {
+		size_t operator()(const gps::Vertex& vertex) const {
+			const unsigned int* words = reinterpret_cast<const unsigned int*>(&vertex);
+			size_t hash = 2166136261u;
+			for (size_t i = 0; i < sizeof(gps::Vertex) / sizeof(unsigned int); i++) {
+				hash = (hash ^ words[i]) * 16777619u;
+			}
+			return hash;
+		}
+	};
+
+	struct VertexEqual {
+		bool operator()(const gps::Vertex& a, const gps::Vertex& b) const {
+			return memcmp(&a, &b, sizeof(gps::Vertex)) == 0;
+		}
+	};
+
+	// Layout read by glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// Meshes merged by BuildStaticBatches
+	struct StaticBatch {
+		std::vector<gps::Vertex> vertices;
+		// indices of each level of detail
+		std::vector<std::vector<GLuint> > lodIndices;
+		std::vector<float> lodErrors;
+		std::vector<gps::Texture> textures;
+		// cell of all the merged meshes, -1 outside the cells
+		int cell;
+		// grid region of the centers of the merged meshes
+		glm::ivec3 region;
+	};
+
+	// Same texture objects bound to the same sampler uniforms
+	static bool SameTextures(const std::vector<gps::Texture>& a, const std::vector<gps::Texture>& b) {
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++) {
+			if (a[i].id != b[i].id || a[i].type != b[i].type) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Shader features of each material variant (see Shader::getPermutation), the specular term is left out without a specular map
+	static const char* MATERIAL_VARIANT_FEATURES[2] = { "", "SPECULAR_TEXTURE" };
+
+	static unsigned char MaterialVariant(const std::vector<gps::Texture>& textures) {
+		for (size_t i = 0; i < textures.size(); i++) {
+			if (textures[i].type == "specularTexture") {
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	// Pixels of a texture decoded by a pool worker, waiting for the upload
+	struct DecodedTexture {
+		GLuint textureID;
+		std::string fileName;
+		unsigned char* imageData;
+		int width;
+		int height;
+	};
+
+	struct TextureDecodeBatch {
+		std::mutex mutex;
+		std::condition_variable decoded;
+		std::deque<DecodedTexture> finished;
+		size_t pending;
+
+		TextureDecodeBatch() : pending(0) {}
+	};
+
+	// Runs on a pool worker: stbi_load and the vertical flip, no GL calls
+	static void DecodeTexture(std::shared_ptr<TextureDecodeBatch> batch, GLuint textureID, std::string fileName) {
+		DecodedTexture texture;
+		texture.textureID = textureID;
+		texture.fileName = fileName;
+
+		int n;
+		int force_channels = 4;
+		texture.imageData = stbi_load(fileName.c_str(), &texture.width, &texture.height, &n, force_channels);
+		if (!texture.imageData) {
+			fprintf(stderr, "ERROR: could not load %s\n", fileName.c_str());
+		}
+		else {
+			int x = texture.width;
+			int y = texture.height;
+			// NPOT check
+			if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+				fprintf(
+					stderr, "WARNING: texture %s is not power-of-2 dimensions\n", fileName.c_str()
+				);
+			}
+
+			int width_in_bytes = x * 4;
+			unsigned char *top = NULL;
+			unsigned char *bottom = NULL;
+			unsigned char temp = 0;
+			int half_height = y / 2;
+
+			for (int row = 0; row < half_height; row++) {
+				top = texture.imageData + row * width_in_bytes;
+				bottom = texture.imageData + (y - row - 1) * width_in_bytes;
+				for (int col = 0; col < width_in_bytes; col++) {
+					temp = *top;
+					*top = *bottom;
+					*bottom = temp;
+					top++;
+					bottom++;
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(batch->mutex);
+			batch->finished.push_back(texture);
+		}
+		batch->decoded.notify_one();
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
+		if (ReadCache(fileName, basePath)) {
+			BuildBoundsArrays();
+			UploadDecodedTextures();
+			return;
+		}
+
 		ReadOBJ(fileName, basePath);
+		BuildBoundsArrays();
+
+		// the textures keep decoding on the pool while the cache is written
+		if (!gps::MeshCache::Write(gps::MeshCache::GetCacheFileName(fileName), fileName, basePath, meshes)) {
+			std::cerr << "WARNING: could not write the mesh cache for " << fileName << std::endl;
+		}
+
+		UploadDecodedTextures();
+	}
+
+	// Stores vertices in the compressed layout, must be called before LoadModel
+	void Model3D::SetCompressedVertices(bool compressed) {
+		vertexFormat.compressed = compressed;
+	}
+
+	// Uniforms used by the vertex shaders to decode compressed vertices
+	void Model3D::SetVertexDecodingUniforms(gps::Shader shaderProgram) {
+		glm::vec3 positionOffset(0.0f);
+		glm::vec3 positionScale(1.0f);
+		if (vertexFormat.compressed) {
+			positionOffset = vertexFormat.boundsMin;
+			positionScale = vertexFormat.boundsMax - vertexFormat.boundsMin;
+		}
+
+		glUniform3fv(glGetUniformLocation(shaderProgram.shaderProgram, "positionOffset"), 1, glm::value_ptr(positionOffset));
+		glUniform3fv(glGetUniformLocation(shaderProgram.shaderProgram, "positionScale"), 1, glm::value_ptr(positionScale));
+		glUniform1i(glGetUniformLocation(shaderProgram.shaderProgram, "octahedralNormals"), vertexFormat.compressed);
 	}
 
 	// Draw each mesh from the model
 	void Model3D::Draw(gps::Shader shaderProgram)
 	{
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+		CullAndSelectLods(NULL, glm::mat4(1.0f));
+		DrawVisibleRuns(shaderProgram);
+	}
+
+	// Draw the visible meshes at the level of detail that fits their size on the screen, without the meshlets out of view
+	void Model3D::Draw(gps::Shader shaderProgram, const RenderView& view, const glm::mat4& modelMatrix)
+	{
+		CullAndSelectLods(&view, modelMatrix);
+		if (view.queries) {
+			DrawWithQueries(shaderProgram, view, modelMatrix);
+			return;
+		}
+		DrawVisibleRuns(shaderProgram);
+	}
+
+	// Draws only the geometry, without textures (for depth passes)
+	void Model3D::DrawDepth(gps::Shader shaderProgram)
+	{
+		CullAndSelectLods(NULL, glm::mat4(1.0f));
+		DrawVisibleRunsDepth(shaderProgram, 0);
+	}
+
+	void Model3D::DrawDepth(gps::Shader shaderProgram, const RenderView& view, const glm::mat4& modelMatrix)
+	{
+		CullAndSelectLods(&view, modelMatrix);
+		DrawVisibleRunsDepth(shaderProgram, view.depthSlot);
+	}
+
+	const std::vector<gps::Mesh>& Model3D::GetMeshes() const {
+		return meshes;
+	}
+
+	void Model3D::AssignCells(const CellGraph& cells) {
+		meshCells.resize(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshCells[i] = cells.FindMeshCell(meshes[i].name, meshes[i].boundsMin, meshes[i].boundsMax);
+		}
+	}
+
+	// Refills the bounds arrays and the material variants after the meshes changed
+	void Model3D::BuildBoundsArrays() {
+		materialPermutations.clear();
+		meshMaterialVariants.resize(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshMaterialVariants[i] = MaterialVariant(meshes[i].textures);
+		}
+
+		for (int c = 0; c < 3; c++) {
+			boundsCenters[c].resize(meshes.size());
+			boundsExtents[c].resize(meshes.size());
+			for (size_t i = 0; i < meshes.size(); i++) {
+				boundsCenters[c][i] = (meshes[i].boundsMin[c] + meshes[i].boundsMax[c]) * 0.5f;
+				boundsExtents[c][i] = (meshes[i].boundsMax[c] - meshes[i].boundsMin[c]) * 0.5f;
+			}
+		}
+
+		meshBvh = Bvh();
+		if (!meshes.empty()) {
+			std::vector<glm::vec3> boundsMin, boundsMax;
+			for (size_t i = 0; i < meshes.size(); i++) {
+				boundsMin.push_back(meshes[i].boundsMin);
+				boundsMax.push_back(meshes[i].boundsMax);
+			}
+			meshBvh.Build(boundsMin, boundsMax);
+		}
+	}
+
+	// Runs the culling and the level of detail selection for a draw
+	void Model3D::CullAndSelectLods(const RenderView* view, const glm::mat4& modelMatrix) {
+		if (!view) {
+			meshVisible.assign(meshes.size(), 1);
+			SelectLods(NULL, modelMatrix);
+			CullMeshlets(NULL, gps::Frustum(), modelMatrix);
+			return;
+		}
+
+		// the tests run in the space of the model
+		gps::Frustum frustum = view->frustum.Transformed(modelMatrix);
+		CullMeshes(frustum);
+		CullHiddenCells(*view);
+		CullOccludedMeshes(*view, modelMatrix);
+		SelectLods(view, modelMatrix);
+		CullMeshlets(view, frustum, modelMatrix);
+
+		if (view->stats) {
+			for (size_t i = 0; i < meshes.size(); i++) {
+				if (runStarts[i] == runStarts[i + 1]) {
+					view->stats->meshesCulled++;
+				}
+				else {
+					view->stats->meshesDrawn++;
+				}
+			}
+		}
+	}
+
+	// Tests the mesh bounding boxes against the frustum (in model space) into meshVisible
+	void Model3D::CullMeshes(const Frustum& frustum) {
+		meshVisible.resize(meshes.size());
+		if (meshes.empty()) {
+			return;
+		}
+		if (meshes.size() >= BVH_CULLING_MESHES) {
+			std::fill(meshVisible.begin(), meshVisible.end(), 0);
+			visibleMeshIndices.clear();
+			meshBvh.QueryFrustum(frustum, visibleMeshIndices);
+			for (size_t i = 0; i < visibleMeshIndices.size(); i++) {
+				meshVisible[visibleMeshIndices[i]] = 1;
+			}
+			return;
+		}
+		frustum.TestBoxes(&boundsCenters[0][0], &boundsCenters[1][0], &boundsCenters[2][0],
+			&boundsExtents[0][0], &boundsExtents[1][0], &boundsExtents[2][0], meshes.size(), &meshVisible[0]);
+	}
+
+	void Model3D::CullHiddenCells(const RenderView& view) {
+		if (!view.visibleCells || meshCells.size() != meshes.size()) {
+			return;
+		}
+		for (size_t i = 0; i < meshes.size(); i++) {
+			int cell = meshCells[i];
+			if (cell >= 0 && (size_t)cell < view.visibleCells->size() && !(*view.visibleCells)[cell]) {
+				meshVisible[i] = 0;
+			}
+		}
+	}
+
+	void Model3D::CullOccludedMeshes(const RenderView& view, const glm::mat4& modelMatrix) {
+		if (!view.occlusion) {
+			return;
+		}
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (meshVisible[i] && !view.occlusion->IsBoxVisible(meshes[i].boundsMin, meshes[i].boundsMax, modelMatrix)) {
+				meshVisible[i] = 0;
+				if (view.stats) {
+					view.stats->meshesOccluded++;
+				}
+			}
+		}
+	}
+
+	// Picks the level of each mesh into selectedLods, the full detail ones without a view
+	void Model3D::SelectLods(const RenderView* view, const glm::mat4& modelMatrix) {
+		selectedLods.assign(meshes.size(), 0);
+		if (!view) {
+			return;
+		}
+
+		// pixels covered by one unit at a distance of one unit (or anywhere, for an orthographic projection)
+		bool orthographic = view->projection[3][3] == 1.0f;
+		float maxScale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+			std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+		float pixelsPerUnit = view->projection[1][1] * 0.5f * view->viewportHeight * maxScale;
+		glm::mat4 modelView = view->view * modelMatrix;
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const gps::Mesh& mesh = meshes[i];
+			if (!meshVisible[i]) {
+				continue;
+			}
+			float meshPixelsPerUnit = pixelsPerUnit;
+			if (!orthographic) {
+				// the nearest point of the bounding sphere, a camera inside it gets the full detail
+				float distance = -(modelView * glm::vec4(mesh.boundsCenter, 1.0f)).z - mesh.boundsRadius * maxScale;
+				if (distance <= 0.0f) {
+					continue;
+				}
+				meshPixelsPerUnit /= distance;
+			}
+
+			size_t level = mesh.lods.size() - 1;
+			while (level > 0 && mesh.lods[level].error * meshPixelsPerUnit > view->lodBias) {
+				level--;
+			}
+			selectedLods[i] = level;
+		}
+	}
+
+	// Fills visibleRuns from the levels in selectedLods of the visible meshes, keeping every meshlet without a view
+	void Model3D::CullMeshlets(const RenderView* view, const Frustum& frustum, const glm::mat4& modelMatrix) {
+		visibleRuns.clear();
+		runStarts.clear();
+
+		if (!view) {
+			for (size_t i = 0; i < meshes.size(); i++) {
+				const gps::MeshLod& lod = meshes[i].lods[selectedLods[i]];
+				IndexRun run;
+				run.firstIndex = lod.firstIndex;
+				run.indexCount = lod.indexCount;
+				runStarts.push_back(visibleRuns.size());
+				visibleRuns.push_back(run);
+			}
+			runStarts.push_back(visibleRuns.size());
+			return;
+		}
+
+		glm::mat4 modelView = view->view * modelMatrix;
+		bool coneCulling = view->coneCulling && view->projection[3][3] != 1.0f;
+		glm::vec3 cameraPosition = glm::vec3(glm::inverse(modelView)[3]);
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const gps::Mesh& mesh = meshes[i];
+			const gps::MeshLod& lod = mesh.lods[selectedLods[i]];
+			runStarts.push_back(visibleRuns.size());
+			if (!meshVisible[i]) {
+				continue;
+			}
+
+			for (GLuint m = lod.firstMeshlet; m < lod.firstMeshlet + lod.meshletCount; m++) {
+				const gps::Meshlet& meshlet = mesh.meshlets[m];
+				bool culled = !frustum.IntersectsSphere(meshlet.center, meshlet.radius);
+				if (!culled && coneCulling) {
+					glm::vec3 toMeshlet = meshlet.center - cameraPosition;
+					culled = glm::dot(toMeshlet, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toMeshlet) + meshlet.radius;
+				}
+				if (!culled && view->occlusion) {
+					glm::vec3 radius(meshlet.radius);
+					culled = !view->occlusion->IsBoxVisible(meshlet.center - radius, meshlet.center + radius, modelMatrix);
+					if (culled && view->stats) {
+						view->stats->meshletsOccluded++;
+					}
+				}
+				if (culled) {
+					if (view->stats) {
+						view->stats->meshletsCulled++;
+					}
+					continue;
+				}
+
+				// meshlets follow each other in the index buffer, so visible neighbours become one draw
+				if (visibleRuns.size() > runStarts.back() &&
+					visibleRuns.back().firstIndex + visibleRuns.back().indexCount == meshlet.firstIndex) {
+					visibleRuns.back().indexCount += meshlet.indexCount;
+				}
+				else {
+					IndexRun run;
+					run.firstIndex = meshlet.firstIndex;
+					run.indexCount = meshlet.indexCount;
+					visibleRuns.push_back(run);
+				}
+			}
+		}
+		runStarts.push_back(visibleRuns.size());
+	}
+
+	void Model3D::DrawVisibleRuns(gps::Shader shaderProgram)
+	{
+		shaderProgram.useShaderProgram();
+		SetVertexDecodingUniforms(shaderProgram);
+
+		RunBindings bindings;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			DrawMeshRuns(shaderProgram, i, bindings);
+		}
+		EndMeshRuns(shaderProgram, bindings);
+	}
+
+	void Model3D::DrawMeshRuns(gps::Shader shaderProgram, size_t i, RunBindings& bindings)
+	{
+		const gps::GeometryAllocation& allocation = meshes[i].getAllocation();
+		if (allocation.block < 0 || runStarts[i] == runStarts[i + 1]) {
+			return;
+		}
+
+		// textures and vertex arrays are only rebound when they change between meshes
+		const std::vector<gps::Texture>& textures = meshes[i].textures;
+		if (!bindings.textures || !SameTextures(*bindings.textures, textures)) {
+			// the permutation of the shader for the material, the caller has set its uniforms (GetMaterialPermutations)
+			if (!bindings.permutations) {
+				bindings.permutations = &FindMaterialPermutations(shaderProgram);
+			}
+			const gps::Shader& permutation = bindings.permutations->variants[meshMaterialVariants[i]];
+			if (permutation.shaderProgram != bindings.program) {
+				glUseProgram(permutation.shaderProgram);
+				SetVertexDecodingUniforms(permutation);
+				bindings.program = permutation.shaderProgram;
+			}
+			for (GLuint t = 0; t < textures.size(); t++) {
+				glActiveTexture(GL_TEXTURE0 + t);
+				glUniform1i(glGetUniformLocation(permutation.shaderProgram, textures[t].type.c_str()), t);
+				glBindTexture(GL_TEXTURE_2D, textures[t].id);
+			}
+			// units left over from the previous mesh sample nothing, as after Mesh::Draw
+			for (GLuint t = (GLuint)textures.size(); bindings.textures && t < bindings.textures->size(); t++) {
+				glActiveTexture(GL_TEXTURE0 + t);
+				glBindTexture(GL_TEXTURE_2D, 0);
+			}
+			bindings.textures = &textures;
+		}
+
+		if (allocation.block != bindings.block) {
+			glBindVertexArray(gps::GeometryArena::GetShared().GetVertexArray(allocation.block));
+			bindings.block = allocation.block;
+		}
+
+		if (runStarts[i + 1] - runStarts[i] == 1) {
+			const IndexRun& run = visibleRuns[runStarts[i]];
+			glDrawElementsBaseVertex(GL_TRIANGLES, run.indexCount, allocation.indexType,
+				gps::GeometryArena::GetIndexOffset(allocation, run.firstIndex), allocation.baseVertex);
+			return;
+		}
+
+		runCounts.clear();
+		runOffsets.clear();
+		runBaseVertices.clear();
+		for (size_t r = runStarts[i]; r < runStarts[i + 1]; r++) {
+			runCounts.push_back(visibleRuns[r].indexCount);
+			runOffsets.push_back(gps::GeometryArena::GetIndexOffset(allocation, visibleRuns[r].firstIndex));
+			runBaseVertices.push_back(allocation.baseVertex);
+		}
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, &runCounts[0], allocation.indexType, &runOffsets[0],
+			(GLsizei)runCounts.size(), &runBaseVertices[0]);
+	}
+
+	void Model3D::EndMeshRuns(gps::Shader shaderProgram, RunBindings& bindings)
+	{
+		glBindVertexArray(0);
+		for (GLuint t = 0; bindings.textures && t < bindings.textures->size(); t++) {
+			glActiveTexture(GL_TEXTURE0 + t);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+		// the caller keeps setting uniforms on its own program after the draw
+		if (bindings.program != 0 && bindings.program != shaderProgram.shaderProgram) {
+			shaderProgram.useShaderProgram();
+		}
+		bindings = RunBindings();
+	}
+
+	Model3D::MaterialPermutations& Model3D::FindMaterialPermutations(gps::Shader shaderProgram)
+	{
+		for (size_t i = 0; i < materialPermutations.size(); i++) {
+			if (materialPermutations[i].base == shaderProgram.shaderProgram) {
+				return materialPermutations[i];
+			}
+		}
+
+		// compiled once per shader for the variants the meshes use, each starts with the uniforms the shader has now
+		MaterialPermutations permutations;
+		permutations.base = shaderProgram.shaderProgram;
+		for (int v = 0; v < MATERIAL_VARIANTS; v++) {
+			if (std::find(meshMaterialVariants.begin(), meshMaterialVariants.end(), v) == meshMaterialVariants.end()) {
+				permutations.variants[v] = shaderProgram;
+				continue;
+			}
+			permutations.variants[v] = shaderProgram.getPermutation(MATERIAL_VARIANT_FEATURES[v]);
+			shaderProgram.copyUniformsTo(permutations.variants[v]);
+		}
+		materialPermutations.push_back(permutations);
+		return materialPermutations.back();
+	}
+
+	void Model3D::GetMaterialPermutations(gps::Shader shaderProgram, std::vector<gps::Shader>& permutations)
+	{
+		const MaterialPermutations& cached = FindMaterialPermutations(shaderProgram);
+		for (int v = 0; v < MATERIAL_VARIANTS; v++) {
+			if (std::find(meshMaterialVariants.begin(), meshMaterialVariants.end(), v) == meshMaterialVariants.end()) {
+				continue;
+			}
+			bool listed = false;
+			for (size_t i = 0; i < permutations.size() && !listed; i++) {
+				listed = permutations[i].shaderProgram == cached.variants[v].shaderProgram;
+			}
+			if (!listed) {
+				permutations.push_back(cached.variants[v]);
+			}
+		}
+	}
+
+	void Model3D::ReadQueryResults(RenderStats* stats)
+	{
+		const std::vector<BvhNode>& nodes = meshBvh.GetNodes();
+		if (nodeQueries.size() != nodes.size()) {
+			for (size_t i = 0; i < nodeQueries.size(); i++) {
+				glDeleteQueries(1, &nodeQueries[i].query);
+			}
+			nodeQueries.assign(nodes.size(), NodeOcclusionQuery());
+			for (size_t i = 0; i < nodeQueries.size(); i++) {
+				glGenQueries(1, &nodeQueries[i].query);
+			}
+			nodeParents.assign(nodes.size(), 0);
+			for (size_t i = 0; i < nodes.size(); i++) {
+				if (nodes[i].primitiveCount == 0) {
+					nodeParents[nodes[i].leftOrFirst] = (GLuint)i;
+					nodeParents[nodes[i].leftOrFirst + 1] = (GLuint)i;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < nodeQueries.size(); i++) {
+			NodeOcclusionQuery& query = nodeQueries[i];
+			if (!query.pending) {
+				continue;
+			}
+			GLuint available = 0;
+			glGetQueryObjectuiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				continue;
+			}
+			GLuint samplesPassed = 0;
+			glGetQueryObjectuiv(query.query, GL_QUERY_RESULT, &samplesPassed);
+			query.visible = samplesPassed != 0;
+			query.pending = false;
+			if (stats) {
+				stats->queryResults++;
+				if (query.visible) {
+					stats->queryResultsVisible++;
+				}
+			}
+
+			// pull-up: the walk has to go through the ancestors to reach a visible node
+			for (size_t n = i; query.visible && n != 0 && !nodeQueries[nodeParents[n]].visible; n = nodeParents[n]) {
+				nodeQueries[nodeParents[n]].visible = true;
+			}
+
+			// push-down: the children of an inner node found visible as a whole are drawn and get their own
+			// queries next frame, instead of the node being merged back below
+			if (query.visible && nodes[i].primitiveCount == 0) {
+				for (GLuint c = nodes[i].leftOrFirst; c <= nodes[i].leftOrFirst + 1; c++) {
+					nodeQueries[c].visible = true;
+					nodeQueries[c].pending = false;
+					nodeQueries[c].queryNext = true;
+				}
+			}
+		}
+
+		// an inner node whose children were both found occluded is queried as a whole again, children come after
+		// their parents. Nodes visible this frame have had their children pushed down to visible, so stay
+		for (size_t n = nodes.size(); n-- > 0; ) {
+			const BvhNode& node = nodes[n];
+			if (node.primitiveCount == 0 && nodeQueries[n].visible &&
+				!nodeQueries[node.leftOrFirst].visible && !nodeQueries[node.leftOrFirst + 1].visible) {
+				nodeQueries[n].visible = false;
+			}
+		}
+	}
+
+	void Model3D::DrawNodeRuns(gps::Shader shaderProgram, GLuint nodeIndex, RunBindings& bindings)
+	{
+		const std::vector<BvhNode>& nodes = meshBvh.GetNodes();
+		const std::vector<GLuint>& nodeMeshes = meshBvh.GetPrimitives();
+
+		GLuint stack[64];
+		int stackSize = 0;
+		stack[stackSize++] = nodeIndex;
+		while (stackSize > 0) {
+			const BvhNode& node = nodes[stack[--stackSize]];
+			if (node.primitiveCount == 0) {
+				stack[stackSize++] = node.leftOrFirst + 1;
+				stack[stackSize++] = node.leftOrFirst;
+				continue;
+			}
+			for (GLuint i = 0; i < node.primitiveCount; i++) {
+				GLuint meshIndex = nodeMeshes[node.leftOrFirst + i];
+				if (runStarts[meshIndex] != runStarts[meshIndex + 1]) {
+					DrawMeshRuns(shaderProgram, meshIndex, bindings);
+				}
+			}
+		}
+	}
+
+	void Model3D::DrawWithQueries(gps::Shader shaderProgram, const RenderView& view, const glm::mat4& modelMatrix)
+	{
+		gps::OcclusionQueries& queries = *view.queries;
+		ReadQueryResults(view.stats);
+		const std::vector<BvhNode>& nodes = meshBvh.GetNodes();
+		if (nodes.empty()) {
+			return;
+		}
+
+		// subtrees without anything left to draw after the culling are skipped, filled from the leaves up
+		const std::vector<GLuint>& nodeMeshes = meshBvh.GetPrimitives();
+		nodeDrawn.resize(nodes.size());
+		for (size_t n = nodes.size(); n-- > 0; ) {
+			const BvhNode& node = nodes[n];
+			if (node.primitiveCount == 0) {
+				nodeDrawn[n] = nodeDrawn[node.leftOrFirst] || nodeDrawn[node.leftOrFirst + 1];
+				continue;
+			}
+			nodeDrawn[n] = 0;
+			for (GLuint i = 0; i < node.primitiveCount && !nodeDrawn[n]; i++) {
+				GLuint meshIndex = nodeMeshes[node.leftOrFirst + i];
+				nodeDrawn[n] = runStarts[meshIndex] != runStarts[meshIndex + 1];
+			}
+		}
+
+		// the box of a node the camera is in, or about to be, would be clipped by the near plane
+		glm::mat4 modelView = view.view * modelMatrix;
+		glm::vec3 cameraPosition = glm::vec3(glm::inverse(modelView)[3]);
+		float nearDistance = view.projection[3][3] == 1.0f ? 0.0f : view.projection[3][2] / (view.projection[2][2] - 1.0f);
+		glm::vec3 nearMargin(2.0f * fabsf(nearDistance));
+
+		shaderProgram.useShaderProgram();
+		SetVertexDecodingUniforms(shaderProgram);
+
+		// front to back from the root: visible leaves are drawn right away to fill the depth buffer, with a query
+		// now and then to see if they still are. The walk stops at occluded nodes
+		RunBindings bindings;
+		terminationNodes.clear();
+		GLuint stack[64];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			GLuint n = stack[--stackSize];
+			if (!nodeDrawn[n]) {
+				continue;
+			}
+			const BvhNode& node = nodes[n];
+			NodeOcclusionQuery& query = nodeQueries[n];
+
+			glm::vec3 offset = glm::max(node.boundsMin - cameraPosition, cameraPosition - node.boundsMax);
+			if (offset.x < nearMargin.x && offset.y < nearMargin.y && offset.z < nearMargin.z) {
+				query.visible = true;
+			}
+			if (!query.visible) {
+				terminationNodes.push_back(n);
+				continue;
+			}
+
+			if (node.primitiveCount == 0) {
+				// the far child goes below the near one
+				glm::vec3 leftOffset = (nodes[node.leftOrFirst].boundsMin + nodes[node.leftOrFirst].boundsMax) * 0.5f - cameraPosition;
+				glm::vec3 rightOffset = (nodes[node.leftOrFirst + 1].boundsMin + nodes[node.leftOrFirst + 1].boundsMax) * 0.5f - cameraPosition;
+				bool leftFirst = glm::dot(leftOffset, leftOffset) <= glm::dot(rightOffset, rightOffset);
+				stack[stackSize++] = node.leftOrFirst + (leftFirst ? 1 : 0);
+				stack[stackSize++] = node.leftOrFirst + (leftFirst ? 0 : 1);
+				continue;
+			}
+
+			bool issueQuery = !query.pending && (query.queryNext || queries.IsVisibleQueryDue(n));
+			query.queryNext = false;
+			if (issueQuery) {
+				glBeginQuery(queries.GetQueryTarget(), query.query);
+			}
+			DrawNodeRuns(shaderProgram, n, bindings);
+			if (issueQuery) {
+				glEndQuery(queries.GetQueryTarget());
+				query.pending = true;
+				if (view.stats) {
+					view.stats->queriesIssued++;
+				}
+			}
+		}
+		EndMeshRuns(shaderProgram, bindings);
+
+		// occluded nodes: their boxes are tested in one batch against that depth
+		glm::mat4 modelViewProjection = view.projection * modelView;
+		bool boxesStarted = false;
+		for (size_t i = 0; i < terminationNodes.size(); i++) {
+			NodeOcclusionQuery& query = nodeQueries[terminationNodes[i]];
+			if (query.pending) {
+				continue;
+			}
+			if (!boxesStarted) {
+				queries.BeginBoxes();
+				boxesStarted = true;
+			}
+			const BvhNode& node = nodes[terminationNodes[i]];
+			glBeginQuery(queries.GetQueryTarget(), query.query);
+			queries.DrawBox(modelViewProjection, node.boundsMin, node.boundsMax);
+			glEndQuery(queries.GetQueryTarget());
+			query.pending = true;
+			if (view.stats) {
+				view.stats->queriesIssued++;
+			}
+		}
+		if (boxesStarted) {
+			queries.EndBoxes();
+		}
+
+		// and their subtrees drawn only where the GPU saw the box pass, without the CPU waiting for the answer
+		bool shaderBound = !boxesStarted;
+		for (size_t i = 0; i < terminationNodes.size(); i++) {
+			if (!shaderBound) {
+				shaderProgram.useShaderProgram();
+				SetVertexDecodingUniforms(shaderProgram);
+				shaderBound = true;
+			}
+			glBeginConditionalRender(nodeQueries[terminationNodes[i]].query, GL_QUERY_NO_WAIT);
+			DrawNodeRuns(shaderProgram, terminationNodes[i], bindings);
+			glEndConditionalRender();
+		}
+		EndMeshRuns(shaderProgram, bindings);
+	}
+
+	void Model3D::DrawVisibleRunsDepth(gps::Shader shaderProgram, unsigned int depthSlot)
+	{
+		shaderProgram.useShaderProgram();
+		SetVertexDecodingUniforms(shaderProgram);
+
+		// glMultiDrawElementsIndirect needs ARB_multi_draw_indirect (core in 4.3), the context is 4.1
+		if (GLEW_ARB_multi_draw_indirect) {
+			// the commands of a slot are only rewritten when the levels or the culling results of its view change
+			if (depthSlot >= indirectCommands.size()) {
+				indirectCommands.resize(depthSlot + 1);
+			}
+			IndirectCommands& cache = indirectCommands[depthSlot];
+			if (!cache.buffer || cache.runs != visibleRuns || cache.runStarts != runStarts) {
+				BuildIndirectCommands(cache);
+			}
+
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cache.buffer);
+			for (size_t i = 0; i < cache.draws.size(); i++) {
+				glBindVertexArray(gps::GeometryArena::GetShared().GetVertexArray(cache.draws[i].block));
+				glMultiDrawElementsIndirect(GL_TRIANGLES, cache.draws[i].indexType,
+					(GLvoid*)(cache.draws[i].firstCommand * sizeof(DrawElementsIndirectCommand)),
+					cache.draws[i].commandCount, 0);
+			}
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		else {
+			int boundBlock = -1;
+			for (size_t i = 0; i < meshes.size(); i++) {
+				const gps::GeometryAllocation& allocation = meshes[i].getAllocation();
+				if (allocation.block < 0 || runStarts[i] == runStarts[i + 1]) {
+					continue;
+				}
+				if (allocation.block != boundBlock) {
+					glBindVertexArray(gps::GeometryArena::GetShared().GetVertexArray(allocation.block));
+					boundBlock = allocation.block;
+				}
+
+				runCounts.clear();
+				runOffsets.clear();
+				runBaseVertices.clear();
+				for (size_t r = runStarts[i]; r < runStarts[i + 1]; r++) {
+					runCounts.push_back(visibleRuns[r].indexCount);
+					runOffsets.push_back(gps::GeometryArena::GetIndexOffset(allocation, visibleRuns[r].firstIndex));
+					runBaseVertices.push_back(allocation.baseVertex);
+				}
+				glMultiDrawElementsBaseVertex(GL_TRIANGLES, &runCounts[0], allocation.indexType, &runOffsets[0],
+					(GLsizei)runCounts.size(), &runBaseVertices[0]);
+			}
+		}
+
+		glBindVertexArray(0);
+	}
+
+	// Rebuilds the indirect draw commands of a slot for the current visibleRuns
+	void Model3D::BuildIndirectCommands(IndirectCommands& cache) {
+		cache.draws.clear();
+		cache.runs = visibleRuns;
+		cache.runStarts = runStarts;
+
+		// one run of commands per block, the depth pass does not care about the mesh order
+		std::vector<DrawElementsIndirectCommand> commands;
+		std::vector<bool> blockDone;
+		for (size_t first = 0; first < meshes.size(); first++) {
+			int block = meshes[first].getAllocation().block;
+			if (block < 0 || (block < (int)blockDone.size() && blockDone[block])) {
+				continue;
+			}
+			if (block >= (int)blockDone.size()) {
+				blockDone.resize(block + 1, false);
+			}
+			blockDone[block] = true;
+
+			IndirectDrawRange range;
+			range.block = block;
+			range.indexType = meshes[first].getAllocation().indexType;
+			range.firstCommand = (GLuint)commands.size();
+			for (size_t i = first; i < meshes.size(); i++) {
+				const gps::GeometryAllocation& allocation = meshes[i].getAllocation();
+				if (allocation.block != block) {
+					continue;
+				}
+				for (size_t r = runStarts[i]; r < runStarts[i + 1]; r++) {
+					DrawElementsIndirectCommand command;
+					command.count = visibleRuns[r].indexCount;
+					command.instanceCount = 1;
+					command.firstIndex = allocation.firstIndex + visibleRuns[r].firstIndex;
+					command.baseVertex = allocation.baseVertex;
+					command.baseInstance = 0;
+					commands.push_back(command);
+				}
+			}
+			range.commandCount = (GLsizei)(commands.size() - range.firstCommand);
+			cache.draws.push_back(range);
+		}
+
+		if (!cache.buffer) {
+			glGenBuffers(1, &cache.buffer);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cache.buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+			commands.empty() ? NULL : &commands[0], GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	// Merges the nearby meshes that use the same textures into one mesh each
+	void Model3D::BuildStaticBatches(glm::mat4 modelMatrix) {
+		glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(modelMatrix));
+		bool transform = modelMatrix != glm::mat4(1.0f);
+
+		// batches keep the order in which their texture sets first appear
+		std::vector<StaticBatch> batches;
+
+		for (size_t m = 0; m < meshes.size(); m++) {
+			gps::Mesh& mesh = meshes[m];
+
+			// meshes of different cells stay apart, so hidden rooms can be skipped whole, and so do meshes
+			// of different grid regions, so the batches are still culled and given a level each
+			int cell = meshCells.empty() ? -1 : meshCells[m];
+			glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(mesh.boundsCenter, 1.0f));
+			glm::ivec3 region = glm::ivec3(glm::floor(center / STATIC_BATCH_REGION_SIZE));
+			size_t b = 0;
+			while (b < batches.size() && (batches[b].cell != cell || batches[b].region != region ||
+				!SameTextures(batches[b].textures, mesh.textures))) {
+				b++;
+			}
+			if (b == batches.size()) {
+				batches.push_back(StaticBatch());
+				batches[b].textures = mesh.textures;
+				batches[b].cell = cell;
+				batches[b].region = region;
+			}
+
+			StaticBatch& batch = batches[b];
+			GLuint firstVertex = (GLuint)batch.vertices.size();
+			for (size_t v = 0; v < mesh.vertices.size(); v++) {
+				gps::Vertex vertex = mesh.vertices[v];
+				if (transform) {
+					vertex.Position = glm::vec3(modelMatrix * glm::vec4(vertex.Position, 1.0f));
+					vertex.Normal = glm::normalize(normalMatrix * vertex.Normal);
+				}
+				batch.vertices.push_back(vertex);
+			}
+			// level l of the batch merges level l of its meshes, or their coarsest one: the levels this
+			// mesh adds start as copies of the coarsest level of the meshes merged before it
+			size_t oldLevelCount = batch.lodIndices.size();
+			size_t levelCount = std::max(oldLevelCount, mesh.lods.size());
+			batch.lodIndices.resize(levelCount);
+			batch.lodErrors.resize(levelCount, 0.0f);
+			for (size_t l = oldLevelCount; l < levelCount && oldLevelCount > 0; l++) {
+				batch.lodIndices[l] = batch.lodIndices[oldLevelCount - 1];
+				batch.lodErrors[l] = batch.lodErrors[oldLevelCount - 1];
+			}
+			for (size_t l = 0; l < levelCount; l++) {
+				const gps::MeshLod& lod = mesh.lods[std::min(l, mesh.lods.size() - 1)];
+				for (GLuint i = 0; i < lod.indexCount; i++) {
+					batch.lodIndices[l].push_back(firstVertex + mesh.indices[lod.firstIndex + i]);
+				}
+				batch.lodErrors[l] = std::max(batch.lodErrors[l], lod.error);
+			}
+
+			mesh.releaseBuffers();
+		}
+
+		std::cout << "Batched " << meshes.size() << " meshes into " << batches.size() << " draw calls" << std::endl;
+
+		// the baked vertices may have moved out of the previous quantization bounds
+		if (vertexFormat.compressed) {
+			bool first = true;
+			for (size_t b = 0; b < batches.size(); b++) {
+				for (size_t v = 0; v < batches[b].vertices.size(); v++) {
+					const glm::vec3& position = batches[b].vertices[v].Position;
+					vertexFormat.boundsMin = first ? position : glm::min(vertexFormat.boundsMin, position);
+					vertexFormat.boundsMax = first ? position : glm::max(vertexFormat.boundsMax, position);
+					first = false;
+				}
+			}
+		}
+
+		meshes.clear();
+		meshCells.clear();
+		for (size_t b = 0; b < batches.size(); b++) {
+			// every level holds all the meshes of the batch, those with fewer levels repeat their coarsest one
+			std::vector<GLuint> indices;
+			std::vector<gps::MeshLod> lods;
+			for (size_t l = 0; l < batches[b].lodIndices.size(); l++) {
+				gps::MeshLod lod;
+				lod.firstIndex = (GLuint)indices.size();
+				lod.indexCount = (GLuint)batches[b].lodIndices[l].size();
+				lod.error = batches[b].lodErrors[l];
+				// the meshlets are built by the Mesh constructor
+				lod.firstMeshlet = 0;
+				lod.meshletCount = 0;
+				indices.insert(indices.end(), batches[b].lodIndices[l].begin(), batches[b].lodIndices[l].end());
+				lods.push_back(lod);
+			}
+			meshes.push_back(gps::Mesh(batches[b].vertices, indices, batches[b].textures, vertexFormat, lods));
+			meshCells.push_back(batches[b].cell);
+		}
+
+		// the mesh count changed, the depth commands are rebuilt on the next draw
+		for (size_t i = 0; i < indirectCommands.size(); i++) {
+			indirectCommands[i].runs.clear();
+			indirectCommands[i].runStarts.clear();
+		}
+		BuildBoundsArrays();
+	}
+
+	// Fills in the data structure from the binary cache of the .obj file, if it is up to date
+	bool Model3D::ReadCache(std::string fileName, std::string basePath) {
+
+		std::string cacheFileName = gps::MeshCache::GetCacheFileName(fileName);
+		gps::MeshCache cache;
+		if (!cache.Open(cacheFileName, fileName, basePath)) {
+			return false;
+		}
+
+		std::cout << "Loading : " << fileName << " (cached in " << cacheFileName << ")" << std::endl;
+
+		const std::vector<gps::CachedShape>& shapes = cache.GetShapes();
+		std::cout << "# of shapes    : " << shapes.size() << std::endl;
+
+		for (size_t s = 0; s < shapes.size(); s++) {
+			vertexFormat.boundsMin = s == 0 ? shapes[s].boundsMin : glm::min(vertexFormat.boundsMin, shapes[s].boundsMin);
+			vertexFormat.boundsMax = s == 0 ? shapes[s].boundsMax : glm::max(vertexFormat.boundsMax, shapes[s].boundsMax);
+		}
+
+		for (size_t s = 0; s < shapes.size(); s++) {
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < shapes[s].textures.size(); t++) {
+				textures.push_back(LoadTexture(shapes[s].textures[t].path, shapes[s].textures[t].type));
+			}
+
+			// the arrays are copied straight out of the mapped file, and moved into the mesh
+			std::vector<gps::Vertex> vertices(shapes[s].vertices, shapes[s].vertices + shapes[s].vertexCount);
+			std::vector<GLuint> indices(shapes[s].indices, shapes[s].indices + shapes[s].indexCount);
+
+			meshes.push_back(gps::Mesh(std::move(vertices), std::move(indices), textures, vertexFormat, shapes[s].lods, shapes[s].meshlets));
+			meshes.back().name = shapes[s].name;
+		}
+
+		return true;
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
@@ -29,8 +1046,19 @@ namespace gps {
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
+		gps::MappedFile objFile;
+		if (!objFile.Open(fileName)) {
+			std::cerr << "Cannot open file [" << fileName << "]" << std::endl;
+			exit(1);
+		}
+
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		// the vertex and face lines are parsed on all hardware threads, only the parse of the mapped file is timed
+		tinyobj::MaterialFileReader materialReader(basePath);
+		std::chrono::high_resolution_clock::time_point parseStart = std::chrono::high_resolution_clock::now();
+		bool ret = tinyobj::LoadObjParallel(&attrib, &shapes, &materials, &err, (const char*)objFile.GetData(), objFile.GetSize(),
+			&materialReader, GL_TRUE);
+		double parseTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - parseStart).count();
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
@@ -40,14 +1068,32 @@ namespace gps {
 			exit(1);
 		}
 
+		// parse throughput, to keep an eye on the number parsing cost of large models
+		double fileMegabytes = (double)objFile.GetSize() / (1024.0 * 1024.0);
+		std::cout << "Parsed " << fileMegabytes << " MB in " << parseTime << " ms";
+		if (parseTime > 0.0) {
+			std::cout << " (" << fileMegabytes / (parseTime / 1000.0) << " MB/s)";
+		}
+		std::cout << std::endl;
+
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		// all the positions of the file, so every shape is quantized to the same box
+		for (size_t v = 0; v + 2 < attrib.vertices.size(); v += 3) {
+			glm::vec3 position(attrib.vertices[v], attrib.vertices[v + 1], attrib.vertices[v + 2]);
+			vertexFormat.boundsMin = v == 0 ? position : glm::min(vertexFormat.boundsMin, position);
+			vertexFormat.boundsMax = v == 0 ? position : glm::max(vertexFormat.boundsMax, position);
+		}
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 			std::vector<gps::Vertex> vertices;
 			std::vector<GLuint> indices;
 			std::vector<gps::Texture> textures;
+			// Maps every distinct vertex to its slot in `vertices`
+			std::unordered_map<gps::Vertex, GLuint, VertexHash, VertexEqual> uniqueVertices;
+			uniqueVertices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -84,14 +1130,56 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
-					vertices.push_back(currentVertex);
+					// weld face corners that share position, normal and texture coordinates
+					std::pair<std::unordered_map<gps::Vertex, GLuint, VertexHash, VertexEqual>::iterator, bool> inserted =
+						uniqueVertices.insert(std::make_pair(currentVertex, (GLuint)vertices.size()));
+					if (inserted.second) {
+						vertices.push_back(currentVertex);
+					}
 
-					indices.push_back(index_offset + v);
+					indices.push_back(inserted.first->second);
 				}
 
 				index_offset += fv;
 			}
 
+			// triangle and vertex order for the post-transform cache, overdraw and vertex fetch
+			float acmrBefore = gps::MeshOptimizer::ComputeACMR(indices, vertices.size());
+			float atvrBefore = gps::MeshOptimizer::ComputeATVR(indices, vertices.size());
+			gps::MeshOptimizer::Optimize(vertices, indices);
+
+			std::cout << "  shape " << s << " (" << shapes[s].name << ") : "
+				<< indices.size() << " -> " << vertices.size() << " vertices, ACMR "
+				<< acmrBefore << " -> " << gps::MeshOptimizer::ComputeACMR(indices, vertices.size()) << ", ATVR "
+				<< atvrBefore << " -> " << gps::MeshOptimizer::ComputeATVR(indices, vertices.size()) << std::endl;
+
+			// coarser levels over the same vertices, appended after the full detail indices
+			std::vector<std::vector<GLuint> > lodIndices;
+			std::vector<float> lodErrors;
+			gps::MeshSimplifier::BuildLods(vertices, indices, LOD_LEVELS, lodIndices, lodErrors);
+
+			std::vector<gps::MeshLod> lods(1);
+			lods[0].firstIndex = 0;
+			lods[0].indexCount = (GLuint)indices.size();
+			lods[0].error = 0.0f;
+			lods[0].firstMeshlet = 0;
+			lods[0].meshletCount = 0;
+			for (size_t l = 0; l < lodIndices.size(); l++) {
+				gps::MeshOptimizer::OptimizeIndices(vertices, lodIndices[l]);
+
+				gps::MeshLod lod;
+				lod.firstIndex = (GLuint)indices.size();
+				lod.indexCount = (GLuint)lodIndices[l].size();
+				lod.error = lodErrors[l];
+				// the meshlets are built by the Mesh constructor
+				lod.firstMeshlet = 0;
+				lod.meshletCount = 0;
+				indices.insert(indices.end(), lodIndices[l].begin(), lodIndices[l].end());
+				lods.push_back(lod);
+
+				std::cout << "    LOD " << l + 1 << " : " << lod.indexCount / 3 << " triangles, error " << lod.error << std::endl;
+			}
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			int a = shapes[s].mesh.material_ids.size();
@@ -132,102 +1220,111 @@ namespace gps {
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			meshes.push_back(gps::Mesh(vertices, indices, textures, vertexFormat, lods));
+			meshes.back().name = shapes[s].name;
 		}
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
-				if (loadedTextures[i].path == path)
-				{
-					//already loaded texture
-					return loadedTextures[i];
-				}
+		// meshes sharing an image share the texture, the model holds one registry reference per path
+		// and the pixels are loaded once per process
+		std::unordered_map<std::string, gps::Texture>::iterator loaded = loadedTextures.find(path);
+		if (loaded == loadedTextures.end()) {
+			bool created;
+			gps::Texture texture;
+			texture.id = gps::TextureRegistry::GetShared().Acquire(path, &created);
+			texture.path = path;
+
+			if (created) {
+				ReadTextureFromFile(texture.id, path.c_str());
 			}
 
-			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
-			currentTexture.type = std::string(type);
-			currentTexture.path = path;
+			loaded = loadedTextures.insert(std::make_pair(path, texture)).first;
+		}
+
+		gps::Texture currentTexture = loaded->second;
+		currentTexture.type = std::string(type);
 
-			loadedTextures.push_back(currentTexture);
+		return currentTexture;
+	}
 
-			return currentTexture;
+	// Queues the image file for decoding on the thread pool, the pixels go into the given texture
+	void Model3D::ReadTextureFromFile(GLuint textureID, const char* file_name) {
+		if (!decodeBatch) {
+			decodeBatch = std::make_shared<TextureDecodeBatch>();
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
+		{
+			std::lock_guard<std::mutex> lock(decodeBatch->mutex);
+			decodeBatch->pending++;
 		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
+		gps::ThreadPool::GetShared().Enqueue(std::bind(DecodeTexture, decodeBatch, textureID, std::string(file_name)));
+	}
+
+	// Loads the pixel data of the queued textures into the video memory, as each decode finishes
+	void Model3D::UploadDecodedTextures() {
+		if (!decodeBatch) {
+			return;
 		}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
+		std::chrono::high_resolution_clock::time_point uploadStart = std::chrono::high_resolution_clock::now();
+		size_t uploadCount = 0;
+
+		for (;;) {
+			DecodedTexture texture;
+			{
+				std::unique_lock<std::mutex> lock(decodeBatch->mutex);
+				if (decodeBatch->pending == 0) {
+					break;
+				}
+				while (decodeBatch->finished.empty()) {
+					decodeBatch->decoded.wait(lock);
+				}
+				texture = decodeBatch->finished.front();
+				decodeBatch->finished.pop_front();
+				decodeBatch->pending--;
+			}
 
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
+			// a texture that failed to decode stays without storage, like texture 0
+			if (!texture.imageData) {
+				continue;
 			}
+
+			gps::TextureUploader::GetShared().Upload(texture.textureID, texture.width, texture.height, texture.imageData);
+
+			stbi_image_free(texture.imageData);
+			uploadCount++;
 		}
 
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return textureID;
+		if (uploadCount > 0) {
+			double uploadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - uploadStart).count();
+			std::cout << "Uploaded " << uploadCount << " textures (" << gps::ThreadPool::GetShared().GetWorkerCount()
+				<< " decode threads) in " << uploadTime << " ms" << std::endl;
+		}
+	}
+
+	Model3D::Model3D() {
 	}
 
 	Model3D::~Model3D() {
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+        for (std::unordered_map<std::string, gps::Texture>::iterator texture = loadedTextures.begin(); texture != loadedTextures.end(); ++texture) {
+            gps::TextureRegistry::GetShared().Release(texture->second.id);
         }
 
         for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+            meshes.at(i).releaseBuffers();
+        }
+
+        for (size_t i = 0; i < indirectCommands.size(); i++) {
+            if (indirectCommands[i].buffer) {
+                glDeleteBuffers(1, &indirectCommands[i].buffer);
+            }
+        }
+
+        for (size_t i = 0; i < nodeQueries.size(); i++) {
+            glDeleteQueries(1, &nodeQueries[i].query);
         }
 	}
 }
@@ -1,34 +1,270 @@
 #ifndef Model3D_hpp
 #define Model3D_hpp
 
+#include "Bvh.hpp"
+#include "CellGraph.hpp"
+#include "Frustum.hpp"
 #include "Mesh.hpp"
+#include "OcclusionCuller.hpp"
+#include "OcclusionQueries.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
 #include <iostream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace gps {
 
+    // Textures of a model being decoded on the thread pool
+    struct TextureDecodeBatch;
+
+    // Per frame counters, summed over the draws that share a RenderView::stats
+    struct RenderStats
+    {
+        unsigned int meshesDrawn;
+        // meshes outside the view frustum, or with all their meshlets culled
+        unsigned int meshesCulled;
+        // meshlets of the drawn meshes outside the frustum or facing away
+        unsigned int meshletsCulled;
+        // the meshes and meshlets of the counts above hidden behind the occluders of RenderView::occlusion
+        unsigned int meshesOccluded;
+        unsigned int meshletsOccluded;
+        // hardware occlusion queries (RenderView::queries) issued this frame, and the results read back
+        unsigned int queriesIssued;
+        unsigned int queryResults;
+        unsigned int queryResultsVisible;
+
+        RenderStats() { Reset(); }
+
+        void Reset() {
+            meshesDrawn = 0;
+            meshesCulled = 0;
+            meshletsCulled = 0;
+            meshesOccluded = 0;
+            meshletsOccluded = 0;
+            queriesIssued = 0;
+            queryResults = 0;
+            queryResultsVisible = 0;
+        }
+    };
+
+    // Camera a model is drawn for, used to pick the levels of detail and to cull
+    struct RenderView
+    {
+        glm::mat4 view;
+        // perspective or orthographic
+        glm::mat4 projection;
+        // height of the render target in pixels
+        float viewportHeight;
+        // screen space error in pixels a level of detail may have, larger values pick coarser levels
+        float lodBias;
+        // clip planes of projection * view in world space (e.g. Camera::getFrustum)
+        Frustum frustum;
+        // also skip the meshlets facing away from the camera - only valid with GL_CULL_FACE on
+        bool coneCulling;
+        // occluders rendered for projection * view, the meshes and meshlets behind them are skipped. May be NULL
+        const OcclusionCuller* occlusion;
+        // cells seen by the camera (CellGraph::ComputeVisibleCells), the meshes of the others are skipped. May be NULL
+        const std::vector<unsigned char>* visibleCells;
+        // draws the meshes with coherent hardware occlusion queries (Draw only, not DrawDepth). May be NULL
+        OcclusionQueries* queries;
+        // DrawDepth keeps the draw commands of each slot between frames: one per shadow map the model is drawn into
+        unsigned int depthSlot;
+        // counters to add to, may be NULL
+        RenderStats* stats;
+
+        RenderView() : view(1.0f), projection(1.0f), viewportHeight(1.0f), lodBias(1.0f), coneCulling(false), occlusion(NULL), visibleCells(NULL), queries(NULL), depthSlot(0), stats(NULL) {}
+    };
+
     class Model3D
     {
 
     public:
+        Model3D();
         ~Model3D();
 
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
+		// Draws the full detail level of every mesh
 		void Draw(gps::Shader shaderProgram);
 
+		// Draws the meshes inside the view frustum, each at the coarsest level of detail whose error,
+		// projected for `view`, stays under view.lodBias pixels, and only the meshlets of that level
+		// inside the frustum. `modelMatrix` is the one the shader is using
+		void Draw(gps::Shader shaderProgram, const RenderView& view, const glm::mat4& modelMatrix = glm::mat4(1.0f));
+
+		// Stores the vertices in the compressed layout (gps::PackedVertex), must be called before LoadModel.
+		// The shaders drawing the model have to decode them (see shaderStart.vert)
+		void SetCompressedVertices(bool compressed);
+
+		// Draws only the geometry, without textures (for depth passes) - with one
+		// multi draw indirect call per geometry arena block when the driver supports it
+		void DrawDepth(gps::Shader shaderProgram);
+
+		// DrawDepth with the levels of detail picked as in Draw - shadow passes can pass a larger lodBias
+		void DrawDepth(gps::Shader shaderProgram, const RenderView& view, const glm::mat4& modelMatrix = glm::mat4(1.0f));
+
+		// Merges the nearby meshes that use the same textures into one mesh each, so the model takes
+		// one draw call per texture set and grid region. Only for static models: the vertices are moved by
+		// `modelMatrix`, so the model must then be drawn with an identity model matrix
+		void BuildStaticBatches(glm::mat4 modelMatrix = glm::mat4(1.0f));
+
+		// Places each mesh in a cell of `cells`, for RenderView::visibleCells. Called before
+		// BuildStaticBatches, the batches are then split by cell
+		void AssignCells(const CellGraph& cells);
+
+		// Meshes of the model, with their vertices and indices kept on the CPU
+		const std::vector<gps::Mesh>& GetMeshes() const;
+
+		// Draw binds a permutation of the shader for each material (Shader::getPermutation), and uniforms are
+		// per program. Appends the permutations of `shaderProgram` the materials use to `permutations`, those
+		// not listed yet: the caller sets the uniforms of the draw on each of them
+		void GetMaterialPermutations(gps::Shader shaderProgram, std::vector<gps::Shader>& permutations);
+
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
-		// Associated textures
-        std::vector<gps::Texture> loadedTextures;
+		// Associated textures by path - one reference in the texture registry for each distinct path
+        std::unordered_map<std::string, gps::Texture> loadedTextures;
+		// Decodes started by ReadTextureFromFile and not uploaded yet
+		std::shared_ptr<TextureDecodeBatch> decodeBatch;
+
+		// Layout of the vertices on the GPU, with the quantization bounds of the whole model
+		gps::VertexFormat vertexFormat;
+
+		// Uniforms used by the vertex shaders to decode compressed vertices
+		void SetVertexDecodingUniforms(gps::Shader shaderProgram);
+
+		// Bounding boxes of the meshes as centers and half extents, one array per coordinate for Frustum::TestBoxes
+		std::vector<float> boundsCenters[3];
+		std::vector<float> boundsExtents[3];
+		// Result of the frustum test of each mesh for the current draw
+		std::vector<unsigned char> meshVisible;
+		// Hierarchy over the mesh boxes: frustum culling of the models with many meshes, and the nodes of the occlusion queries
+		Bvh meshBvh;
+		std::vector<GLuint> visibleMeshIndices;
+
+		// Refills the bounds arrays, the BVH and the material variants after the meshes changed
+		void BuildBoundsArrays();
+
+		// Runs the culling and the level of detail selection below for a draw, without a view everything is drawn in full
+		void CullAndSelectLods(const RenderView* view, const glm::mat4& modelMatrix);
+
+		// Tests the mesh bounding boxes against the frustum (in model space) into meshVisible, through meshBvh for models with many meshes
+		void CullMeshes(const Frustum& frustum);
+
+		// Cell of each mesh, -1 outside the cells, empty without AssignCells
+		std::vector<int> meshCells;
+
+		// Clears meshVisible for the meshes in the cells the view cannot see
+		void CullHiddenCells(const RenderView& view);
+
+		// Clears meshVisible for the meshes hidden behind view.occlusion
+		void CullOccludedMeshes(const RenderView& view, const glm::mat4& modelMatrix);
+
+		// Level of detail of each mesh for the current draw
+		std::vector<size_t> selectedLods;
+
+		// Picks the level of each mesh into selectedLods, the full detail ones without a view
+		void SelectLods(const RenderView* view, const glm::mat4& modelMatrix);
+
+		// Index ranges drawn this frame: the meshlets of the selected level of each mesh that passed
+		// the culling, consecutive ones merged. Mesh i draws visibleRuns[runStarts[i]] up to runStarts[i + 1]
+		struct IndexRun {
+			// relative to the allocation of the mesh
+			GLuint firstIndex;
+			GLuint indexCount;
+
+			bool operator==(const IndexRun& other) const {
+				return firstIndex == other.firstIndex && indexCount == other.indexCount;
+			}
+		};
+		std::vector<IndexRun> visibleRuns;
+		std::vector<size_t> runStarts;
+
+		// Fills visibleRuns from the levels in selectedLods of the visible meshes, keeping every meshlet without a view
+		void CullMeshlets(const RenderView* view, const Frustum& frustum, const glm::mat4& modelMatrix);
+
+		// Arguments of glMultiDrawElementsBaseVertex, for the meshes drawn in several runs
+		std::vector<GLsizei> runCounts;
+		std::vector<GLvoid*> runOffsets;
+		std::vector<GLint> runBaseVertices;
+
+		void DrawVisibleRuns(gps::Shader shaderProgram);
+
+		// Material variant of each mesh: 1 with a specular map, 0 without
+		static const int MATERIAL_VARIANTS = 2;
+		std::vector<unsigned char> meshMaterialVariants;
+
+		// Permutation of a shader for each material variant, looked up once per shader
+		struct MaterialPermutations {
+			GLuint base;
+			gps::Shader variants[MATERIAL_VARIANTS];
+		};
+		std::vector<MaterialPermutations> materialPermutations;
+
+		MaterialPermutations& FindMaterialPermutations(gps::Shader shaderProgram);
+
+		// Textures, program and vertex array left bound by DrawMeshRuns
+		struct RunBindings {
+			const std::vector<gps::Texture>* textures;
+			const MaterialPermutations* permutations;
+			GLuint program;
+			int block;
+
+			RunBindings() : textures(NULL), permutations(NULL), program(0), block(-1) {}
+		};
+		// Draws the visible runs of one mesh
+		void DrawMeshRuns(gps::Shader shaderProgram, size_t meshIndex, RunBindings& bindings);
+		// Unbinds what the DrawMeshRuns calls left bound and binds `shaderProgram` again
+		void EndMeshRuns(gps::Shader shaderProgram, RunBindings& bindings);
+
+		// Query of each node of meshBvh for RenderView::queries, and the parent of each node
+		std::vector<NodeOcclusionQuery> nodeQueries;
+		std::vector<GLuint> nodeParents;
+		// Nodes with visible runs under them in the current draw
+		std::vector<unsigned char> nodeDrawn;
+		// Nodes the current draw stopped at as occluded, nearest first
+		std::vector<GLuint> terminationNodes;
+
+		// Updates the classification of the nodes whose query results are available, without waiting for the others
+		void ReadQueryResults(RenderStats* stats);
+		// DrawVisibleRuns with the hierarchical visible / occluded split of OcclusionQueries
+		void DrawWithQueries(gps::Shader shaderProgram, const RenderView& view, const glm::mat4& modelMatrix);
+		// Draws the visible runs of every mesh under a node of meshBvh
+		void DrawNodeRuns(gps::Shader shaderProgram, GLuint nodeIndex, RunBindings& bindings);
+		void DrawVisibleRunsDepth(gps::Shader shaderProgram, unsigned int depthSlot);
+
+		// Commands of DrawDepth, grouped by arena block
+		struct IndirectDrawRange {
+			int block;
+			GLenum indexType;
+			GLuint firstCommand;
+			GLsizei commandCount;
+		};
+		// The commands of a RenderView::depthSlot, so the views drawn every frame do not rewrite each other's
+		struct IndirectCommands {
+			GLuint buffer;
+			std::vector<IndirectDrawRange> draws;
+			// runs the commands in `buffer` draw
+			std::vector<IndexRun> runs;
+			std::vector<size_t> runStarts;
+
+			IndirectCommands() : buffer(0) {}
+		};
+		std::vector<IndirectCommands> indirectCommands;
+
+		// Rebuilds the indirect draw commands of a slot for the current visibleRuns
+		void BuildIndirectCommands(IndirectCommands& cache);
+
+		// Fills in the data structure from the binary cache of the .obj file, if it is up to date
+		bool ReadCache(std::string fileName, std::string basePath);
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
@@ -36,8 +272,11 @@ namespace gps {
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Queues the image file for decoding on the thread pool, the pixels go into the given texture
+		void ReadTextureFromFile(GLuint textureID, const char* file_name);
+
+		// Loads the pixel data of the queued textures into the video memory, as each decode finishes
+		void UploadDecodedTextures();
     };
 }
 
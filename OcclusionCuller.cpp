@@ -0,0 +1,277 @@
+#include "OcclusionCuller.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+namespace gps {
+
+	// vertex of an added occluder not used by any of its triangles yet
+	static const GLuint NO_VERTEX = ~0u;
+
+	OcclusionCuller::OcclusionCuller(int width, int height) : width((std::max(width, 4) + 3) & ~3), height(std::max(height, 1)), viewProjection(1.0f) {
+		int levelWidth = this->width;
+		int levelHeight = this->height;
+		for (;;) {
+			levels.push_back(std::vector<float>((size_t)levelWidth * levelHeight, 1.0f));
+			levelWidths.push_back(levelWidth);
+			levelHeights.push_back(levelHeight);
+			if (levelWidth == 1 && levelHeight == 1) {
+				break;
+			}
+			levelWidth = (levelWidth + 1) / 2;
+			levelHeight = (levelHeight + 1) / 2;
+		}
+	}
+
+	void OcclusionCuller::AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices) {
+		// only the vertices the triangles use are kept, Render transforms every one of them each frame
+		std::vector<GLuint> remap(positions.size(), NO_VERTEX);
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			for (int corner = 0; corner < 3; corner++) {
+				GLuint& vertex = remap[indices[i + corner]];
+				if (vertex == NO_VERTEX) {
+					vertex = (GLuint)occluderPositions.size();
+					occluderPositions.push_back(positions[indices[i + corner]]);
+				}
+				occluderIndices.push_back(vertex);
+			}
+		}
+	}
+
+	void OcclusionCuller::ClearOccluders() {
+		occluderPositions.clear();
+		occluderIndices.clear();
+	}
+
+	size_t OcclusionCuller::GetOccluderTriangleCount() const {
+		return occluderIndices.size() / 3;
+	}
+
+	size_t OcclusionCuller::GetOccluderVertexCount() const {
+		return occluderPositions.size();
+	}
+
+	int OcclusionCuller::GetWidth() const {
+		return width;
+	}
+
+	int OcclusionCuller::GetHeight() const {
+		return height;
+	}
+
+	const std::vector<float>& OcclusionCuller::GetDepthBuffer() const {
+		return levels[0];
+	}
+
+	void OcclusionCuller::Render(const glm::mat4& viewProjection) {
+		this->viewProjection = viewProjection;
+		std::fill(levels[0].begin(), levels[0].end(), 1.0f);
+
+		clipPositions.resize(occluderPositions.size());
+		for (size_t i = 0; i < occluderPositions.size(); i++) {
+			clipPositions[i] = viewProjection * glm::vec4(occluderPositions[i], 1.0f);
+		}
+		for (size_t i = 0; i < occluderIndices.size(); i += 3) {
+			DrawTriangle(clipPositions[occluderIndices[i]], clipPositions[occluderIndices[i + 1]], clipPositions[occluderIndices[i + 2]]);
+		}
+
+		BuildPyramid();
+	}
+
+	void OcclusionCuller::DrawTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2) {
+		// all three vertices outside the same side or far plane
+		for (int axis = 0; axis < 3; axis++) {
+			if (v0[axis] > v0.w && v1[axis] > v1.w && v2[axis] > v2.w) {
+				return;
+			}
+			if (axis < 2 && v0[axis] < -v0.w && v1[axis] < -v1.w && v2[axis] < -v2.w) {
+				return;
+			}
+		}
+
+		// signed distances to the near plane z = -w
+		const glm::vec4* vertices[3] = { &v0, &v1, &v2 };
+		float distances[3] = { v0.z + v0.w, v1.z + v1.w, v2.z + v2.w };
+		if (distances[0] >= 0.0f && distances[1] >= 0.0f && distances[2] >= 0.0f) {
+			RasterizeTriangle(v0, v1, v2);
+			return;
+		}
+
+		glm::vec4 clipped[4];
+		int clippedCount = 0;
+		for (int i = 0; i < 3; i++) {
+			int next = (i + 1) % 3;
+			if (distances[i] >= 0.0f) {
+				clipped[clippedCount++] = *vertices[i];
+			}
+			if ((distances[i] >= 0.0f) != (distances[next] >= 0.0f)) {
+				float t = distances[i] / (distances[i] - distances[next]);
+				clipped[clippedCount++] = *vertices[i] + (*vertices[next] - *vertices[i]) * t;
+			}
+		}
+		for (int i = 1; i + 1 < clippedCount; i++) {
+			RasterizeTriangle(clipped[0], clipped[i], clipped[i + 1]);
+		}
+	}
+
+	void OcclusionCuller::RasterizeTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2) {
+		if (v0.w <= 0.0f || v1.w <= 0.0f || v2.w <= 0.0f) {
+			return;
+		}
+
+		// pixel coordinates and depth in [0, 1]
+		glm::vec3 screen[3];
+		const glm::vec4* vertices[3] = { &v0, &v1, &v2 };
+		for (int i = 0; i < 3; i++) {
+			float inverseW = 1.0f / vertices[i]->w;
+			screen[i] = glm::vec3((vertices[i]->x * inverseW * 0.5f + 0.5f) * width,
+				(vertices[i]->y * inverseW * 0.5f + 0.5f) * height,
+				vertices[i]->z * inverseW * 0.5f + 0.5f);
+		}
+
+		// occluders are two sided, so the winding is made counter clockwise
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+		if (area < 0.0f) {
+			std::swap(screen[1], screen[2]);
+			area = -area;
+		}
+		if (area < 1e-6f) {
+			return;
+		}
+
+		int minX = std::max(0, (int)floorf(std::min(screen[0].x, std::min(screen[1].x, screen[2].x))));
+		int maxX = std::min(width - 1, (int)floorf(std::max(screen[0].x, std::max(screen[1].x, screen[2].x))));
+		int minY = std::max(0, (int)floorf(std::min(screen[0].y, std::min(screen[1].y, screen[2].y))));
+		int maxY = std::min(height - 1, (int)floorf(std::max(screen[0].y, std::max(screen[1].y, screen[2].y))));
+		if (minX > maxX || minY > maxY) {
+			return;
+		}
+
+		// edge function of the edge a -> b: stepX * x + stepY * y + offset, not negative inside the triangle.
+		// Edge i is the one opposite to vertex i, so its value over the area is the weight of that vertex
+		float stepX[3], stepY[3], offset[3];
+		for (int i = 0; i < 3; i++) {
+			const glm::vec3& a = screen[(i + 1) % 3];
+			const glm::vec3& b = screen[(i + 2) % 3];
+			stepX[i] = a.y - b.y;
+			stepY[i] = b.x - a.x;
+			offset[i] = -stepX[i] * a.x - stepY[i] * a.y;
+		}
+		float depthScale1 = (screen[1].z - screen[0].z) / area;
+		float depthScale2 = (screen[2].z - screen[0].z) / area;
+
+		// rows are walked from a multiple of 4, the buffer width is one too
+		int startX = minX & ~3;
+		for (int y = minY; y <= maxY; y++) {
+			float pixelY = y + 0.5f;
+			float rowOffset[3];
+			for (int i = 0; i < 3; i++) {
+				rowOffset[i] = stepY[i] * pixelY + offset[i];
+			}
+			float* row = &levels[0][(size_t)y * width];
+
+#ifdef OCCLUSION_SSE
+			__m128 zero = _mm_setzero_ps();
+			__m128 laneX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			__m128 depth0 = _mm_set1_ps(screen[0].z);
+			__m128 scale1 = _mm_set1_ps(depthScale1);
+			__m128 scale2 = _mm_set1_ps(depthScale2);
+			for (int x = startX; x <= maxX; x += 4) {
+				__m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), laneX);
+				__m128 edge0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(stepX[0]), pixelX), _mm_set1_ps(rowOffset[0]));
+				__m128 edge1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(stepX[1]), pixelX), _mm_set1_ps(rowOffset[1]));
+				__m128 edge2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(stepX[2]), pixelX), _mm_set1_ps(rowOffset[2]));
+				__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+				if (_mm_movemask_ps(inside) == 0) {
+					continue;
+				}
+
+				__m128 depth = _mm_add_ps(depth0, _mm_add_ps(_mm_mul_ps(edge1, scale1), _mm_mul_ps(edge2, scale2)));
+				__m128 stored = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(stored, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, stored)));
+			}
+#else
+			for (int x = startX; x <= maxX; x++) {
+				float pixelX = x + 0.5f;
+				float edge0 = stepX[0] * pixelX + rowOffset[0];
+				float edge1 = stepX[1] * pixelX + rowOffset[1];
+				float edge2 = stepX[2] * pixelX + rowOffset[2];
+				if (edge0 >= 0.0f && edge1 >= 0.0f && edge2 >= 0.0f) {
+					float depth = screen[0].z + edge1 * depthScale1 + edge2 * depthScale2;
+					row[x] = std::min(row[x], depth);
+				}
+			}
+#endif
+		}
+	}
+
+	void OcclusionCuller::BuildPyramid() {
+		for (size_t level = 1; level < levels.size(); level++) {
+			const std::vector<float>& source = levels[level - 1];
+			int sourceWidth = levelWidths[level - 1];
+			int sourceHeight = levelHeights[level - 1];
+			std::vector<float>& target = levels[level];
+			for (int y = 0; y < levelHeights[level]; y++) {
+				const float* row0 = &source[(size_t)(2 * y) * sourceWidth];
+				const float* row1 = &source[(size_t)std::min(2 * y + 1, sourceHeight - 1) * sourceWidth];
+				for (int x = 0; x < levelWidths[level]; x++) {
+					int x1 = std::min(2 * x + 1, sourceWidth - 1);
+					target[(size_t)y * levelWidths[level] + x] = std::max(std::max(row0[2 * x], row0[x1]), std::max(row1[2 * x], row1[x1]));
+				}
+			}
+		}
+	}
+
+	bool OcclusionCuller::IsBoxVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& modelMatrix) const {
+		glm::mat4 matrix = viewProjection * modelMatrix;
+
+		// screen rectangle and nearest depth of the corners
+		float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+		float minDepth = 1e30f;
+		for (int c = 0; c < 8; c++) {
+			glm::vec3 corner((c & 1) ? boundsMax.x : boundsMin.x, (c & 2) ? boundsMax.y : boundsMin.y, (c & 4) ? boundsMax.z : boundsMin.z);
+			glm::vec4 clip = matrix * glm::vec4(corner, 1.0f);
+			// crossing the near plane, the projection is unbounded
+			if (clip.w <= 0.0f || clip.z < -clip.w) {
+				return true;
+			}
+			float inverseW = 1.0f / clip.w;
+			float x = (clip.x * inverseW * 0.5f + 0.5f) * width;
+			float y = (clip.y * inverseW * 0.5f + 0.5f) * height;
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y);
+			minDepth = std::min(minDepth, clip.z * inverseW * 0.5f + 0.5f);
+		}
+		if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height) {
+			return false;
+		}
+
+		int x0 = (int)floorf(std::max(minX, 0.0f));
+		int y0 = (int)floorf(std::max(minY, 0.0f));
+		int x1 = std::min(width - 1, (int)floorf(maxX));
+		int y1 = std::min(height - 1, (int)floorf(maxY));
+
+		// the finest level where the rectangle spans at most 2x2 texels
+		size_t level = 0;
+		while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+			level++;
+		}
+
+		for (int y = y0 >> level; y <= y1 >> level; y++) {
+			for (int x = x0 >> level; x <= x1 >> level; x++) {
+				if (levels[level][(size_t)y * levelWidths[level] + x] >= minDepth) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef OcclusionCuller_hpp
+#define OcclusionCuller_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Software occlusion culling: a few large occluder triangles (walls, floors) are rasterized on
+    // the CPU into a small depth buffer, four pixels at a time with SSE, and a hierarchical-Z pyramid
+    // of its farthest depths is built. Boxes are then tested against the pyramid level where
+    // their screen rectangle covers at most 2x2 texels. Coverage and depth are sampled at the pixel
+    // centers like on the GPU, so what shows by less than a pixel of this buffer around an occluder
+    // may be culled. Needs no GL context
+    class OcclusionCuller
+    {
+    public:
+        // Size of the depth buffer, the width is rounded up to a multiple of 4
+        OcclusionCuller(int width = 256, int height = 128);
+
+        // Adds world space triangles to the occluders drawn by every Render, with only the positions they use
+        void AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices);
+        void ClearOccluders();
+        size_t GetOccluderTriangleCount() const;
+        size_t GetOccluderVertexCount() const;
+
+        // Rasterizes the occluders as seen through viewProjection and builds the pyramid
+        void Render(const glm::mat4& viewProjection);
+
+        // False if the box, in the space of modelMatrix, is completely hidden behind the occluders
+        // or completely off screen for the last Render
+        bool IsBoxVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+                          const glm::mat4& modelMatrix = glm::mat4(1.0f)) const;
+
+        int GetWidth() const;
+        int GetHeight() const;
+        // Depths in [0, 1] of the rasterized occluders, rows from the bottom of the screen, 1 where none is
+        const std::vector<float>& GetDepthBuffer() const;
+
+    private:
+        int width;
+        int height;
+        glm::mat4 viewProjection;
+
+        std::vector<glm::vec3> occluderPositions;
+        std::vector<GLuint> occluderIndices;
+        // occluder vertices in clip space, refilled by Render
+        std::vector<glm::vec4> clipPositions;
+
+        // level 0 is the depth buffer, every next level keeps the farthest depth of 2x2 texels
+        std::vector<std::vector<float> > levels;
+        std::vector<int> levelWidths;
+        std::vector<int> levelHeights;
+
+        // Clips a triangle against the near plane and rasterizes what is left
+        void DrawTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+        // Triangle already in front of the near plane
+        void RasterizeTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+        void BuildPyramid();
+    };
+}
+
+#endif /* OcclusionCuller_hpp */
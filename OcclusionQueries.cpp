@@ -0,0 +1,78 @@
+#include "OcclusionQueries.hpp"
+
+#include "glm/gtc/type_ptr.hpp"
+
+namespace gps {
+
+	// frames between two queries of a node that stays visible
+	static const unsigned int VISIBLE_QUERY_INTERVAL = 8;
+
+	OcclusionQueries::OcclusionQueries() : boxVAO(0), boxVBO(0), boxEBO(0), queryTarget(GL_ANY_SAMPLES_PASSED), frame(0) {
+	}
+
+	void OcclusionQueries::Init(gps::Shader boxShader) {
+		this->boxShader = boxShader;
+		queryTarget = GLEW_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+
+		// unit cube, scaled and moved onto each box by boxMatrix
+		GLfloat corners[] = {
+			0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  0.0f, 1.0f, 1.0f,  1.0f, 1.0f, 1.0f
+		};
+		GLubyte faces[] = {
+			0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,
+			0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+			0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5
+		};
+
+		glGenVertexArrays(1, &boxVAO);
+		glGenBuffers(1, &boxVBO);
+		glGenBuffers(1, &boxEBO);
+		glBindVertexArray(boxVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+		glBindVertexArray(0);
+	}
+
+	void OcclusionQueries::BeginFrame() {
+		frame++;
+	}
+
+	bool OcclusionQueries::IsVisibleQueryDue(size_t nodeIndex) const {
+		return (frame + nodeIndex) % VISIBLE_QUERY_INTERVAL == 0;
+	}
+
+	GLenum OcclusionQueries::GetQueryTarget() const {
+		return queryTarget;
+	}
+
+	void OcclusionQueries::BeginBoxes() {
+		boxShader.useShaderProgram();
+		glBindVertexArray(boxVAO);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+	}
+
+	void OcclusionQueries::DrawBox(const glm::mat4& modelViewProjection, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+		glm::mat4 boxMatrix(1.0f);
+		glm::vec3 size = boundsMax - boundsMin;
+		boxMatrix[0][0] = size.x;
+		boxMatrix[1][1] = size.y;
+		boxMatrix[2][2] = size.z;
+		boxMatrix[3] = glm::vec4(boundsMin, 1.0f);
+		boxMatrix = modelViewProjection * boxMatrix;
+
+		glUniformMatrix4fv(glGetUniformLocation(boxShader.shaderProgram, "boxMatrix"), 1, GL_FALSE, glm::value_ptr(boxMatrix));
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (GLvoid*)0);
+	}
+
+	void OcclusionQueries::EndBoxes() {
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_TRUE);
+		glBindVertexArray(0);
+	}
+}
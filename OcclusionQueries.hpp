@@ -0,0 +1,67 @@
+#ifndef OcclusionQueries_hpp
+#define OcclusionQueries_hpp
+
+#include "Shader.hpp"
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    // Occlusion query of one node of the mesh hierarchy of a model, kept from frame to frame by the model
+    struct NodeOcclusionQuery
+    {
+        GLuint query;
+        // classification from the last result read back, or pulled up from a visible child
+        bool visible;
+        // issued and not read back yet
+        bool pending;
+        // pushed down from a parent found visible: a leaf is queried on its next draw even if not due
+        bool queryNext;
+
+        NodeOcclusionQuery() : query(0), visible(true), pending(false), queryNext(false) {}
+    };
+
+    // Shared state of the coherent hierarchical culling pass (CHC++, Mattausch et al.) of the camera view.
+    // Each model walks the BVH over its meshes front to back. Visible leaves are drawn right away and
+    // checked again every few frames with a query around their own draw. The walk stops at nodes found
+    // occluded: they get a query on their bounding box, batched after the visible draws, and their whole
+    // subtree is drawn under conditional rendering of that query. A visible result marks the ancestors
+    // visible, and the children of a node that turns visible are queried on their own the next frame; a
+    // node whose children are all occluded is queried as a whole again. Results are only read once
+    // available, in a later frame, so the CPU never waits for the GPU
+    class OcclusionQueries
+    {
+    public:
+        OcclusionQueries();
+
+        // Creates the box geometry; `boxShader` draws positions with the "boxMatrix" uniform (shaders/occlusionBox.*)
+        void Init(gps::Shader boxShader);
+
+        // Starts a frame, called once before the models are drawn
+        void BeginFrame();
+
+        // Whether a visible node is queried again this frame - spread over the frames by node index
+        bool IsVisibleQueryDue(size_t nodeIndex) const;
+
+        // Query target: conservative sample counting when the driver has it
+        GLenum GetQueryTarget() const;
+
+        // Binds the box shader and geometry, with color and depth writes off
+        void BeginBoxes();
+        // Draws the box [boundsMin, boundsMax] of a model drawn with `modelViewProjection`
+        void DrawBox(const glm::mat4& modelViewProjection, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+        // Restores the writes, the shader of the model has to be bound again
+        void EndBoxes();
+
+    private:
+        gps::Shader boxShader;
+        GLuint boxVAO;
+        GLuint boxVBO;
+        GLuint boxEBO;
+        GLenum queryTarget;
+        unsigned int frame;
+    };
+}
+
+#endif /* OcclusionQueries_hpp */
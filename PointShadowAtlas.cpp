@@ -0,0 +1,400 @@
+#include "PointShadowAtlas.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+	static const float NEAR_PLANE = 0.05f;
+
+	// +X, -X, +Y, -Y, +Z, -Z - the fragment shader picks the face from the major axis
+	static const glm::vec3 FACE_DIRECTIONS[6] = {
+		glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+	};
+	static const glm::vec3 FACE_UPS[6] = {
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+	};
+
+	// the even bits of a Morton code
+	static int CompactBits(unsigned int v) {
+		v &= 0x55555555;
+		v = (v | (v >> 1)) & 0x33333333;
+		v = (v | (v >> 2)) & 0x0F0F0F0F;
+		v = (v | (v >> 4)) & 0x00FF00FF;
+		v = (v | (v >> 8)) & 0x0000FFFF;
+		return (int)v;
+	}
+
+	static bool IsLargerTile(const PointShadowFace* a, const PointShadowFace* b) {
+		return a->size > b->size;
+	}
+
+	// The face is widened so that the 90 degrees of the cube end a texel inside the tile,
+	// the 2x2 filtering at its edges does not read the neighbouring tiles
+	static float FaceSpread(int size) {
+		return (float)size / (size - 2);
+	}
+
+	PointShadowAtlas::PointShadowAtlas() : atlasSize(0), minTileSize(0), maxTileSize(0), framebuffer(0), texture(0),
+		staticFramebuffer(0), staticTexture(0), activeFaces(0), staticRedraws(0) {
+		for (int l = 0; l < MAX_LIGHTS; l++) {
+			lights[l].enabled = false;
+			lights[l].position = glm::vec3(0.0f);
+			lights[l].range = 0.0f;
+			lights[l].importance = 1.0f;
+			for (int f = 0; f < FACE_COUNT; f++) {
+				PointShadowFace& face = faces[l][f];
+				face.active = false;
+				face.x = face.y = face.size = 0;
+				face.view = face.projection = glm::mat4(1.0f);
+				face.staticValid = false;
+				face.staticPosition = glm::vec3(0.0f);
+				face.staticRange = 0.0f;
+				face.staticX = face.staticY = face.staticSize = 0;
+			}
+		}
+	}
+
+	// 24 bit depth texture of size x size and a framebuffer drawing into it
+	static void CreateDepthTarget(int size, GLuint& texture, GLuint& framebuffer) {
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		if (GLEW_ARB_texture_storage) {
+			glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size, size);
+		}
+		else {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void PointShadowAtlas::Init(int atlasSize, int minTileSize, int maxTileSize) {
+		this->atlasSize = atlasSize;
+		this->minTileSize = minTileSize;
+		this->maxTileSize = std::min(maxTileSize, atlasSize);
+
+		CreateDepthTarget(atlasSize, texture, framebuffer);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		// linear filtering of the comparison results gives 2x2 percentage closer filtering
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		// the static casters of each face, copied into its tile every frame
+		CreateDepthTarget(atlasSize, staticTexture, staticFramebuffer);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		int gridSize = atlasSize / minTileSize;
+		staticOwners.assign(gridSize * gridSize, -1);
+	}
+
+	void PointShadowAtlas::SetLight(int index, const glm::vec3& position, float range, float importance) {
+		lights[index].enabled = true;
+		lights[index].position = position;
+		lights[index].range = range;
+		lights[index].importance = importance;
+	}
+
+	void PointShadowAtlas::DisableLight(int index) {
+		lights[index].enabled = false;
+		for (int f = 0; f < FACE_COUNT; f++) {
+			faces[index][f].staticValid = false;
+		}
+	}
+
+	// Whether the two boxes overlap
+	static bool BoxesOverlap(const glm::vec3& aMin, const glm::vec3& aMax, const glm::vec3& bMin, const glm::vec3& bMax) {
+		return aMin.x <= bMax.x && bMin.x <= aMax.x && aMin.y <= bMax.y && bMin.y <= aMax.y && aMin.z <= bMax.z && bMin.z <= aMax.z;
+	}
+
+	void PointShadowAtlas::Update(const Frustum& cameraFrustum, const glm::vec3& cameraPosition, const glm::mat4& cameraProjection,
+		const CellGraph* cells, const std::vector<unsigned char>* visibleCells) {
+		staticRedraws = 0;
+		float tanHalfY = 1.0f / cameraProjection[1][1];
+		// the widest a face gets, for the smallest tiles
+		float spread = FaceSpread(minTileSize);
+
+		for (int l = 0; l < MAX_LIGHTS; l++) {
+			const Light& light = lights[l];
+			for (int f = 0; f < FACE_COUNT; f++) {
+				faces[l][f].active = false;
+			}
+			if (!light.enabled || !cameraFrustum.IntersectsSphere(light.position, light.range)) {
+				continue;
+			}
+
+			// fraction of the screen height covered by the range of the light
+			float distance = glm::length(light.position - cameraPosition);
+			float coverage = distance <= light.range ? 1.0f : light.range / (distance * tanHalfY);
+			coverage = std::min(coverage * light.importance, 1.0f);
+			int size = minTileSize;
+			while (size < maxTileSize && size < coverage * maxTileSize) {
+				size *= 2;
+			}
+
+			// the shadows only fall in the cells the light reaches, the camera has to see one of them
+			bool cellCulling = cells && visibleCells && !cells->IsEmpty() && visibleCells->size() == cells->GetCellCount();
+			if (cellCulling) {
+				cells->ComputeLitCells(light.position, light.range, litCells);
+			}
+
+			for (int f = 0; f < FACE_COUNT; f++) {
+				// box around the pyramid the face sees, up to the range
+				glm::vec3 direction = FACE_DIRECTIONS[f];
+				glm::vec3 side1 = FACE_DIRECTIONS[(f / 2 * 2 + 2) % 6];
+				glm::vec3 side2 = FACE_DIRECTIONS[(f / 2 * 2 + 4) % 6];
+				glm::vec3 boxMin = light.position;
+				glm::vec3 boxMax = light.position;
+				for (int c = 0; c < 4; c++) {
+					glm::vec3 corner = light.position + light.range * (direction +
+						spread * ((c & 1) ? side1 : -side1) + spread * ((c & 2) ? side2 : -side2));
+					boxMin = glm::min(boxMin, corner);
+					boxMax = glm::max(boxMax, corner);
+				}
+				if (!cameraFrustum.IntersectsBox(boxMin, boxMax)) {
+					continue;
+				}
+				if (cellCulling) {
+					bool seen = false;
+					for (size_t c = 0; c < litCells.size() && !seen; c++) {
+						const Cell& cell = cells->GetCell(c);
+						seen = litCells[c] && (*visibleCells)[c] && BoxesOverlap(boxMin, boxMax, cell.boundsMin, cell.boundsMax);
+					}
+					if (!seen) {
+						continue;
+					}
+				}
+				PointShadowFace& face = faces[l][f];
+				face.active = true;
+				face.size = size;
+				face.view = glm::lookAt(light.position, light.position + direction, FACE_UPS[f]);
+			}
+		}
+
+		PackTiles();
+
+		activeFaces = 0;
+		for (int l = 0; l < MAX_LIGHTS; l++) {
+			for (int f = 0; f < FACE_COUNT; f++) {
+				PointShadowFace& face = faces[l][f];
+				if (face.active) {
+					face.projection = glm::perspective(2.0f * atanf(FaceSpread(face.size)), 1.0f, NEAR_PLANE, lights[l].range);
+					activeFaces++;
+				}
+				else {
+					// its tile may be handed to another face before it comes back
+					face.staticValid = false;
+				}
+			}
+		}
+	}
+
+	void PointShadowAtlas::PackTiles() {
+		std::vector<PointShadowFace*> tiles;
+		for (int l = 0; l < MAX_LIGHTS; l++) {
+			for (int f = 0; f < FACE_COUNT; f++) {
+				if (faces[l][f].active) {
+					tiles.push_back(&faces[l][f]);
+				}
+			}
+		}
+		// the atlas is a grid of the smallest tiles, filled along a Morton curve: with the larger tiles
+		// first, every tile starts at a multiple of its own area and so stays aligned to its size
+		int gridSize = atlasSize / minTileSize;
+		unsigned int gridCells = (unsigned int)(gridSize * gridSize);
+		std::stable_sort(tiles.begin(), tiles.end(), IsLargerTile);
+		for (;;) {
+			unsigned int cursor = 0;
+			size_t placed = 0;
+			for (; placed < tiles.size(); placed++) {
+				unsigned int side = (unsigned int)(tiles[placed]->size / minTileSize);
+				if (cursor + side * side > gridCells) {
+					break;
+				}
+				tiles[placed]->x = CompactBits(cursor) * minTileSize;
+				tiles[placed]->y = CompactBits(cursor >> 1) * minTileSize;
+				cursor += side * side;
+			}
+			if (placed == tiles.size()) {
+				return;
+			}
+
+			// halve the tiles and try again, the faces that still do not fit at the smallest size get no shadows
+			bool shrunk = false;
+			for (size_t t = 0; t < tiles.size(); t++) {
+				if (tiles[t]->size > minTileSize) {
+					tiles[t]->size /= 2;
+					shrunk = true;
+				}
+			}
+			if (!shrunk) {
+				for (; placed < tiles.size(); placed++) {
+					tiles[placed]->active = false;
+				}
+				return;
+			}
+		}
+	}
+
+	const PointShadowFace& PointShadowAtlas::GetFace(int light, int face) const {
+		return faces[light][face];
+	}
+
+	int PointShadowAtlas::GetActiveFaceCount() const {
+		return activeFaces;
+	}
+
+	size_t PointShadowAtlas::GetMemorySize() const {
+		// 24 bit depth is stored in 32 bits, the cache of the static casters is as large again
+		return (size_t)atlasSize * atlasSize * 4 * 2;
+	}
+
+	void PointShadowAtlas::BindTile(GLuint target, const PointShadowFace& tile) {
+		glBindFramebuffer(GL_FRAMEBUFFER, target);
+		glViewport(tile.x, tile.y, tile.size, tile.size);
+		// the clears and the draws stay inside the tile
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(tile.x, tile.y, tile.size, tile.size);
+	}
+
+	bool PointShadowAtlas::BeginStaticFace(int light, int face) {
+		PointShadowFace& tile = faces[light][face];
+		const Light& source = lights[light];
+		if (tile.staticValid && tile.staticPosition == source.position && tile.staticRange == source.range &&
+			tile.staticX == tile.x && tile.staticY == tile.y && tile.staticSize == tile.size) {
+			return false;
+		}
+		ClaimStaticTile(light, face);
+		tile.staticValid = true;
+		tile.staticPosition = source.position;
+		tile.staticRange = source.range;
+		tile.staticX = tile.x;
+		tile.staticY = tile.y;
+		tile.staticSize = tile.size;
+		staticRedraws++;
+
+		BindTile(staticFramebuffer, tile);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		return true;
+	}
+
+	void PointShadowAtlas::ClaimStaticTile(int light, int face) {
+		const PointShadowFace& tile = faces[light][face];
+		int owner = light * FACE_COUNT + face;
+		int gridSize = atlasSize / minTileSize;
+
+		// the cells of the previous tile of the face are free again
+		if (tile.staticSize > 0) {
+			for (int y = tile.staticY / minTileSize; y < (tile.staticY + tile.staticSize) / minTileSize; y++) {
+				for (int x = tile.staticX / minTileSize; x < (tile.staticX + tile.staticSize) / minTileSize; x++) {
+					if (staticOwners[y * gridSize + x] == owner) {
+						staticOwners[y * gridSize + x] = -1;
+					}
+				}
+			}
+		}
+
+		for (int y = tile.y / minTileSize; y < (tile.y + tile.size) / minTileSize; y++) {
+			for (int x = tile.x / minTileSize; x < (tile.x + tile.size) / minTileSize; x++) {
+				int previous = staticOwners[y * gridSize + x];
+				if (previous >= 0 && previous != owner) {
+					faces[previous / FACE_COUNT][previous % FACE_COUNT].staticValid = false;
+				}
+				staticOwners[y * gridSize + x] = owner;
+			}
+		}
+	}
+
+	void PointShadowAtlas::BeginFace(int light, int face) {
+		const PointShadowFace& tile = faces[light][face];
+		BindTile(framebuffer, tile);
+		if (!tile.staticValid) {
+			glClear(GL_DEPTH_BUFFER_BIT);
+			return;
+		}
+		// ARB_copy_image (core in 4.3) copies the tile directly, otherwise it is blitted between the framebuffers
+		if (GLEW_ARB_copy_image) {
+			glCopyImageSubData(staticTexture, GL_TEXTURE_2D, 0, tile.x, tile.y, 0,
+				texture, GL_TEXTURE_2D, 0, tile.x, tile.y, 0, tile.size, tile.size, 1);
+		}
+		else {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+			glBlitFramebuffer(tile.x, tile.y, tile.x + tile.size, tile.y + tile.size,
+				tile.x, tile.y, tile.x + tile.size, tile.y + tile.size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		}
+	}
+
+	void PointShadowAtlas::EndFaces() {
+		glDisable(GL_SCISSOR_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void PointShadowAtlas::InvalidateStaticCache() {
+		for (int l = 0; l < MAX_LIGHTS; l++) {
+			for (int f = 0; f < FACE_COUNT; f++) {
+				faces[l][f].staticValid = false;
+			}
+		}
+	}
+
+	int PointShadowAtlas::GetStaticRedrawCount() const {
+		return staticRedraws;
+	}
+
+	void PointShadowAtlas::SetUniforms(gps::Shader shader, GLint textureUnit) const {
+		glActiveTexture(GL_TEXTURE0 + textureUnit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "pointShadowAtlas"), textureUnit);
+
+		for (int l = 0; l < MAX_LIGHTS; l++) {
+			// w scales the normal offset: a texel and a half of the tile, per unit of distance to the light
+			float normalOffset = 0.0f;
+			// bit f set for the faces with a tile, the matrices of the others are left from older frames
+			int faceMask = 0;
+			for (int f = 0; f < FACE_COUNT; f++) {
+				const PointShadowFace& face = faces[l][f];
+				if (!face.active) {
+					continue;
+				}
+				faceMask |= 1 << f;
+				normalOffset = std::max(normalOffset, 1.5f * 2.0f * FaceSpread(face.size) / face.size);
+
+				// from clip space of the face to its tile of the atlas
+				float scale = 0.5f * face.size / atlasSize;
+				glm::mat4 tileMatrix(1.0f);
+				tileMatrix[0][0] = scale;
+				tileMatrix[1][1] = scale;
+				tileMatrix[2][2] = 0.5f;
+				tileMatrix[3] = glm::vec4((face.x + 0.5f * face.size) / atlasSize, (face.y + 0.5f * face.size) / atlasSize, 0.5f, 1.0f);
+				std::string name = "pointShadowMatrices[" + std::to_string(l * FACE_COUNT + f) + "]";
+				glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, name.c_str()), 1, GL_FALSE,
+					glm::value_ptr(tileMatrix * face.projection * face.view));
+			}
+			std::string name = "pointShadowLights[" + std::to_string(l) + "]";
+			glm::vec4 light(lights[l].position, normalOffset);
+			glUniform4fv(glGetUniformLocation(shader.shaderProgram, name.c_str()), 1, glm::value_ptr(light));
+			name = "pointShadowFaceMasks[" + std::to_string(l) + "]";
+			glUniform1i(glGetUniformLocation(shader.shaderProgram, name.c_str()), faceMask);
+		}
+	}
+}
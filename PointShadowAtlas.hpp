@@ -0,0 +1,118 @@
+#ifndef PointShadowAtlas_hpp
+#define PointShadowAtlas_hpp
+
+#include "CellGraph.hpp"
+#include "Frustum.hpp"
+#include "Shader.hpp"
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // A face of the cube a point light casts its shadows through, and its tile of the atlas
+    struct PointShadowFace
+    {
+        // false when the face sees nothing the camera sees, or the atlas is full
+        bool active;
+        // tile in atlas texels
+        int x;
+        int y;
+        int size;
+        glm::mat4 view;
+        glm::mat4 projection;
+        // the cached static casters were drawn for this tile and light
+        bool staticValid;
+        glm::vec3 staticPosition;
+        float staticRange;
+        int staticX;
+        int staticY;
+        int staticSize;
+    };
+
+    // Shadows of the point lights, all the cube faces share one depth texture. Each light gets square
+    // tiles sized by how much of the screen its range covers times its importance, the faces the
+    // camera cannot see get none, and everything is drawn through one framebuffer by moving the
+    // viewport. Like the sun's cascades the static casters are cached, in a second atlas that is only
+    // redrawn for a face when its light or its tile changed
+    class PointShadowAtlas
+    {
+    public:
+        // lightPos1..3 in shaderStart.frag
+        static const int MAX_LIGHTS = 3;
+        static const int FACE_COUNT = 6;
+
+        PointShadowAtlas();
+
+        // Square atlas of 24 bit depth, tiles are powers of two between minTileSize and maxTileSize
+        void Init(int atlasSize, int minTileSize, int maxTileSize);
+
+        // Light `index` casts shadows up to `range`, importance scales the size of its tiles
+        void SetLight(int index, const glm::vec3& position, float range, float importance);
+        void DisableLight(int index);
+
+        // Sizes the tiles from the screen coverage of the lights, culls the faces against the camera and packs the atlas.
+        // With `cells`, a face also needs a cell its light reaches through the portals that is in `visibleCells`
+        void Update(const Frustum& cameraFrustum, const glm::vec3& cameraPosition, const glm::mat4& cameraProjection,
+                    const CellGraph* cells = NULL, const std::vector<unsigned char>* visibleCells = NULL);
+
+        const PointShadowFace& GetFace(int light, int face) const;
+        int GetActiveFaceCount() const;
+        size_t GetMemorySize() const;
+
+        // Returns false when the cached static casters of the face are still valid. Otherwise binds the
+        // tile of the cache as the depth target and clears it: the static casters are drawn next
+        bool BeginStaticFace(int light, int face);
+        // Binds the tile of the face as the depth target and fills it with the cached static casters:
+        // the moving casters are drawn next
+        void BeginFace(int light, int face);
+        // Back to the default framebuffer
+        void EndFaces();
+        // Forces the static casters to be redrawn, after they changed
+        void InvalidateStaticCache();
+        // Number of faces whose cache was redrawn since the last Update
+        int GetStaticRedrawCount() const;
+
+        // Binds the atlas to `textureUnit` and sets the uniforms read by computePointShadow in shaderStart.frag,
+        // the faces without a tile this frame are flagged so they are not sampled
+        void SetUniforms(gps::Shader shader, GLint textureUnit) const;
+
+    private:
+        struct Light
+        {
+            bool enabled;
+            glm::vec3 position;
+            float range;
+            float importance;
+        };
+
+        int atlasSize;
+        int minTileSize;
+        int maxTileSize;
+        GLuint framebuffer;
+        GLuint texture;
+        GLuint staticFramebuffer;
+        GLuint staticTexture;
+
+        Light lights[MAX_LIGHTS];
+        PointShadowFace faces[MAX_LIGHTS][FACE_COUNT];
+        int activeFaces;
+        int staticRedraws;
+        // cells reached by the light being updated
+        std::vector<unsigned char> litCells;
+        // face (light * FACE_COUNT + face) whose static casters are cached in each cell of the grid of
+        // the smallest tiles, -1 for none: a face drawing over another one's cache invalidates it
+        std::vector<int> staticOwners;
+
+        // Packs the active faces, halving the tiles while they do not fit
+        void PackTiles();
+        // Binds `tile` of the framebuffer as the viewport and the scissor box
+        void BindTile(GLuint target, const PointShadowFace& tile);
+        // Records `face` as the owner of the cells of its tile in the static cache, invalidating the faces it overwrites
+        void ClaimStaticTile(int light, int face);
+    };
+}
+
+#endif /* PointShadowAtlas_hpp */
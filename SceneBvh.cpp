@@ -0,0 +1,158 @@
+#include "SceneBvh.hpp"
+
+#include <cmath>
+
+namespace gps {
+
+	SceneBvh::SceneBvh() : modelCount(0) {
+	}
+
+	GLuint SceneBvh::AddModel(const Model3D& model, const glm::mat4& modelMatrix) {
+		const std::vector<gps::Mesh>& modelMeshes = model.GetMeshes();
+		for (size_t m = 0; m < modelMeshes.size(); m++) {
+			const gps::Mesh& mesh = modelMeshes[m];
+			if (mesh.lods.empty() || mesh.lods[0].indexCount == 0) {
+				continue;
+			}
+
+			SceneMesh sceneMesh;
+			sceneMesh.model = modelCount;
+			sceneMesh.mesh = (GLuint)m;
+			sceneMesh.positions.reserve(mesh.vertices.size());
+			for (size_t i = 0; i < mesh.vertices.size(); i++) {
+				sceneMesh.positions.push_back(glm::vec3(modelMatrix * glm::vec4(mesh.vertices[i].Position, 1.0f)));
+			}
+			sceneMesh.indices.assign(mesh.indices.begin() + mesh.lods[0].firstIndex,
+				mesh.indices.begin() + mesh.lods[0].firstIndex + mesh.lods[0].indexCount);
+
+			sceneMesh.boundsMin = sceneMesh.positions[sceneMesh.indices[0]];
+			sceneMesh.boundsMax = sceneMesh.boundsMin;
+			for (size_t i = 1; i < sceneMesh.indices.size(); i++) {
+				sceneMesh.boundsMin = glm::min(sceneMesh.boundsMin, sceneMesh.positions[sceneMesh.indices[i]]);
+				sceneMesh.boundsMax = glm::max(sceneMesh.boundsMax, sceneMesh.positions[sceneMesh.indices[i]]);
+			}
+			meshes.push_back(sceneMesh);
+		}
+		return modelCount++;
+	}
+
+	void SceneBvh::Build() {
+		std::vector<glm::vec3> boundsMin, boundsMax;
+		for (size_t m = 0; m < meshes.size(); m++) {
+			SceneMesh& mesh = meshes[m];
+			size_t triangleCount = mesh.indices.size() / 3;
+			std::vector<glm::vec3> triangleMin(triangleCount), triangleMax(triangleCount);
+			for (size_t t = 0; t < triangleCount; t++) {
+				const glm::vec3& v0 = mesh.positions[mesh.indices[t * 3]];
+				const glm::vec3& v1 = mesh.positions[mesh.indices[t * 3 + 1]];
+				const glm::vec3& v2 = mesh.positions[mesh.indices[t * 3 + 2]];
+				triangleMin[t] = glm::min(v0, glm::min(v1, v2));
+				triangleMax[t] = glm::max(v0, glm::max(v1, v2));
+			}
+			mesh.triangleBvh.Build(triangleMin, triangleMax);
+
+			boundsMin.push_back(mesh.boundsMin);
+			boundsMax.push_back(mesh.boundsMax);
+		}
+		meshBvh.Build(boundsMin, boundsMax);
+	}
+
+	void SceneBvh::QueryFrustum(const Frustum& frustum, std::vector<SceneMeshRef>& result) const {
+		std::vector<GLuint> found;
+		meshBvh.QueryFrustum(frustum, found);
+		for (size_t i = 0; i < found.size(); i++) {
+			SceneMeshRef ref;
+			ref.model = meshes[found[i]].model;
+			ref.mesh = meshes[found[i]].mesh;
+			result.push_back(ref);
+		}
+	}
+
+	void SceneBvh::QueryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<SceneTriangleRef>& result) const {
+		std::vector<GLuint> foundMeshes, foundTriangles;
+		meshBvh.QueryBox(boundsMin, boundsMax, foundMeshes);
+		for (size_t i = 0; i < foundMeshes.size(); i++) {
+			const SceneMesh& mesh = meshes[foundMeshes[i]];
+			foundTriangles.clear();
+			mesh.triangleBvh.QueryBox(boundsMin, boundsMax, foundTriangles);
+			for (size_t t = 0; t < foundTriangles.size(); t++) {
+				SceneTriangleRef ref;
+				ref.model = mesh.model;
+				ref.mesh = mesh.mesh;
+				ref.triangle = foundTriangles[t];
+				result.push_back(ref);
+			}
+		}
+	}
+
+	bool SceneBvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit* hit) const {
+		const float missDistance = maxDistance;
+		GLuint hitMesh = 0, hitTriangle = 0;
+
+		auto intersectMesh = [&](GLuint meshIndex, float meshMaxDistance) {
+			const SceneMesh& mesh = meshes[meshIndex];
+			auto intersectTriangle = [&](GLuint triangle, float triangleMaxDistance) {
+				float distance = IntersectTriangle(origin, direction, mesh.positions[mesh.indices[triangle * 3]],
+					mesh.positions[mesh.indices[triangle * 3 + 1]], mesh.positions[mesh.indices[triangle * 3 + 2]], triangleMaxDistance);
+				if (distance < triangleMaxDistance) {
+					hitMesh = meshIndex;
+					hitTriangle = triangle;
+				}
+				return distance;
+			};
+			return mesh.triangleBvh.Raycast(origin, direction, meshMaxDistance, intersectTriangle);
+		};
+		maxDistance = meshBvh.Raycast(origin, direction, maxDistance, intersectMesh);
+
+		if (maxDistance >= missDistance) {
+			return false;
+		}
+		hit->distance = maxDistance;
+		hit->model = meshes[hitMesh].model;
+		hit->mesh = meshes[hitMesh].mesh;
+		hit->triangle = hitTriangle;
+		return true;
+	}
+
+	size_t SceneBvh::GetNodeCount() const {
+		size_t nodeCount = meshBvh.GetNodes().size();
+		for (size_t m = 0; m < meshes.size(); m++) {
+			nodeCount += meshes[m].triangleBvh.GetNodes().size();
+		}
+		return nodeCount;
+	}
+
+	size_t SceneBvh::GetTriangleCount() const {
+		size_t triangleCount = 0;
+		for (size_t m = 0; m < meshes.size(); m++) {
+			triangleCount += meshes[m].indices.size() / 3;
+		}
+		return triangleCount;
+	}
+
+	float SceneBvh::IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+		const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float maxDistance) {
+		glm::vec3 edge1 = v1 - v0;
+		glm::vec3 edge2 = v2 - v0;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		// ray parallel to the triangle, front and back faces are both hit otherwise
+		if (fabsf(determinant) < 1e-12f) {
+			return maxDistance;
+		}
+		float inverseDeterminant = 1.0f / determinant;
+
+		glm::vec3 s = origin - v0;
+		float u = glm::dot(s, p) * inverseDeterminant;
+		if (u < 0.0f || u > 1.0f) {
+			return maxDistance;
+		}
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(direction, q) * inverseDeterminant;
+		if (v < 0.0f || u + v > 1.0f) {
+			return maxDistance;
+		}
+		float distance = glm::dot(edge2, q) * inverseDeterminant;
+		return distance >= 0.0f && distance < maxDistance ? distance : maxDistance;
+	}
+}
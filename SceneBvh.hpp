@@ -0,0 +1,84 @@
+#ifndef SceneBvh_hpp
+#define SceneBvh_hpp
+
+#include "Bvh.hpp"
+#include "Model3D.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // A mesh of a model added to the scene
+    struct SceneMeshRef
+    {
+        // index returned by SceneBvh::AddModel
+        GLuint model;
+        // index in Model3D::GetMeshes
+        GLuint mesh;
+    };
+
+    struct SceneTriangleRef
+    {
+        GLuint model;
+        GLuint mesh;
+        // first index of the triangle in the full detail level is 3 * triangle
+        GLuint triangle;
+    };
+
+    struct RayHit
+    {
+        float distance;
+        GLuint model;
+        GLuint mesh;
+        GLuint triangle;
+    };
+
+    // Two level BVH over static geometry: one hierarchy over the world space boxes of the meshes,
+    // and one over the triangles of the full detail level of each mesh
+    class SceneBvh
+    {
+    public:
+        SceneBvh();
+
+        // Copies the world space triangles of the model, returns the index used in the query results
+        GLuint AddModel(const Model3D& model, const glm::mat4& modelMatrix = glm::mat4(1.0f));
+
+        // Builds the hierarchies over everything added so far
+        void Build();
+
+        // Meshes whose world space box is not completely outside the frustum
+        void QueryFrustum(const Frustum& frustum, std::vector<SceneMeshRef>& meshes) const;
+
+        // Triangles whose box overlaps the given world space box
+        void QueryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<SceneTriangleRef>& triangles) const;
+
+        // Closest triangle hit by the ray closer than maxDistance. `direction` does not have to be normalized,
+        // distances are in units of its length
+        bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit* hit) const;
+
+        size_t GetNodeCount() const;
+        size_t GetTriangleCount() const;
+
+    private:
+        struct SceneMesh
+        {
+            GLuint model;
+            GLuint mesh;
+            std::vector<glm::vec3> positions;
+            std::vector<GLuint> indices;
+            glm::vec3 boundsMin;
+            glm::vec3 boundsMax;
+            Bvh triangleBvh;
+        };
+
+        GLuint modelCount;
+        std::vector<SceneMesh> meshes;
+        Bvh meshBvh;
+
+        // Möller-Trumbore, returns maxDistance on a miss
+        static float IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+                                       const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float maxDistance);
+    };
+}
+
+#endif /* SceneBvh_hpp */
@@ -1,6 +1,12 @@
 #include "Shader.hpp"
 
+#include <algorithm>
+
 namespace gps {
+    Shader::Shader() : shaderProgram(0)
+    {
+    }
+
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -44,42 +50,232 @@ namespace gps {
         //check linking info
         glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
         if(!success) {
-            glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+            glGetProgramInfoLog(shaderProgramId, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
     }
 
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::string& features)
     {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
+        //read the sources, kept for the permutations
+        this->sources = std::make_shared<Sources>();
+        this->sources->vertexShaderFileName = vertexShaderFileName;
+        this->sources->fragmentShaderFileName = fragmentShaderFileName;
+        this->sources->vertexSource = readShaderFile(vertexShaderFileName);
+        this->sources->fragmentSource = readShaderFile(fragmentShaderFileName);
+        this->features = sortFeatures(features);
+
+        //compile and link with the features of the shader only
+        this->shaderProgram = compileProgram(*this->sources, this->features);
+        Permutation permutation = { this->features, this->shaderProgram };
+        this->sources->permutations[featureHash(this->features)] = permutation;
+    }
+
+    Shader Shader::getPermutation(const std::string& features) const
+    {
+        if (!this->sources)
+            return *this;
+
+        Shader permutation = *this;
+        permutation.features = sortFeatures(this->features + " " + features);
+        if (permutation.features == this->features)
+            return permutation;
+
+        unsigned long long hash = featureHash(permutation.features);
+        auto cached = this->sources->permutations.find(hash);
+        if (cached != this->sources->permutations.end()) {
+            if (cached->second.features == permutation.features) {
+                permutation.shaderProgram = cached->second.program;
+                return permutation;
+            }
+            std::cout << "Shader permutation \"" << permutation.features << "\" has the hash of \""
+                << cached->second.features << "\", using the shader without it" << std::endl;
+            return *this;
+        }
+
+        std::cout << "Compiling " << this->sources->fragmentShaderFileName << " with \"" << permutation.features << "\"" << std::endl;
+        permutation.shaderProgram = compileProgram(*this->sources, permutation.features);
+        Permutation entry = { permutation.features, permutation.shaderProgram };
+        this->sources->permutations[hash] = entry;
+        return permutation;
+    }
+
+    const std::string& Shader::getFeatures() const
+    {
+        return this->features;
+    }
+
+    void Shader::copyUniformsTo(const Shader& target) const
+    {
+        if (!this->sources || target.sources != this->sources || target.shaderProgram == this->shaderProgram)
+            return;
+
+        //the locations of the uniforms both programs have, looked up once per pair of programs
+        std::vector<UniformCopy>& copies = this->sources->uniformCopies[std::make_pair(this->shaderProgram, target.shaderProgram)];
+        if (copies.empty()) {
+            GLint uniformCount = 0;
+            glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+            for (GLint i = 0; i < uniformCount; i++) {
+                GLchar nameBuffer[256];
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type = 0;
+                glGetActiveUniform(this->shaderProgram, i, sizeof(nameBuffer), &length, &size, &type, nameBuffer);
+                std::string name(nameBuffer, length);
+                //arrays are reported as name[0], each element has its own location
+                size_t bracket = name.find('[');
+                if (bracket != std::string::npos)
+                    name = name.substr(0, bracket);
+                for (GLint element = 0; element < size; element++) {
+                    std::string elementName = size > 1 ? name + "[" + std::to_string(element) + "]" : name;
+                    UniformCopy copy = {
+                        glGetUniformLocation(this->shaderProgram, elementName.c_str()),
+                        glGetUniformLocation(target.shaderProgram, elementName.c_str()),
+                        type
+                    };
+                    if (copy.source != -1 && copy.target != -1)
+                        copies.push_back(copy);
+                }
+            }
+        }
+
+        //glProgramUniform sets them without binding the target
+        for (size_t i = 0; i < copies.size(); i++) {
+            const UniformCopy& copy = copies[i];
+            GLfloat floats[16];
+            GLint ints[4];
+            GLuint uints[4];
+            switch (copy.type) {
+            case GL_FLOAT:
+                glGetUniformfv(this->shaderProgram, copy.source, floats);
+                glProgramUniform1fv(target.shaderProgram, copy.target, 1, floats);
+                break;
+            case GL_FLOAT_VEC2:
+                glGetUniformfv(this->shaderProgram, copy.source, floats);
+                glProgramUniform2fv(target.shaderProgram, copy.target, 1, floats);
+                break;
+            case GL_FLOAT_VEC3:
+                glGetUniformfv(this->shaderProgram, copy.source, floats);
+                glProgramUniform3fv(target.shaderProgram, copy.target, 1, floats);
+                break;
+            case GL_FLOAT_VEC4:
+                glGetUniformfv(this->shaderProgram, copy.source, floats);
+                glProgramUniform4fv(target.shaderProgram, copy.target, 1, floats);
+                break;
+            case GL_FLOAT_MAT3:
+                glGetUniformfv(this->shaderProgram, copy.source, floats);
+                glProgramUniformMatrix3fv(target.shaderProgram, copy.target, 1, GL_FALSE, floats);
+                break;
+            case GL_FLOAT_MAT4:
+                glGetUniformfv(this->shaderProgram, copy.source, floats);
+                glProgramUniformMatrix4fv(target.shaderProgram, copy.target, 1, GL_FALSE, floats);
+                break;
+            case GL_INT_VEC2:
+            case GL_BOOL_VEC2:
+                glGetUniformiv(this->shaderProgram, copy.source, ints);
+                glProgramUniform2iv(target.shaderProgram, copy.target, 1, ints);
+                break;
+            case GL_INT_VEC3:
+            case GL_BOOL_VEC3:
+                glGetUniformiv(this->shaderProgram, copy.source, ints);
+                glProgramUniform3iv(target.shaderProgram, copy.target, 1, ints);
+                break;
+            case GL_INT_VEC4:
+            case GL_BOOL_VEC4:
+                glGetUniformiv(this->shaderProgram, copy.source, ints);
+                glProgramUniform4iv(target.shaderProgram, copy.target, 1, ints);
+                break;
+            case GL_UNSIGNED_INT:
+                glGetUniformuiv(this->shaderProgram, copy.source, uints);
+                glProgramUniform1uiv(target.shaderProgram, copy.target, 1, uints);
+                break;
+            default:
+                //int, bool and the samplers, which hold their texture unit
+                glGetUniformiv(this->shaderProgram, copy.source, ints);
+                glProgramUniform1iv(target.shaderProgram, copy.target, 1, ints);
+                break;
+            }
+        }
+    }
+
+    GLuint Shader::compileProgram(const Sources& sources, const std::string& features)
+    {
+        GLuint vertexShader = compileShader(GL_VERTEX_SHADER, sources.vertexSource, features);
+        GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, sources.fragmentSource, features);
 
         //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
-        glLinkProgram(this->shaderProgram);
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
         //check linking info
-        shaderLinkLog(this->shaderProgram);
+        shaderLinkLog(program);
+        return program;
+    }
+
+    GLuint Shader::compileShader(GLenum type, const std::string& source, const std::string& features)
+    {
+        //the defines go right after the #version line, which has to come first
+        std::string defines;
+        std::istringstream stream(features);
+        std::string name;
+        while (stream >> name)
+            defines += "#define " + name + "\n";
+
+        std::string s = source;
+        if (!defines.empty()) {
+            size_t version = s.find("#version");
+            size_t lineEnd = version == std::string::npos ? std::string::npos : s.find('\n', version);
+            if (lineEnd == std::string::npos) {
+                s = defines + "#line 1\n" + s;
+            }
+            else {
+                //keeps the line numbers of the compilation errors those of the file
+                s.insert(lineEnd + 1, defines + "#line " + std::to_string(std::count(s.begin(), s.begin() + lineEnd + 1, '\n') + 1) + "\n");
+            }
+        }
+
+        //parse and compile the shader
+        const GLchar* shaderString = s.c_str();
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &shaderString, NULL);
+        glCompileShader(shader);
+        //check compilation status
+        shaderCompileLog(shader);
+        return shader;
+    }
+
+    //sorted and without duplicates, so the same set of features always gives the same key
+    std::string Shader::sortFeatures(const std::string& features)
+    {
+        std::vector<std::string> names;
+        std::istringstream stream(features);
+        std::string name;
+        while (stream >> name)
+            names.push_back(name);
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+
+        std::string sorted;
+        for (size_t i = 0; i < names.size(); i++) {
+            if (i > 0)
+                sorted += " ";
+            sorted += names[i];
+        }
+        return sorted;
+    }
+
+    unsigned long long Shader::featureHash(const std::string& features)
+    {
+        //64 bit FNV-1a
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < features.size(); i++) {
+            hash ^= (unsigned char)features[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
     }
 
     void Shader::useShaderProgram()
@@ -7,7 +7,11 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace gps {
 
@@ -15,13 +19,65 @@ class Shader
 {
 public:
     GLuint shaderProgram;
-    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+
+    Shader();
+
+    // Compiles the sources with `features` defined, none by default. They are kept in all the permutations,
+    // so one fragment shader can serve different vertex shaders (the DEFERRED lighting pass of shaderStart.frag)
+    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::string& features = "");
     void useShaderProgram();
 
+    // The same sources compiled with the features of this shader and `features` (names separated by spaces)
+    // as #defines, so the code of the features left out is removed. Permutations are compiled the first time
+    // they are asked for and cached by the hash of their sorted feature names, copies of a shader share the cache
+    Shader getPermutation(const std::string& features) const;
+    const std::string& getFeatures() const;
+
+    // Sets the uniforms of `target`, a permutation of the same sources, to the values they have in this
+    // shader - uniforms are per program, so a permutation created in the middle of a frame starts with
+    // the ones already set on the shader it was made from. Reads every uniform back, not for each draw
+    void copyUniformsTo(const Shader& target) const;
+
 private:
+    struct Permutation
+    {
+        std::string features;
+        GLuint program;
+    };
+
+    // uniform location in the source and in the target program of a copy
+    struct UniformCopy
+    {
+        GLint source;
+        GLint target;
+        GLenum type;
+    };
+
+    // shared by all the copies and permutations of the shader
+    struct Sources
+    {
+        std::string vertexShaderFileName;
+        std::string fragmentShaderFileName;
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::unordered_map<unsigned long long, Permutation> permutations;
+        std::map<std::pair<GLuint, GLuint>, std::vector<UniformCopy> > uniformCopies;
+    };
+
+    std::shared_ptr<Sources> sources;
+    // sorted feature names, separated by spaces
+    std::string features;
+
     std::string readShaderFile(std::string fileName);
-    void shaderCompileLog(GLuint shaderId);
-    void shaderLinkLog(GLuint shaderProgramId);
+    static void shaderCompileLog(GLuint shaderId);
+    static void shaderLinkLog(GLuint shaderProgramId);
+
+    // Compiles and links `sources` with `features` defined after the #version line
+    static GLuint compileProgram(const Sources& sources, const std::string& features);
+    static GLuint compileShader(GLenum type, const std::string& source, const std::string& features);
+    static unsigned long long featureHash(const std::string& features);
+    // Feature names sorted and without duplicates, separated by spaces
+    static std::string sortFeatures(const std::string& features);
 };
 
 }
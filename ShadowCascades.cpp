@@ -0,0 +1,257 @@
+#include "ShadowCascades.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace gps {
+
+	// weight of the logarithmic splits against the uniform ones
+	static const float SPLIT_LAMBDA = 0.75f;
+	static const float BIAS_TEXELS = 1.5f;
+
+	// depth texture array of `layers` layers of size x size
+	static GLuint CreateDepthArray(int size, int layers, int depthBits) {
+		GLenum internalFormat = depthBits == 16 ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT24;
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+		// immutable storage needs ARB_texture_storage (core in 4.2)
+		if (GLEW_ARB_texture_storage) {
+			glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, internalFormat, size, size, layers);
+		}
+		else {
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, size, size, layers, 0,
+				GL_DEPTH_COMPONENT, depthBits == 16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		return id;
+	}
+
+	// framebuffer with only a depth attachment, the first layer of `depthArray`
+	static GLuint CreateDepthFramebuffer(GLuint depthArray) {
+		GLuint id;
+		glGenFramebuffers(1, &id);
+		glBindFramebuffer(GL_FRAMEBUFFER, id);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return id;
+	}
+
+	ShadowCascades::ShadowCascades() : resolution(0), cascadeCount(0), depthBits(24), framebuffer(0), texture(0),
+		staticFramebuffer(0), staticTexture(0), staticRedraws(0), hasSceneBounds(false), sceneMin(0.0f), sceneMax(0.0f),
+		maxDistance(50.0f), lightView(1.0f) {
+		for (int i = 0; i < MAX_CASCADES; i++) {
+			projections[i] = glm::mat4(1.0f);
+			splitDistances[i] = 0.0f;
+			depthBias[i] = 0.0f;
+			staticValid[i] = false;
+			staticLightSpace[i] = glm::mat4(1.0f);
+		}
+	}
+
+	void ShadowCascades::Init(int resolution, int cascadeCount, int depthBits) {
+		this->resolution = resolution;
+		this->cascadeCount = std::max(1, std::min(cascadeCount, (int)MAX_CASCADES));
+		this->depthBits = depthBits <= 16 ? 16 : 24;
+
+		texture = CreateDepthArray(resolution, this->cascadeCount, this->depthBits);
+		// linear filtering of the comparison results gives 2x2 percentage closer filtering
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		framebuffer = CreateDepthFramebuffer(texture);
+
+		// the static casters of each cascade, copied into the cascade every frame
+		staticTexture = CreateDepthArray(resolution, this->cascadeCount, this->depthBits);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		staticFramebuffer = CreateDepthFramebuffer(staticTexture);
+		InvalidateStaticCache();
+	}
+
+	void ShadowCascades::SetSceneBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+		hasSceneBounds = true;
+		sceneMin = boundsMin;
+		sceneMax = boundsMax;
+	}
+
+	void ShadowCascades::SetMaxDistance(float maxDistance) {
+		this->maxDistance = maxDistance;
+	}
+
+	void ShadowCascades::Update(const glm::mat4& cameraView, const glm::mat4& cameraProjection, const glm::vec3& lightDirection) {
+		// the slices are cut from the perspective projection of the camera
+		float nearDistance = cameraProjection[3][2] / (cameraProjection[2][2] - 1.0f);
+		float farDistance = std::min(cameraProjection[3][2] / (cameraProjection[2][2] + 1.0f), maxDistance);
+		float tanHalfX = 1.0f / cameraProjection[0][0];
+		float tanHalfY = 1.0f / cameraProjection[1][1];
+		glm::mat4 cameraToWorld = glm::inverse(cameraView);
+
+		glm::vec3 direction = glm::normalize(lightDirection);
+		glm::vec3 up = fabsf(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		// only a rotation, the cascades are placed by their projections
+		lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+
+		staticRedraws = 0;
+
+		float sliceNear = nearDistance;
+		for (int c = 0; c < cascadeCount; c++) {
+			float fraction = (float)(c + 1) / cascadeCount;
+			float logarithmic = nearDistance * powf(farDistance / nearDistance, fraction);
+			float uniform = nearDistance + (farDistance - nearDistance) * fraction;
+			float sliceFar = SPLIT_LAMBDA * logarithmic + (1.0f - SPLIT_LAMBDA) * uniform;
+			splitDistances[c] = sliceFar;
+
+			// bounding sphere of the slice, its size does not change as the camera turns
+			glm::vec3 corners[8];
+			glm::vec3 center(0.0f);
+			for (int i = 0; i < 8; i++) {
+				float distance = (i & 4) ? sliceFar : sliceNear;
+				corners[i] = glm::vec3(((i & 1) ? 1.0f : -1.0f) * distance * tanHalfX, ((i & 2) ? 1.0f : -1.0f) * distance * tanHalfY, -distance);
+				center += corners[i] / 8.0f;
+			}
+			float radius = 0.0f;
+			for (int i = 0; i < 8; i++) {
+				radius = std::max(radius, glm::length(corners[i] - center));
+			}
+			radius = ceilf(radius * 16.0f) / 16.0f;
+
+			// the center moves in whole texels of the light view, so does the depth range: the projection
+			// only changes after a move of a texel, which keeps the cached static casters valid below that
+			glm::vec3 lightCenter = glm::vec3(lightView * cameraToWorld * glm::vec4(center, 1.0f));
+			// a texel of margin around the sphere covers the snapping
+			float texelSize = 2.0f * radius / (resolution - 2);
+			float extent = radius + texelSize;
+			lightCenter = glm::floor(lightCenter / texelSize) * texelSize;
+
+			// the light looks down -z, the casters between the light and the slice are in front of it
+			float nearestZ = lightCenter.z + extent;
+			float farthestZ = lightCenter.z - extent;
+			if (hasSceneBounds) {
+				for (int i = 0; i < 8; i++) {
+					glm::vec3 corner((i & 1) ? sceneMax.x : sceneMin.x, (i & 2) ? sceneMax.y : sceneMin.y, (i & 4) ? sceneMax.z : sceneMin.z);
+					nearestZ = std::max(nearestZ, (lightView * glm::vec4(corner, 1.0f)).z);
+				}
+			}
+			projections[c] = glm::ortho(lightCenter.x - extent, lightCenter.x + extent, lightCenter.y - extent, lightCenter.y + extent,
+				-nearestZ, -farthestZ);
+			depthBias[c] = BIAS_TEXELS * texelSize / (nearestZ - farthestZ);
+
+			sliceNear = sliceFar;
+		}
+	}
+
+	int ShadowCascades::GetCascadeCount() const {
+		return cascadeCount;
+	}
+
+	int ShadowCascades::GetResolution() const {
+		return resolution;
+	}
+
+	size_t ShadowCascades::GetMemorySize() const {
+		// 24 bit depth is stored in 32 bits
+		return (size_t)resolution * resolution * cascadeCount * (depthBits == 16 ? 2 : 4) * 2;
+	}
+
+	glm::mat4 ShadowCascades::GetViewMatrix() const {
+		return lightView;
+	}
+
+	glm::mat4 ShadowCascades::GetProjectionMatrix(int cascade) const {
+		return projections[cascade];
+	}
+
+	glm::mat4 ShadowCascades::GetLightSpaceMatrix(int cascade) const {
+		return projections[cascade] * lightView;
+	}
+
+	bool ShadowCascades::BeginStaticCascade(int cascade) {
+		glm::mat4 lightSpace = GetLightSpaceMatrix(cascade);
+		if (staticValid[cascade] && staticLightSpace[cascade] == lightSpace) {
+			return false;
+		}
+		staticValid[cascade] = true;
+		staticLightSpace[cascade] = lightSpace;
+		staticRedraws++;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, cascade);
+		glViewport(0, 0, resolution, resolution);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		return true;
+	}
+
+	void ShadowCascades::BeginCascade(int cascade) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+		glViewport(0, 0, resolution, resolution);
+		if (!staticValid[cascade]) {
+			glClear(GL_DEPTH_BUFFER_BIT);
+			return;
+		}
+		// ARB_copy_image (core in 4.3) copies the layer directly, otherwise it is blitted between the framebuffers
+		if (GLEW_ARB_copy_image) {
+			glCopyImageSubData(staticTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade,
+				texture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade, resolution, resolution, 1);
+		}
+		else {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+			glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, cascade);
+			glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		}
+	}
+
+	void ShadowCascades::InvalidateStaticCache() {
+		for (int i = 0; i < MAX_CASCADES; i++) {
+			staticValid[i] = false;
+		}
+	}
+
+	int ShadowCascades::GetStaticRedrawCount() const {
+		return staticRedraws;
+	}
+
+	void ShadowCascades::EndCascades() {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void ShadowCascades::SetUniforms(gps::Shader shader, GLint textureUnit) const {
+		glActiveTexture(GL_TEXTURE0 + textureUnit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "shadowMap"), textureUnit);
+
+		glUniform1i(glGetUniformLocation(shader.shaderProgram, "cascadeCount"), cascadeCount);
+		glUniform4fv(glGetUniformLocation(shader.shaderProgram, "cascadeSplits"), 1, splitDistances);
+		glUniform4fv(glGetUniformLocation(shader.shaderProgram, "cascadeBias"), 1, depthBias);
+		for (int c = 0; c < cascadeCount; c++) {
+			std::string name = "lightSpaceTrMatrices[" + std::to_string(c) + "]";
+			glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, name.c_str()), 1, GL_FALSE,
+				glm::value_ptr(GetLightSpaceMatrix(c)));
+		}
+	}
+
+	void ShadowCascades::SetComparison(bool enabled) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, enabled ? GL_COMPARE_REF_TO_TEXTURE : GL_NONE);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+
+	GLuint ShadowCascades::GetTexture() const {
+		return texture;
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef ShadowCascades_hpp
+#define ShadowCascades_hpp
+
+#include "Shader.hpp"
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    // Cascaded shadow maps of a directional light. The view frustum of the camera, up to a maximum
+    // distance, is cut into slices (practical split scheme, between logarithmic and uniform) and each
+    // slice gets an orthographic light projection around its bounding sphere, moved in whole texels
+    // so the shadows do not shimmer when the camera moves. The cascades are the layers of one depth
+    // texture array, sampled with hardware comparison (sampler2DArrayShadow).
+    // The static casters of each cascade are cached in a second array: it is only redrawn when the
+    // light space matrix of the cascade changes (the light turns or the camera moves by a texel),
+    // every frame starts from a copy of it and only the moving casters are drawn on top
+    class ShadowCascades
+    {
+    public:
+        static const int MAX_CASCADES = 4;
+
+        ShadowCascades();
+
+        // Allocates `cascadeCount` layers of resolution x resolution with 16 or 24 bit depth
+        void Init(int resolution, int cascadeCount, int depthBits);
+
+        // Box of everything that may cast shadows, the light projections reach back to it
+        void SetSceneBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+        // Distance from the camera after which nothing gets shadows
+        void SetMaxDistance(float maxDistance);
+
+        // Fits the cascades to the camera and the direction the light travels in
+        void Update(const glm::mat4& cameraView, const glm::mat4& cameraProjection, const glm::vec3& lightDirection);
+
+        int GetCascadeCount() const;
+        int GetResolution() const;
+        // both the cascades and the cache of the static casters
+        size_t GetMemorySize() const;
+
+        // Shared by all the cascades
+        glm::mat4 GetViewMatrix() const;
+        glm::mat4 GetProjectionMatrix(int cascade) const;
+        glm::mat4 GetLightSpaceMatrix(int cascade) const;
+
+        // Returns false when the cached static casters of the cascade are still valid. Otherwise binds the
+        // cache layer as the depth target, sets the viewport and clears it: the static casters are drawn next
+        bool BeginStaticCascade(int cascade);
+        // Binds the layer of the cascade as the depth target, sets the viewport and fills it with the
+        // cached static casters: the moving casters are drawn next
+        void BeginCascade(int cascade);
+        // Forces the static casters to be redrawn, after they changed
+        void InvalidateStaticCache();
+        // Number of cache layers redrawn since the last Update
+        int GetStaticRedrawCount() const;
+        // Back to the default framebuffer
+        void EndCascades();
+
+        // Binds the texture array to `textureUnit` and sets the uniforms read by computeShadow in shaderStart.frag
+        void SetUniforms(gps::Shader shader, GLint textureUnit) const;
+
+        // Turns the depth comparison off to look at the raw depths (sampler2DArray), and back on
+        void SetComparison(bool enabled);
+        GLuint GetTexture() const;
+
+    private:
+        int resolution;
+        int cascadeCount;
+        int depthBits;
+        GLuint framebuffer;
+        GLuint texture;
+        GLuint staticFramebuffer;
+        GLuint staticTexture;
+        bool staticValid[MAX_CASCADES];
+        // light space matrix the cache layer was drawn with
+        glm::mat4 staticLightSpace[MAX_CASCADES];
+        int staticRedraws;
+
+        bool hasSceneBounds;
+        glm::vec3 sceneMin;
+        glm::vec3 sceneMax;
+        float maxDistance;
+
+        glm::mat4 lightView;
+        glm::mat4 projections[MAX_CASCADES];
+        // far end of each slice, as a distance in front of the camera
+        float splitDistances[MAX_CASCADES];
+        // depth bias of one and a half texels, in the depth units of each cascade
+        float depthBias[MAX_CASCADES];
+    };
+}
+
+#endif /* ShadowCascades_hpp */
@@ -0,0 +1,92 @@
+#include "TextureRegistry.hpp"
+
+#include <cctype>
+#include <vector>
+
+namespace gps {
+
+	GLuint TextureRegistry::Acquire(const std::string& path, bool* created) {
+		std::string key = CanonicalizePath(path);
+
+		std::unordered_map<std::string, Entry>::iterator found = textures.find(key);
+		if (found != textures.end()) {
+			found->second.references++;
+			*created = false;
+			return found->second.textureID;
+		}
+
+		Entry entry;
+		glGenTextures(1, &entry.textureID);
+		entry.references = 1;
+		textures[key] = entry;
+		paths[entry.textureID] = key;
+
+		*created = true;
+		return entry.textureID;
+	}
+
+	void TextureRegistry::Release(GLuint textureID) {
+		std::unordered_map<GLuint, std::string>::iterator path = paths.find(textureID);
+		if (path == paths.end()) {
+			return;
+		}
+
+		std::unordered_map<std::string, Entry>::iterator entry = textures.find(path->second);
+		if (--entry->second.references == 0) {
+			glDeleteTextures(1, &textureID);
+			textures.erase(entry);
+			paths.erase(path);
+		}
+	}
+
+	size_t TextureRegistry::GetTextureCount() const {
+		return textures.size();
+	}
+
+	TextureRegistry& TextureRegistry::GetShared() {
+		// never destroyed: the global models release into it from their destructors at exit
+		static TextureRegistry* sharedRegistry = new TextureRegistry();
+		return *sharedRegistry;
+	}
+
+	std::string TextureRegistry::CanonicalizePath(const std::string& path) {
+		bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+
+		// split into components, dropping empty and "." ones
+		std::vector<std::string> components;
+		std::string component;
+		for (size_t i = 0; i <= path.size(); i++) {
+			char c = i < path.size() ? path[i] : '/';
+			if (c != '/' && c != '\\') {
+#ifdef _WIN32
+				c = (char)tolower((unsigned char)c);
+#endif
+				component += c;
+				continue;
+			}
+
+			if (component == "..") {
+				// a leading ".." of a relative path cannot be resolved lexically
+				if (!components.empty() && components.back() != "..") {
+					components.pop_back();
+				}
+				else if (!absolute) {
+					components.push_back(component);
+				}
+			}
+			else if (!component.empty() && component != ".") {
+				components.push_back(component);
+			}
+			component.clear();
+		}
+
+		std::string canonicalPath = absolute ? "/" : "";
+		for (size_t i = 0; i < components.size(); i++) {
+			if (i > 0) {
+				canonicalPath += '/';
+			}
+			canonicalPath += components[i];
+		}
+		return canonicalPath;
+	}
+}
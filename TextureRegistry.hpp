@@ -0,0 +1,42 @@
+#ifndef TextureRegistry_hpp
+#define TextureRegistry_hpp
+
+#include <GL/glew.h>
+
+#include <string>
+#include <unordered_map>
+
+namespace gps {
+
+    // Process-wide set of the texture objects loaded from image files, shared by all the models.
+    // Each path is loaded once - models acquire a reference to it and the texture is
+    // deleted when the last reference is released. Only used from the GL thread
+    class TextureRegistry
+    {
+    public:
+        // Returns the texture of the image file, creating an empty texture object if the path
+        // was not loaded yet (`created` is set, the caller has to fill in the pixels)
+        GLuint Acquire(const std::string& path, bool* created);
+        // Drops one reference, the texture is deleted with the last one
+        void Release(GLuint textureID);
+
+        size_t GetTextureCount() const;
+
+        static TextureRegistry& GetShared();
+
+        // Lexically normalized path: '/' separators, no "." or "dir/.." components,
+        // case folded on Windows
+        static std::string CanonicalizePath(const std::string& path);
+
+    private:
+        struct Entry {
+            GLuint textureID;
+            unsigned int references;
+        };
+
+        std::unordered_map<std::string, Entry> textures;
+        std::unordered_map<GLuint, std::string> paths;
+    };
+}
+
+#endif /* TextureRegistry_hpp */
@@ -0,0 +1,135 @@
+#include "TextureUploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gps {
+
+	TextureUploader::TextureUploader() : pixelBuffer(0), persistentData(NULL), currentSegment(0) {
+		for (int i = 0; i < SEGMENT_COUNT; i++) {
+			segmentFences[i] = 0;
+		}
+	}
+
+	TextureUploader::~TextureUploader() {
+		for (int i = 0; i < SEGMENT_COUNT; i++) {
+			if (segmentFences[i]) {
+				glDeleteSync(segmentFences[i]);
+			}
+		}
+		if (pixelBuffer) {
+			if (persistentData) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &pixelBuffer);
+		}
+	}
+
+	TextureUploader& TextureUploader::GetShared() {
+		static TextureUploader sharedUploader;
+		return sharedUploader;
+	}
+
+	void TextureUploader::CreateBuffer() {
+		size_t bufferSize = SEGMENT_COUNT * SEGMENT_SIZE;
+
+		glGenBuffers(1, &pixelBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+
+		// the context is 4.1, persistent mapping needs ARB_buffer_storage (core in 4.4)
+		if (GLEW_ARB_buffer_storage) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bufferSize, NULL, flags);
+			persistentData = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bufferSize, flags);
+		}
+		else {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferSize, NULL, GL_STREAM_DRAW);
+		}
+	}
+
+	unsigned char* TextureUploader::BeginSegment(size_t size) {
+		GLsync& fence = segmentFences[currentSegment];
+		if (fence) {
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(fence);
+			fence = 0;
+		}
+
+		size_t offset = currentSegment * SEGMENT_SIZE;
+		if (persistentData) {
+			return persistentData + offset;
+		}
+
+		// the fence already guarantees the range is free, so the map does not need to synchronize
+		return (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	}
+
+	void TextureUploader::EndSegment() {
+		segmentFences[currentSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		currentSegment = (currentSegment + 1) % SEGMENT_COUNT;
+	}
+
+	void TextureUploader::Upload(GLuint textureID, int width, int height, const unsigned char* pixels) {
+		if (!pixelBuffer) {
+			CreateBuffer();
+		}
+
+		int levels = 1;
+		while ((std::max(width, height) >> levels) > 0) {
+			levels++;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		// immutable storage needs ARB_texture_storage (core in 4.2)
+		if (GLEW_ARB_texture_storage) {
+			glTexStorage2D(GL_TEXTURE_2D, levels, GL_SRGB8, width, height);
+		}
+		else {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		size_t rowSize = (size_t)width * 4;
+		int rowsPerSegment = (int)std::max((size_t)1, SEGMENT_SIZE / rowSize);
+
+		for (int firstRow = 0; firstRow < height; firstRow += rowsPerSegment) {
+			int rowCount = std::min(rowsPerSegment, height - firstRow);
+			size_t stripSize = rowCount * rowSize;
+			const unsigned char* source = pixels + firstRow * rowSize;
+
+			// a single row wider than a segment (or a failed map) is sent straight from client memory
+			unsigned char* destination = stripSize <= SEGMENT_SIZE ? BeginSegment(stripSize) : NULL;
+			if (!destination) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, width, rowCount, GL_RGBA, GL_UNSIGNED_BYTE, source);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+				continue;
+			}
+
+			memcpy(destination, source, stripSize);
+			if (!persistentData) {
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			}
+
+			// with a PBO bound the pointer is an offset into the buffer
+			size_t offset = currentSegment * SEGMENT_SIZE;
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, width, rowCount, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)offset);
+			EndSegment();
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef TextureUploader_hpp
+#define TextureUploader_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+namespace gps {
+
+    // Streams decoded RGBA8 images into textures through a ring of pixel buffer objects.
+    // The pixels are copied into mapped PBO memory and transferred with glTexSubImage2D,
+    // so the driver does not have to copy client memory on the spot. Each ring segment
+    // is guarded by a fence and is only rewritten once the GPU has consumed it.
+    // Images larger than a segment are sent in strips of rows. Only used from the GL thread
+    class TextureUploader
+    {
+    public:
+        TextureUploader();
+        ~TextureUploader();
+
+        // Allocates the storage of the texture (all mip levels), uploads the top level
+        // and generates the other ones. `pixels` holds width * height RGBA8 texels
+        void Upload(GLuint textureID, int width, int height, const unsigned char* pixels);
+
+        // Uploader shared by the models, the buffers are created on first use
+        static TextureUploader& GetShared();
+
+    private:
+        static const int SEGMENT_COUNT = 4;
+        static const size_t SEGMENT_SIZE = 8 * 1024 * 1024;
+
+        GLuint pixelBuffer;
+        // NULL when the buffer is not persistently mapped
+        unsigned char* persistentData;
+        GLsync segmentFences[SEGMENT_COUNT];
+        int currentSegment;
+
+        void CreateBuffer();
+        // Waits until the GPU is done with the current segment and returns its memory
+        unsigned char* BeginSegment(size_t size);
+        // Fences the current segment and moves to the next one
+        void EndSegment();
+
+        TextureUploader(const TextureUploader&);
+        TextureUploader& operator=(const TextureUploader&);
+    };
+}
+
+#endif /* TextureUploader_hpp */
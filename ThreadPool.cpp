@@ -0,0 +1,65 @@
+#include "ThreadPool.hpp"
+
+namespace gps {
+
+	ThreadPool::ThreadPool(unsigned int workerCount) : stopping(false) {
+		if (workerCount == 0) {
+			workerCount = std::thread::hardware_concurrency();
+		}
+		if (workerCount == 0) {
+			workerCount = 1;
+		}
+
+		for (unsigned int i = 0; i < workerCount; i++) {
+			workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+		}
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			stopping = true;
+		}
+		jobAvailable.notify_all();
+
+		for (size_t i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+	}
+
+	void ThreadPool::Enqueue(const std::function<void()>& job) {
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			jobs.push_back(job);
+		}
+		jobAvailable.notify_one();
+	}
+
+	unsigned int ThreadPool::GetWorkerCount() const {
+		return (unsigned int)workers.size();
+	}
+
+	ThreadPool& ThreadPool::GetShared() {
+		static ThreadPool sharedPool;
+		return sharedPool;
+	}
+
+	void ThreadPool::WorkerLoop() {
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(jobsMutex);
+				while (!stopping && jobs.empty()) {
+					jobAvailable.wait(lock);
+				}
+				// the queue is drained before the workers stop
+				if (jobs.empty()) {
+					return;
+				}
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Fixed set of worker threads running queued jobs in FIFO order.
+    // Jobs must not touch OpenGL - the context is current on the main thread only
+    class ThreadPool
+    {
+    public:
+        // 0 workers means one per hardware thread
+        explicit ThreadPool(unsigned int workerCount = 0);
+        // Finishes the queued jobs, then joins the workers
+        ~ThreadPool();
+
+        void Enqueue(const std::function<void()>& job);
+
+        unsigned int GetWorkerCount() const;
+
+        // Pool shared by the loaders, created on first use
+        static ThreadPool& GetShared();
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > jobs;
+        std::mutex jobsMutex;
+        std::condition_variable jobAvailable;
+        bool stopping;
+
+        void WorkerLoop();
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+    };
+}
+
+#endif /* ThreadPool_hpp */
@@ -10,9 +10,22 @@
 #include "Window.h"
 #include "Shader.hpp"
 #include "Camera.hpp"
+#include "CellGraph.hpp"
+#include "GBuffer.hpp"
+#include "LightManager.hpp"
+#include "MappedFile.hpp"
 #include "Model3D.hpp"
+#include "OcclusionCuller.hpp"
+#include "OcclusionQueries.hpp"
+#include "PointShadowAtlas.hpp"
+#include "SceneBvh.hpp"
+#include "ShadowCascades.hpp"
 #include "SkyBox.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 
 // window
@@ -31,8 +44,31 @@ int glWindowHeight = 1080;
 int retina_width, retina_height;
 GLFWwindow* glWindow = NULL;
 
-const unsigned int SHADOW_WIDTH = 10000;
-const unsigned int SHADOW_HEIGHT = 10000;
+// cascaded shadow maps: 4 x 2048^2 at 16 bit depth is 32 MB, as much again for the cache of the static casters
+const int SHADOW_RESOLUTION = 2048;
+const int SHADOW_CASCADES = 4;
+const int SHADOW_DEPTH_BITS = 16;
+// distance from the camera the sun casts shadows up to
+const float SHADOW_DISTANCE = 50.0f;
+// the point lights share an atlas of tiles from 128^2 to 512^2 per cube face, sized by screen coverage
+const int POINT_SHADOW_ATLAS_SIZE = 2048;
+const int POINT_SHADOW_MIN_TILE = 128;
+const int POINT_SHADOW_MAX_TILE = 512;
+// distance the lamps light and cast shadows up to, their attenuation is below 2% past it
+const float POINT_LIGHT_RANGE = 15.0f;
+// small lights spread over the scene with P, to compare the cost of many lights
+const int LIGHT_SWARM_SIZE = 256;
+const float LIGHT_SWARM_RANGE = 2.0f;
+
+// levels of detail: screen space error allowed in pixels, the shadow map gets away with coarser meshes
+float lodBias = 1.0f;
+float shadowLodBias = 4.0f;
+
+// culling counters of the last frame, shown in the window title
+gps::RenderStats cameraStats;
+gps::RenderStats shadowStats;
+double lastStatsTitleTime = 0.0;
+int statsTitleFrames = 0;
 
 // matrices
 glm::mat4 model;
@@ -48,13 +84,17 @@ glm::vec3 lightColor;
 GLuint lightColorLoc;
 
 glm::vec3 pointLightPos1;
-GLuint pointLightPos1Loc;
-
 glm::vec3 pointLightPos2;
-GLuint pointLightPos2Loc;
 
+// lamps switched on: 0 none, 1 or 2 one of them, 4 both
 GLuint activatePointLight;
-GLuint activatePointLightLoc;
+
+// clustered point and spot lights, the lamps first and then the swarm
+gps::LightManager lightManager;
+int lampLight1;
+int lampLight2;
+int firstSwarmLight;
+bool lightSwarm = false;
 
 // shader uniform locations
 GLint modelLoc;
@@ -77,6 +117,10 @@ gps::Camera myCamera(
 	glm::vec3(0.0f, 1.0f, 0.0f));
 
 GLfloat cameraSpeed = 0.1f;
+// the camera flies freely, collision with the walls and furniture of the scene is opt-in, toggled with N
+bool cameraCollision = false;
+// closest the camera moves to the scene while the collision is on
+const float CAMERA_COLLISION_DISTANCE = 0.3f;
 
 GLboolean pressedKeys[1024];
 
@@ -93,9 +137,23 @@ gps::Model3D ceilingFan;
 gps::Model3D lightCube;
 gps::Model3D screenQuad;
 
+// triangles of the static scene, ray cast against by the optional camera collision
+gps::SceneBvh sceneBvh;
+
+// rooms of the house and the doors and windows between them, from an optional .cells file
+gps::CellGraph sceneCells;
+// cells seen by the camera this frame
+std::vector<unsigned char> visibleCells;
+
+// the largest triangles of the scene (walls, floors) hide what is behind them from the camera pass
+gps::OcclusionCuller occlusionCuller;
+bool occlusionCulling = true;
+// triangles with an area of at least this fraction of the squared scene diagonal become occluders
+const float OCCLUDER_MIN_AREA = 0.001f;
 
-GLuint shadowMapFBO;
-GLuint depthMapTexture;
+
+gps::ShadowCascades shadowCascades;
+gps::PointShadowAtlas pointShadowAtlas;
 GLfloat angle;
 
 // shaders
@@ -107,7 +165,23 @@ gps::Shader depthMapShader;
 gps::SkyBox mySkyBox;
 gps::Shader skyboxShader;
 
+// coherent hardware occlusion queries for the camera pass, toggled with H
+gps::Shader occlusionBoxShader;
+gps::OcclusionQueries occlusionQueries;
+bool hardwareOcclusionQueries = false;
+
+// deferred shading instead of forward, toggled with G to compare the frame times. The G-buffer has one
+// sample per pixel while the forward path draws into the 4x multisampled window, the title says so
+gps::Shader gbufferShader;
+gps::Shader deferredShader;
+gps::GBuffer gBuffer;
+bool deferredShading = false;
+// units of the G-buffer in the lighting pass, after the ones of the shadows and the lights
+const GLint GBUFFER_TEXTURE_UNIT = 8;
+
 bool showDepthMap;
+// cascade shown by the depth map view
+int shownCascade = 0;
 
 GLenum glCheckError_(const char* file, int line)
 {
@@ -152,8 +226,31 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 		glfwSetWindowShouldClose(window, GL_TRUE);
 	}
 
-	if (key == GLFW_KEY_M && action == GLFW_PRESS)
-		showDepthMap = !showDepthMap;
+	// steps through the shadow cascades, then back to the scene
+	if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+		if (!showDepthMap) {
+			showDepthMap = true;
+			shownCascade = 0;
+		}
+		else if (++shownCascade >= shadowCascades.GetCascadeCount()) {
+			showDepthMap = false;
+		}
+	}
+
+	if (key == GLFW_KEY_O && action == GLFW_PRESS)
+		occlusionCulling = !occlusionCulling;
+
+	if (key == GLFW_KEY_H && action == GLFW_PRESS)
+		hardwareOcclusionQueries = !hardwareOcclusionQueries;
+
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		lightSwarm = !lightSwarm;
+
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+		deferredShading = !deferredShading;
+
+	if (key == GLFW_KEY_N && action == GLFW_PRESS)
+		cameraCollision = !cameraCollision;
 
 	if (key >= 0 && key < 1024) {
 		if (action == GLFW_PRESS) {
@@ -180,10 +277,27 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 	lastY = ypos;
 }
 
+// moves the camera, unless the collision is on and that takes it closer than CAMERA_COLLISION_DISTANCE to the scene
+void moveCamera(gps::MOVE_DIRECTION direction, float speed) {
+	gps::Camera previousCamera = myCamera;
+	myCamera.move(direction, speed);
+	if (!cameraCollision) {
+		return;
+	}
+
+	glm::vec3 step = myCamera.getCameraPosition() - previousCamera.getCameraPosition();
+	float stepLength = glm::length(step);
+	gps::RayHit hit;
+	if (stepLength > 0.0f && sceneBvh.Raycast(previousCamera.getCameraPosition(), step,
+		(stepLength + CAMERA_COLLISION_DISTANCE) / stepLength, &hit)) {
+		myCamera = previousCamera;
+	}
+}
+
 void processMovement() {
 	if (pressedKeys[GLFW_KEY_W]) {
 		glCheckError();
-		myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
+		moveCamera(gps::MOVE_FORWARD, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
@@ -195,7 +309,7 @@ void processMovement() {
 
 	if (pressedKeys[GLFW_KEY_S]) {
 		glCheckError();
-		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
+		moveCamera(gps::MOVE_BACKWARD, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
@@ -206,7 +320,7 @@ void processMovement() {
 	}
 
 	if (pressedKeys[GLFW_KEY_A]) {
-		myCamera.move(gps::MOVE_LEFT, cameraSpeed);
+		moveCamera(gps::MOVE_LEFT, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
@@ -216,7 +330,7 @@ void processMovement() {
 	}
 
 	if (pressedKeys[GLFW_KEY_D]) {
-		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
+		moveCamera(gps::MOVE_RIGHT, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
@@ -226,7 +340,7 @@ void processMovement() {
 	}
 
 	if (pressedKeys[GLFW_KEY_UP]) {
-		myCamera.move(gps::MOVE_UP, cameraSpeed);
+		moveCamera(gps::MOVE_UP, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
@@ -236,7 +350,7 @@ void processMovement() {
 	}
 
 	if (pressedKeys[GLFW_KEY_DOWN]) {
-		myCamera.move(gps::MOVE_DOWN, cameraSpeed);
+		moveCamera(gps::MOVE_DOWN, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
 		myBasicShader.useShaderProgram();
@@ -364,7 +478,6 @@ void processMovement() {
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 		activatePointLight = 0;
-		glUniform1i(activatePointLightLoc, activatePointLight);
 	}
 
 	if (pressedKeys[GLFW_KEY_C]) {
@@ -376,7 +489,6 @@ void processMovement() {
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 		activatePointLight = 1;
-		glUniform1i(activatePointLightLoc, activatePointLight);
 	}
 
 	if (pressedKeys[GLFW_KEY_X]) {
@@ -388,7 +500,6 @@ void processMovement() {
 		// compute normal matrix for teapot
 		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 		activatePointLight = 2;
-		glUniform1i(activatePointLightLoc, activatePointLight);
 	}
 }
 
@@ -414,9 +525,75 @@ void initOpenGLState() {
 	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
 }
 
+// bounding box of the scene, in world space
+bool computeSceneBounds(glm::vec3& sceneMin, glm::vec3& sceneMax) {
+	const std::vector<gps::Mesh>& meshes = scene.GetMeshes();
+	if (meshes.empty()) {
+		return false;
+	}
+	sceneMin = meshes[0].boundsMin;
+	sceneMax = meshes[0].boundsMax;
+	for (size_t m = 1; m < meshes.size(); m++) {
+		sceneMin = glm::min(sceneMin, meshes[m].boundsMin);
+		sceneMax = glm::max(sceneMax, meshes[m].boundsMax);
+	}
+	return true;
+}
+
+void initOccluders() {
+	const std::vector<gps::Mesh>& meshes = scene.GetMeshes();
+	glm::vec3 sceneMin, sceneMax;
+	if (!computeSceneBounds(sceneMin, sceneMax)) {
+		return;
+	}
+	float minArea = OCCLUDER_MIN_AREA * glm::dot(sceneMax - sceneMin, sceneMax - sceneMin);
+
+	// the scene is batched with an identity model matrix, so its vertices are in world space
+	for (size_t m = 0; m < meshes.size(); m++) {
+		const gps::Mesh& mesh = meshes[m];
+		std::vector<glm::vec3> positions;
+		for (size_t v = 0; v < mesh.vertices.size(); v++) {
+			positions.push_back(mesh.vertices[v].Position);
+		}
+		std::vector<GLuint> indices;
+		for (GLuint i = mesh.lods[0].firstIndex; i + 2 < mesh.lods[0].firstIndex + mesh.lods[0].indexCount; i += 3) {
+			glm::vec3 edge1 = positions[mesh.indices[i + 1]] - positions[mesh.indices[i]];
+			glm::vec3 edge2 = positions[mesh.indices[i + 2]] - positions[mesh.indices[i]];
+			if (glm::length(glm::cross(edge1, edge2)) * 0.5f >= minArea) {
+				indices.insert(indices.end(), mesh.indices.begin() + i, mesh.indices.begin() + i + 3);
+			}
+		}
+		if (!indices.empty()) {
+			occlusionCuller.AddOccluder(positions, indices);
+		}
+	}
+	std::cout << "Occluders : " << occlusionCuller.GetOccluderTriangleCount() << " triangles, "
+		<< occlusionCuller.GetOccluderVertexCount() << " vertices" << std::endl;
+}
+
 void initModels() {
 	//teapot.LoadModel("models/teapot/teapot20segUT.obj");
+	// the models drawn with shaderStart/depthMap use the compressed vertex layout
+	scene.SetCompressedVertices(true);
+	ceilingFan.SetCompressedVertices(true);
 	scene.LoadModel("objects/scene/scene_no_sky.obj");
+	if (sceneCells.Load("objects/scene/scene_no_sky.cells")) {
+		scene.AssignCells(sceneCells);
+	}
+	// the scene never moves, so its shapes are merged into one draw call per texture set and region
+	scene.BuildStaticBatches();
+	std::chrono::high_resolution_clock::time_point bvhStart = std::chrono::high_resolution_clock::now();
+	sceneBvh.AddModel(scene);
+	sceneBvh.Build();
+	double bvhTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - bvhStart).count();
+	std::cout << "Scene BVH : " << sceneBvh.GetNodeCount() << " nodes over " << sceneBvh.GetTriangleCount()
+		<< " triangles in " << bvhTime << " ms" << std::endl;
+	initOccluders();
+	// the cascades reach back to every caster of the scene
+	glm::vec3 sceneMin, sceneMax;
+	if (computeSceneBounds(sceneMin, sceneMax)) {
+		shadowCascades.SetSceneBounds(sceneMin, sceneMax);
+	}
 	ceilingFan.LoadModel("objects/scene/ceiling_fan_2.obj");
 	lightCube.LoadModel("objects/cube/cube.obj");
 	screenQuad.LoadModel("objects/quad/quad.obj");
@@ -438,7 +615,15 @@ void initShaders() {
 	depthMapShader.useShaderProgram();
 
 	skyboxShader.loadShader("shaders/skyboxShader.vert", "shaders/skyboxShader.frag");
+
+	// the deferred path: the scene into the G-buffer, then the lights over a screen quad
+	gbufferShader.loadShader("shaders/shaderStart.vert", "shaders/gbuffer.frag");
+	// the lighting code of the forward path, run once per pixel of the G-buffer
+	deferredShader.loadShader("shaders/screenQuad.vert", "shaders/shaderStart.frag", "DEFERRED");
 	skyboxShader.useShaderProgram();
+
+	occlusionBoxShader.loadShader("shaders/occlusionBox.vert", "shaders/occlusionBox.frag");
+	occlusionQueries.Init(occlusionBoxShader);
 }
 
 void initUniforms() {
@@ -469,6 +654,8 @@ void initUniforms() {
 	// send projection matrix to shader
 	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 	glCheckError();
+	// the camera culls against the same projection
+	myCamera.setProjectionMatrix(projection);
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
@@ -482,16 +669,8 @@ void initUniforms() {
 	glUniform1f(fogDensityLoc, fogDensity);*/
 
 	pointLightPos1 = glm::vec3(2.0743f, 4.7439f, 13.469f);
-	pointLightPos1Loc = glGetUniformLocation(myBasicShader.shaderProgram, "lightPos1");
-	glUniform3fv(pointLightPos1Loc, 1, glm::value_ptr(pointLightPos1));
-
 	pointLightPos2 = glm::vec3(3.8219f, 4.7439f, 12.085f);
-	pointLightPos2Loc = glGetUniformLocation(myBasicShader.shaderProgram, "lightPos2");
-	glUniform3fv(pointLightPos2Loc, 1, glm::value_ptr(pointLightPos2));
-
 	activatePointLight = 0;
-	activatePointLightLoc = glGetUniformLocation(myBasicShader.shaderProgram, "havePointLight");
-	glUniform1i(activatePointLightLoc, activatePointLight);
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
@@ -500,8 +679,40 @@ void initUniforms() {
 	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 }
 
+void initLights() {
+	lightManager.Init();
+	// the lamps, switched with C and X and off with Z, cast shadows through the point shadow atlas
+	lampLight1 = lightManager.AddPointLight(pointLightPos1, 2.0f * lightColor, POINT_LIGHT_RANGE);
+	lightManager.GetLight(lampLight1).shadowIndex = 0;
+	lampLight2 = lightManager.AddPointLight(pointLightPos2, 2.0f * lightColor, POINT_LIGHT_RANGE);
+	lightManager.GetLight(lampLight2).shadowIndex = 1;
+
+	glm::vec3 sceneMin, sceneMax;
+	if (!computeSceneBounds(sceneMin, sceneMax)) {
+		sceneMin = glm::vec3(-10.0f);
+		sceneMax = glm::vec3(10.0f);
+	}
+	firstSwarmLight = lightManager.GetLightCount();
+	srand(1);
+	for (int l = 0; l < LIGHT_SWARM_SIZE; l++) {
+		glm::vec3 random((float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
+		glm::vec3 color((float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
+		int light = lightManager.AddPointLight(sceneMin + random * (sceneMax - sceneMin), color, LIGHT_SWARM_RANGE);
+		lightManager.GetLight(light).enabled = false;
+	}
+}
+
+// switches the lights on and off from the keys
+void updateLights() {
+	lightManager.GetLight(lampLight1).enabled = activatePointLight == 1 || activatePointLight == 4;
+	lightManager.GetLight(lampLight2).enabled = activatePointLight == 2 || activatePointLight == 4;
+	for (int l = firstSwarmLight; l < lightManager.GetLightCount(); l++) {
+		lightManager.GetLight(l).enabled = lightSwarm;
+	}
+}
+
+// the fan is turned once per frame in renderScene, every pass draws it at the same angle
 void rotateCeilingFan(GLint modelLoc) {
-	angle += 0.01f;
 	model = glm::mat4(1.0f);
 	glm::vec3 originalPosition = glm::vec3(0.7752, 6.9715, 8.6792);
 	model = glm::translate(model, originalPosition);
@@ -536,62 +747,105 @@ void initSkyBox() {
 
 }
 
-void drawObjects(gps::Shader shader, bool depthPass) {
+// what a depth pass draws: the scene never moves and is cached by the shadow maps,
+// the ceiling fan turns every frame
+enum ShadowCasters { STATIC_CASTERS = 1, DYNAMIC_CASTERS = 2, ALL_CASTERS = STATIC_CASTERS | DYNAMIC_CASTERS };
+
+// RenderView::depthSlot of each shadow map, 0 is left to the depth draws without a view
+unsigned int cascadeSlot(int cascade) {
+	return 1 + cascade;
+}
+
+unsigned int pointFaceSlot(int light, int face) {
+	return 1 + gps::ShadowCascades::MAX_CASCADES + light * gps::PointShadowAtlas::FACE_COUNT + face;
+}
+
+// Draws `casters` into the bound shadow map, seen by a light through `lightView` and `lightProjection`.
+// `depthSlot` tells the shadow maps apart, the models keep the draw commands of each one
+void drawShadowCasters(gps::Shader shader, const glm::mat4& lightView, const glm::mat4& lightProjection, int resolution, int casters,
+	unsigned int depthSlot) {
+	// what the levels of detail are picked and the meshes culled for
+	gps::RenderView renderView;
+	renderView.view = lightView;
+	renderView.projection = lightProjection;
+	renderView.frustum = gps::Frustum(lightProjection * lightView);
+	renderView.viewportHeight = (float)resolution;
+	renderView.lodBias = shadowLodBias;
+	renderView.depthSlot = depthSlot;
+	renderView.stats = &shadowStats;
+
 	shader.useShaderProgram();
+	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE,
+		glm::value_ptr(lightProjection * lightView));
 	model = glm::mat4(1.0f);
 	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
-	// do not send the normal matrix if we are rendering in the depth map
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	}
-
-	// draw scena
+	// the depth pass needs no textures, so each model goes out as one multi draw call
 	GLint modelLoc = glGetUniformLocation(shader.shaderProgram, "model");
-	scene.Draw(shader);
-	rotateCeilingFan(modelLoc);
-	ceilingFan.Draw(shader);
+	if (casters & STATIC_CASTERS) {
+		scene.DrawDepth(shader, renderView);
+	}
+	if (casters & DYNAMIC_CASTERS) {
+		rotateCeilingFan(modelLoc);
+		ceilingFan.DrawDepth(shader, renderView, model);
+	}
 }
 
-void initFBO() {
-	//TODO - Create the FBO, the depth texture and attach the depth texture to the FBO
-	//generate FBO ID
-	glGenFramebuffers(1, &shadowMapFBO);
-
-	//create depth texture for FBO
-	glGenTextures(1, &depthMapTexture);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-		SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+// `shader` and the permutations the materials of the scene and the fan are drawn with (Model3D::GetMaterialPermutations),
+// each program has its own uniforms
+std::vector<gps::Shader> materialPrograms(gps::Shader shader) {
+	std::vector<gps::Shader> programs(1, shader);
+	scene.GetMaterialPermutations(shader, programs);
+	ceilingFan.GetMaterialPermutations(shader, programs);
+	return programs;
+}
 
-	// attach texture to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
+void drawObjects(gps::Shader shader) {
+	// what the levels of detail are picked and the meshes culled for
+	gps::RenderView renderView;
+	renderView.view = view;
+	renderView.projection = myCamera.getProjectionMatrix();
+	renderView.frustum = myCamera.getFrustum();
+	renderView.viewportHeight = (float)myWindow.getWindowDimensions().height;
+	renderView.lodBias = lodBias;
+	renderView.occlusion = occlusionCulling ? &occlusionCuller : NULL;
+	renderView.visibleCells = sceneCells.IsEmpty() ? NULL : &visibleCells;
+	renderView.queries = hardwareOcclusionQueries ? &occlusionQueries : NULL;
+	renderView.stats = &cameraStats;
 
-	//unbind our frame buffer, otherwise it would be the only frame buffer used by OpenGl
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	model = glm::mat4(1.0f);
+	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+	std::vector<gps::Shader> programs = materialPrograms(shader);
+	for (size_t p = 0; p < programs.size(); p++) {
+		programs[p].useShaderProgram();
+		glUniformMatrix4fv(glGetUniformLocation(programs[p].shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+		glUniformMatrix3fv(glGetUniformLocation(programs[p].shaderProgram, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	}
+	shader.useShaderProgram();
 
+	// draw scena
+	scene.Draw(shader, renderView);
+	for (size_t p = 0; p < programs.size(); p++) {
+		programs[p].useShaderProgram();
+		rotateCeilingFan(glGetUniformLocation(programs[p].shaderProgram, "model"));
+	}
+	shader.useShaderProgram();
+	ceilingFan.Draw(shader, renderView, model);
 }
 
-glm::mat4 computeLightSpaceTrMatrix() {
-	//TODO - Return the light-space transformation matrix
-	glm::mat4 lightView = glm::lookAt(glm::mat3(lightRotation) * lightDir, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+void initFBO() {
+	shadowCascades.Init(SHADOW_RESOLUTION, SHADOW_CASCADES, SHADOW_DEPTH_BITS);
+	shadowCascades.SetMaxDistance(SHADOW_DISTANCE);
+	std::cout << "Shadow cascades : " << shadowCascades.GetCascadeCount() << " x " << SHADOW_RESOLUTION << "^2, "
+		<< SHADOW_DEPTH_BITS << " bit depth (" << shadowCascades.GetMemorySize() / (1024 * 1024) << " MB)" << std::endl;
+	pointShadowAtlas.Init(POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_MIN_TILE, POINT_SHADOW_MAX_TILE);
+	std::cout << "Point shadow atlas : " << POINT_SHADOW_ATLAS_SIZE << "^2 (" << pointShadowAtlas.GetMemorySize() / (1024 * 1024)
+		<< " MB)" << std::endl;
+}
 
-	const GLfloat near_plane = 0.1f, far_plane = 50.0f;
-	// we create an orthographic projection matrix - left right top bot near far
-	// can be used to transform the vertices of the objects in the scene so that they are projected onto the screen in the correct positions.
-	glm::mat4 lightProjection = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, near_plane, far_plane);
-	glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-	return lightSpaceMatrix;
+// direction the sunlight travels in, world space
+glm::vec3 computeLightDirection() {
+	return -glm::normalize(glm::mat3(lightRotation) * lightDir);
 }
 
 void drawLights(gps::Shader shader) {
@@ -631,26 +885,120 @@ void drawLights(gps::Shader shader) {
 	}
 }
 
-void renderScene() {
-	// render the scene to the depth buffer
+void updateStatsTitle() {
+	double time = glfwGetTime();
+	statsTitleFrames++;
+	if (time - lastStatsTitleTime < 0.5) {
+		return;
+	}
+	// average over the frames since the last update
+	double frameTime = 1000.0 * (time - lastStatsTitleTime) / statsTitleFrames;
+	lastStatsTitleTime = time;
+	statsTitleFrames = 0;
+
+	char title[512];
+	snprintf(title, sizeof(title), "OpenGL Project Core - %s %.2f ms - meshes drawn/culled: camera %u/%u (%u meshlets culled, occluded %u/%u, "
+		"queries %u, results %u visible/%u), shadow %u/%u (%d/%d cascades, %d/%d point faces redrawn), "
+		"lights %d (%d cluster entries)",
+		deferredShading ? "deferred (no MSAA)" : "forward (4x MSAA)", frameTime,
+		cameraStats.meshesDrawn, cameraStats.meshesCulled, cameraStats.meshletsCulled,
+		cameraStats.meshesOccluded, cameraStats.meshletsOccluded,
+		cameraStats.queriesIssued, cameraStats.queryResultsVisible, cameraStats.queryResults,
+		shadowStats.meshesDrawn, shadowStats.meshesCulled,
+		shadowCascades.GetStaticRedrawCount(), shadowCascades.GetCascadeCount(),
+		pointShadowAtlas.GetStaticRedrawCount(), pointShadowAtlas.GetActiveFaceCount(),
+		lightManager.GetVisibleLightCount(), lightManager.GetClusterEntryCount());
+	glfwSetWindowTitle(myWindow.getWindow(), title);
+}
 
-	depthMapShader.useShaderProgram();
+// lights, shadows and fog of shaderStart.frag, forward and DEFERRED
+void setLightingUniforms(gps::Shader shader) {
+	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(myCamera.getProjectionMatrix()));
+	glUniform3fv(glGetUniformLocation(shader.shaderProgram, "lightDir"), 1,
+		glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
+	glUniform3fv(glGetUniformLocation(shader.shaderProgram, "lightColor"), 1, glm::value_ptr(lightColor));
+	glUniform1f(glGetUniformLocation(shader.shaderProgram, "fogDensity"), fogDensity);
+
+	//bind the shadow cascades, the point light shadows and the clustered lights
+	shadowCascades.SetUniforms(shader, 3);
+	pointShadowAtlas.SetUniforms(shader, 4);
+	lightManager.SetUniforms(shader, 5);
+}
 
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-	glCheckError();
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glCheckError();
-	glClear(GL_DEPTH_BUFFER_BIT);
-	glCheckError();
-	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"),
-		1,
-		GL_FALSE,
-		glm::value_ptr(computeLightSpaceTrMatrix()));
+// shader features of this frame's lighting (see Shader::getPermutation), without the code of what is off
+std::string lightingFeatures() {
+	std::string features;
+	if (fogDensity > 0.0f) {
+		features += " FOG";
+	}
+	if (lightManager.GetVisibleLightCount() > 0) {
+		features += " CLUSTERED_LIGHTS";
+	}
+	return features;
+}
+
+void renderScene() {
+	cameraStats.Reset();
+	shadowStats.Reset();
+	// the fan turns as fast as when it moved a step in the shadow pass and one in the camera pass
+	angle += 0.02f;
 
+	// render the scene to the depth buffer of each cascade
+
+	depthMapShader.useShaderProgram();
+	shadowCascades.Update(myCamera.getViewMatrix(), myCamera.getProjectionMatrix(), computeLightDirection());
+
+	for (int cascade = 0; cascade < shadowCascades.GetCascadeCount(); cascade++) {
+		glm::mat4 cascadeView = shadowCascades.GetViewMatrix();
+		glm::mat4 cascadeProjection = shadowCascades.GetProjectionMatrix(cascade);
+		// the scene is only redrawn when the light or the cascade moved
+		if (shadowCascades.BeginStaticCascade(cascade)) {
+			drawShadowCasters(depthMapShader, cascadeView, cascadeProjection, shadowCascades.GetResolution(), STATIC_CASTERS, cascadeSlot(cascade));
+			glCheckError();
+		}
+		shadowCascades.BeginCascade(cascade);
+		glCheckError();
+		drawShadowCasters(depthMapShader, cascadeView, cascadeProjection, shadowCascades.GetResolution(), DYNAMIC_CASTERS, cascadeSlot(cascade));
+		glCheckError();
+	}
+	shadowCascades.EndCascades();
 	glCheckError();
 
-	drawObjects(depthMapShader, true);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	updateLights();
+	// the lights with shadows that are on, into the faces of their cubes the camera can see
+	for (int l = 0; l < lightManager.GetLightCount(); l++) {
+		const gps::LightSource& light = lightManager.GetLight(l);
+		if (light.shadowIndex < 0) {
+			continue;
+		}
+		if (light.enabled) {
+			pointShadowAtlas.SetLight(light.shadowIndex, light.position, light.range, 1.0f);
+		}
+		else {
+			pointShadowAtlas.DisableLight(light.shadowIndex);
+		}
+	}
+	// the cells the camera sees also skip the cube faces whose light only reaches hidden rooms
+	if (!sceneCells.IsEmpty()) {
+		sceneCells.ComputeVisibleCells(myCamera.getProjectionMatrix() * myCamera.getViewMatrix(), myCamera.getCameraPosition(), visibleCells);
+	}
+	pointShadowAtlas.Update(myCamera.getFrustum(), myCamera.getCameraPosition(), myCamera.getProjectionMatrix(),
+		&sceneCells, &visibleCells);
+	for (int light = 0; light < gps::PointShadowAtlas::MAX_LIGHTS; light++) {
+		for (int face = 0; face < gps::PointShadowAtlas::FACE_COUNT; face++) {
+			const gps::PointShadowFace& tile = pointShadowAtlas.GetFace(light, face);
+			if (!tile.active) {
+				continue;
+			}
+			if (pointShadowAtlas.BeginStaticFace(light, face)) {
+				drawShadowCasters(depthMapShader, tile.view, tile.projection, tile.size, STATIC_CASTERS, pointFaceSlot(light, face));
+			}
+			pointShadowAtlas.BeginFace(light, face);
+			drawShadowCasters(depthMapShader, tile.view, tile.projection, tile.size, DYNAMIC_CASTERS, pointFaceSlot(light, face));
+		}
+	}
+	pointShadowAtlas.EndFaces();
 	glCheckError();
 
 	if (showDepthMap) {
@@ -660,57 +1008,85 @@ void renderScene() {
 
 		screenQuadShader.useShaderProgram();
 
-		//bind the depth map
+		//bind the depth map, the raw depths are shown instead of the comparison results
+		shadowCascades.SetComparison(false);
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, depthMapTexture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, shadowCascades.GetTexture());
 		glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
+		glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "layer"), shownCascade);
 
 		glDisable(GL_DEPTH_TEST);
 		screenQuad.Draw(screenQuadShader);
 		glEnable(GL_DEPTH_TEST);
+		shadowCascades.SetComparison(true);
 
 	}
 	else {
 
-		// final scene rendering pass (with shadows)
-		glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
-		glCheckError();
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glCheckError();
-		myBasicShader.useShaderProgram();
 		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		glCheckError();
+
+		if (occlusionCulling) {
+			occlusionCuller.Render(myCamera.getProjectionMatrix() * view);
+		}
+		occlusionQueries.BeginFrame();
 
 		// position of directional light (sun in our case)
 		lightDir = glm::vec3(10.0f, 20.0f, 10.0f);
 		lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-		lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-		glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
-
-		fogDensityLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fogDensity");
-		glUniform1f(fogDensityLoc, fogDensity);
-
-		/*pointLightPos1 = glm::vec3(2.0743f, 4.7439f, 13.469f);
-		pointLightPos1Loc = glGetUniformLocation(myBasicShader.shaderProgram, "lightPos1");
-		glUniform3fv(pointLightPos1Loc, 1, glm::value_ptr(pointLightPos1));
-
-		activatePointLight = 0;
-		activatePointLightLoc = glGetUniformLocation(myBasicShader.shaderProgram, "havePointLight");
-		glUniform1i(activatePointLightLoc, activatePointLight);*/
-
-		glCheckError();
-		//bind the shadow map
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-		glUniform1i(glGetUniformLocation(myBasicShader.shaderProgram, "shadowMap"), 3);
 
-		glUniformMatrix4fv(glGetUniformLocation(myBasicShader.shaderProgram, "lightSpaceTrMatrix"),
-			1,
-			GL_FALSE,
-			glm::value_ptr(computeLightSpaceTrMatrix()));
-
-		drawObjects(myBasicShader, false);
+		lightManager.Update(view, myCamera.getProjectionMatrix(), myWindow.getWindowDimensions().width,
+			myWindow.getWindowDimensions().height);
+
+		if (deferredShading) {
+			// the scene into the G-buffer
+			gBuffer.Resize(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+			gBuffer.BindForWriting();
+			std::vector<gps::Shader> gbufferPrograms = materialPrograms(gbufferShader);
+			for (size_t p = 0; p < gbufferPrograms.size(); p++) {
+				gbufferPrograms[p].useShaderProgram();
+				glUniformMatrix4fv(glGetUniformLocation(gbufferPrograms[p].shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+				glUniformMatrix4fv(glGetUniformLocation(gbufferPrograms[p].shaderProgram, "projection"), 1, GL_FALSE,
+					glm::value_ptr(myCamera.getProjectionMatrix()));
+			}
+			drawObjects(gbufferShader);
+			glCheckError();
+
+			// the lights, shadows and fog once per pixel
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			gps::Shader lightingShader = deferredShader.getPermutation(lightingFeatures());
+			lightingShader.useShaderProgram();
+			setLightingUniforms(lightingShader);
+			glUniformMatrix4fv(glGetUniformLocation(lightingShader.shaderProgram, "inverseProjection"), 1, GL_FALSE,
+				glm::value_ptr(glm::inverse(myCamera.getProjectionMatrix())));
+			glUniformMatrix4fv(glGetUniformLocation(lightingShader.shaderProgram, "inverseView"), 1, GL_FALSE,
+				glm::value_ptr(glm::inverse(view)));
+			gBuffer.BindTextures(lightingShader, GBUFFER_TEXTURE_UNIT);
+			// the quad writes the depth of the G-buffer (gl_FragDepth), the light cubes and the sky are drawn
+			// forward against it - a blit cannot resolve into the multisampled window
+			glDepthFunc(GL_ALWAYS);
+			screenQuad.Draw(lightingShader);
+			glDepthFunc(GL_LESS);
+			glCheckError();
+		}
+		else {
+			// final scene rendering pass (with shadows)
+			glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+			glCheckError();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glCheckError();
+			// each material draws with its permutation of this one (Model3D::DrawMeshRuns), all get the uniforms once per frame
+			gps::Shader lightingShader = myBasicShader.getPermutation(lightingFeatures());
+			std::vector<gps::Shader> lightingPrograms = materialPrograms(lightingShader);
+			for (size_t p = 0; p < lightingPrograms.size(); p++) {
+				lightingPrograms[p].useShaderProgram();
+				setLightingUniforms(lightingPrograms[p]);
+			}
+			glCheckError();
+
+			drawObjects(lightingShader);
+		}
 
 		//draw a white cube around the light
 		lightShader.useShaderProgram();
@@ -731,6 +1107,59 @@ void renderScene() {
 
 
 
+// OBJ parse throughput on the models of the scene, run with --parse-benchmark instead of opening the window
+int runParseBenchmark() {
+	const char* fileNames[] = {
+		"objects/scene/scene_no_sky.obj",
+		"objects/scene/ceiling_fan_2.obj",
+		"objects/scene/tank.obj",
+		"objects/car/ford_mustang_gt1967.obj",
+		"objects/cube/cube.obj"
+	};
+	const int runs = 5;
+
+	for (size_t f = 0; f < sizeof(fileNames) / sizeof(fileNames[0]); f++) {
+		gps::MappedFile file;
+		if (!file.Open(fileNames[f])) {
+			std::cout << fileNames[f] << " : not found" << std::endl;
+			continue;
+		}
+		std::string fileName = fileNames[f];
+		tinyobj::MaterialFileReader materialReader(fileName.substr(0, fileName.find_last_of('/')) + "/");
+
+		// the best of a few runs over the mapped file, so the disk is out of the measure
+		double bestTime = 0.0;
+		for (int run = 0; run < runs; run++) {
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> materials;
+			std::string err;
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			tinyobj::LoadObjParallel(&attrib, &shapes, &materials, &err, (const char*)file.GetData(), file.GetSize(),
+				&materialReader, true);
+			double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			bestTime = run == 0 ? time : std::min(bestTime, time);
+		}
+
+		double megabytes = (double)file.GetSize() / (1024.0 * 1024.0);
+		std::cout << fileNames[f] << " : " << megabytes << " MB in " << bestTime << " ms";
+		if (bestTime > 0.0) {
+			std::cout << " (" << megabytes / (bestTime / 1000.0) << " MB/s)";
+		}
+		std::cout << std::endl;
+
+		// the number kernel alone, against the digit by digit parser it replaced
+		double fastTime = 0.0, digitsTime = 0.0;
+		size_t numbers = tinyobj::BenchmarkNumberParsing((const char*)file.GetData(), file.GetSize(), runs, &fastTime, &digitsTime);
+		std::cout << "  " << numbers << " numbers: " << fastTime << " ms, digit by digit " << digitsTime << " ms";
+		if (fastTime > 0.0) {
+			std::cout << " (" << digitsTime / fastTime << "x)";
+		}
+		std::cout << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
+
 void cleanup() {
 	myWindow.Delete();
 	//cleanup code for your own data
@@ -738,6 +1167,10 @@ void cleanup() {
 
 int main(int argc, const char* argv[]) {
 
+	if (argc > 1 && std::string(argv[1]) == "--parse-benchmark") {
+		return runParseBenchmark();
+	}
+
 	try {
 		initOpenGLWindow();
 	}
@@ -751,6 +1184,7 @@ int main(int argc, const char* argv[]) {
 	initModels();
 	initShaders();
 	initUniforms();
+	initLights();
 	//glCheckError();
 	setWindowCallbacks();
 	initSkyBox();
@@ -761,6 +1195,7 @@ int main(int argc, const char* argv[]) {
 		processMovement();
 		glCheckError();
 		renderScene();
+		updateStatsTitle();
 		glCheckError();
 		glfwPollEvents();
 		glCheckError();
@@ -4,7 +4,11 @@ layout(location=0) in vec3 vPosition;
 uniform mat4 lightSpaceTrMatrix;
 uniform mat4 model;
 
+// compressed vertices: positions in [0, 1] inside the model bounds
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 void main()
 {
- gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+ gl_Position = lightSpaceTrMatrix * model * vec4(positionOffset + positionScale * vPosition, 1.0f);
 }
@@ -0,0 +1,37 @@
+#version 410 core
+
+// Geometry pass of the deferred path, after shaderStart.vert. Feature, defined by Shader::getPermutation:
+// SPECULAR_TEXTURE (without it the specular intensity is 0)
+
+in vec3 fNormal;
+in vec4 fPosEye;
+in vec2 fTexCoords;
+in vec4 fPosWorld;
+
+// G-buffer (GBuffer.hpp): albedo and specular intensity, octahedral eye space normal
+layout(location=0) out vec4 gAlbedoSpecular;
+layout(location=1) out vec2 gNormal;
+
+uniform sampler2D diffuseTexture;
+uniform sampler2D specularTexture;
+
+vec2 encodeOctahedral(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.xy;
+	if (n.z < 0.0f)
+		e = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+	return e;
+}
+
+void main()
+{
+	// the specular texture is kept as its luminance
+#ifdef SPECULAR_TEXTURE
+	float specular = dot(texture(specularTexture, fTexCoords).rgb, vec3(0.299f, 0.587f, 0.114f));
+#else
+	float specular = 0.0f;
+#endif
+	gAlbedoSpecular = vec4(texture(diffuseTexture, fTexCoords).rgb, specular);
+	gNormal = encodeOctahedral(normalize(fNormal));
+}
@@ -0,0 +1,9 @@
+#version 410 core
+
+out vec4 fColor;
+
+void main()
+{
+	// only the samples passing the depth test are counted, nothing is written
+	fColor = vec4(1.0f);
+}
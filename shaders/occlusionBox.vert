@@ -0,0 +1,11 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+
+// projection * view * model, times the scale and offset of the box
+uniform mat4 boxMatrix;
+
+void main()
+{
+	gl_Position = boxMatrix * vec4(vPosition, 1.0f);
+}
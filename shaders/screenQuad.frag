@@ -4,10 +4,12 @@ in vec2 fTexCoords;
 
 out vec4 fColor;
 
-uniform sampler2D depthMap;
+// the shadow cascades, read without depth comparison
+uniform sampler2DArray depthMap;
+uniform int layer;
 
 void main() 
 {    
-    fColor = vec4(vec3(texture(depthMap, fTexCoords).r), 1.0f);
+    fColor = vec4(vec3(texture(depthMap, vec3(fTexCoords, float(layer))).r), 1.0f);
     //fColor = vec4(fTexCoords, 0.0f, 1.0f);
 }
@@ -1,10 +1,28 @@
 #version 410 core
 
+// features, defined by Shader::getPermutation: FOG, CLUSTERED_LIGHTS, SPECULAR_TEXTURE (without it the
+// material has no specular term), DEFERRED (the lighting pass of the deferred path, drawn with screenQuad.vert:
+// the inputs are read from the G-buffer once per pixel)
+
+#ifdef DEFERRED
+// G-buffer (GBuffer::BindTextures): albedo and specular intensity, octahedral eye space normal, depth
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+// the inputs of the forward path, rebuilt from the G-buffer
+vec3 fNormal;
+vec4 fPosEye;
+vec4 fPosWorld;
+#else
 // fragCoords
 in vec3 fNormal;
 in vec4 fPosEye;
+in vec4 fPosWorld;
+#endif
 in vec2 fTexCoords;
-in vec4 fragPosLightSpace;
 
 out vec4 fColor;
 
@@ -12,17 +30,40 @@ out vec4 fColor;
 uniform	vec3 lightDir;
 uniform	vec3 lightColor;
 
-// lighting++
-uniform int havePointLight;
-uniform int haveDirLight;
-uniform vec3 lightPos1;
-uniform vec3 lightPos2;
-uniform vec3 lightPos3;
+// clustered point and spot lights (LightManager::SetUniforms): 4 texels per light, eye position and range,
+// color and type (1 for spot lights), eye direction and cosine of the outer angle, cosine of the inner angle and shadow index
+uniform samplerBuffer lightData;
+// first entry in clusterLightIndices and count of each cluster
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLightIndices;
+uniform ivec3 clusterCounts;
+uniform vec2 clusterTileSize;
+// depth slice = log(depth) * clusterDepthScale + clusterDepthBias
+uniform float clusterDepthScale;
+uniform float clusterDepthBias;
 
 // texture
+#ifndef DEFERRED
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
-uniform sampler2D shadowMap;
+#endif
+uniform sampler2DArrayShadow shadowMap;
+
+// cascaded shadow maps (ShadowCascades::SetUniforms)
+uniform int cascadeCount;
+// far end of each cascade, as a distance in front of the camera
+uniform vec4 cascadeSplits;
+uniform vec4 cascadeBias;
+uniform mat4 lightSpaceTrMatrices[4];
+
+// shadows of the point lights (PointShadowAtlas::SetUniforms)
+uniform sampler2DShadow pointShadowAtlas;
+// position of each light, w scales the normal offset and is 0 for the lights without shadows
+uniform vec4 pointShadowLights[3];
+// from world space to the tile of each face, 6 per light
+uniform mat4 pointShadowMatrices[18];
+// bit f is set when face f of the light has a tile this frame
+uniform int pointShadowFaceMasks[3];
 
 // fog
 uniform float fogDensity;
@@ -53,48 +94,83 @@ float computeFog()
 
 float computeShadow()
 {
-	// perform perspective divide
-	vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-
-	// Transform to [0,1] range
-	normalizedCoords = normalizedCoords * 0.5 + 0.5;
+	// the first cascade whose slice of the view frustum holds the fragment
+	float depth = -fPosEye.z;
+	if (cascadeCount == 0 || depth > cascadeSplits[cascadeCount - 1])
+		return 0.0f;
+	int cascade = 0;
+	while (cascade < cascadeCount - 1 && depth > cascadeSplits[cascade])
+		cascade++;
 
+	vec4 fragPosLightSpace = lightSpaceTrMatrices[cascade] * fPosWorld;
+	vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5 + 0.5;
 	if (normalizedCoords.z > 1.0f)
 		return 0.0f;
 
-	// Get closest depth value from light's perspective
-	float closestDepth = texture(shadowMap, normalizedCoords.xy).r;
+	// surfaces at grazing angles to the light need more bias
+	float NdotL = max(dot(normalize(fNormal), normalize(lightDir)), 0.0f);
+	float bias = cascadeBias[cascade] * (2.0f - NdotL);
 
-	// Get depth of current fragment from light's perspective
-	float currentDepth = normalizedCoords.z;
+	// the hardware compares the depths, linear filtering averages 2x2 of the results
+	return 1.0f - texture(shadowMap, vec4(normalizedCoords.xy, float(cascade), normalizedCoords.z - bias));
+}
 
-	// Check whether current frag pos is in shadow
-	float bias = 0.005f;
-	float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
+float computePointShadow(int light)
+{
+	vec4 shadowLight = pointShadowLights[light];
+	if (shadowLight.w == 0.0f)
+		return 0.0f;
 
-	return shadow;
-	
+	// pushed along the normal by about a texel of the tile, against acne
+	vec3 normalWorld = transpose(mat3(view)) * normalize(fNormal);
+	vec3 position = fPosWorld.xyz + normalWorld * length(fPosWorld.xyz - shadowLight.xyz) * shadowLight.w;
+	vec3 toFragment = position - shadowLight.xyz;
+
+	// the face of the cube the fragment is seen through
+	vec3 axis = abs(toFragment);
+	int face;
+	if (axis.x >= axis.y && axis.x >= axis.z)
+		face = toFragment.x >= 0.0f ? 0 : 1;
+	else if (axis.y >= axis.z)
+		face = toFragment.y >= 0.0f ? 2 : 3;
+	else
+		face = toFragment.z >= 0.0f ? 4 : 5;
+
+	// the faces without a tile have no matrix to sample with
+	if ((pointShadowFaceMasks[light] & (1 << face)) == 0)
+		return 0.0f;
+
+	vec4 atlasPos = pointShadowMatrices[light * 6 + face] * vec4(position, 1.0f);
+	vec3 atlasCoords = atlasPos.xyz / atlasPos.w;
+	if (atlasCoords.z > 1.0f)
+		return 0.0f;
+	return 1.0f - texture(pointShadowAtlas, atlasCoords);
 }
 
-// point light
-vec3 computePointLight(vec4 lightPosEye)
+// point or spot light `light` of lightData
+vec3 computePointLight(int light)
 {
+	vec4 positionRange = texelFetch(lightData, light * 4);
+	vec4 colorType = texelFetch(lightData, light * 4 + 1);
+	vec4 spotDirection = texelFetch(lightData, light * 4 + 2);
+	vec4 spotShadow = texelFetch(lightData, light * 4 + 3);
+
 	vec3 cameraPosEye = vec3(0.0f); //in eye coordinates, the viewer is situated at the origin
 
 	//transform normal
 	vec3 normalEye = normalize(fNormal);
 
 	//compute light direction
-	vec3 lightDirN = normalize(lightPosEye.xyz - fPosEye.xyz);
+	vec3 lightDirN = normalize(positionRange.xyz - fPosEye.xyz);
 
 	//compute view direction 
 	vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
 
 	//compute ambient light
-	vec3 ambient = ambientPointStrength * lightColor;
+	vec3 ambient = ambientPointStrength * colorType.rgb;
 
 	//compute diffuse light
-	vec3 diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+	vec3 diffuse = max(dot(normalEye, lightDirN), 0.0f) * colorType.rgb;
 
 	//compute half vector
 	vec3 halfVector = normalize(lightDirN + viewDirN);
@@ -102,11 +178,32 @@ vec3 computePointLight(vec4 lightPosEye)
 	//compute specular coefficient and specular light
 	vec3 reflection = reflect(-lightDirN, normalEye);
 	float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
-	vec3 specular = specularPointStrength * specCoeff * lightColor;
+	vec3 specular = specularPointStrength * specCoeff * colorType.rgb;
 
-	float distance = length(lightPosEye.xyz - fPosEye.xyz);
+	float distance = length(positionRange.xyz - fPosEye.xyz);
 	float att = 1.0f / (constant + linear * distance + quadratic * distance * distance);
-	return (ambient + diffuse + specular) * att * vec3(2.0f,2.0f,2.0f);
+	// faded out towards the range, the clusters hold no light past it
+	float fade = clamp(1.0f - pow(distance / positionRange.w, 4.0f), 0.0f, 1.0f);
+	att *= fade * fade;
+	if (colorType.w > 0.5f)
+		att *= smoothstep(spotDirection.w, spotShadow.x, dot(-lightDirN, spotDirection.xyz));
+
+	float shadow = spotShadow.y >= 0.0f ? computePointShadow(int(spotShadow.y)) : 0.0f;
+	return (ambient + (1.0f - shadow) * (diffuse + specular)) * att;
+}
+
+// the lights of the cluster holding the fragment
+vec3 computeClusteredLights()
+{
+	ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(max(log(-fPosEye.z) * clusterDepthScale + clusterDepthBias, 0.0f)));
+	cluster = min(cluster, clusterCounts - 1);
+	uvec2 lights = texelFetch(clusterGrid, (cluster.z * clusterCounts.y + cluster.y) * clusterCounts.x + cluster.x).rg;
+
+	vec3 result = vec3(0.0f);
+	for (uint i = 0u; i < lights.y; i++) {
+		result += computePointLight(int(texelFetch(clusterLightIndices, int(lights.x + i)).r));
+	}
+	return result;
 }
 
 vec3 computeLightComponents()
@@ -136,43 +233,61 @@ vec3 computeLightComponents()
 	return ambient + diffuse + specular;
 }
 
-void main() 
+#ifdef DEFERRED
+vec3 decodeOctahedral(vec2 e)
 {
-	vec3 initialLight;
-	if (haveDirLight == 0) {
-		initialLight = computeLightComponents();
-	}
-	if (haveDirLight == 1) {
-		initialLight = computeLightComponents();
-	}
-	if (haveDirLight == 2) {
-		initialLight = vec3(1.0f, 0.0f, 0.0f);
-	}
-	
-	vec4 pointLightPos1 = view * vec4(lightPos1, 1.0f);
-	vec4 pointLightPos2 = view * vec4(lightPos2, 1.0f);
-	vec4 pointLightPos3 = view * vec4(lightPos3, 1.0f);
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+#endif
 
-	if (havePointLight == 1 || havePointLight == 4) {
-		initialLight += computePointLight(pointLightPos1);
-	}
-	if (havePointLight == 2 || havePointLight == 4) {
-		initialLight += computePointLight(pointLightPos2);
-	}
-	if (havePointLight == 3 || havePointLight == 4) {
-		initialLight += computePointLight(pointLightPos3);
-	}	
+void main() 
+{
+#ifdef DEFERRED
+	// the sky is drawn after the lighting pass
+	float depth = texture(gDepth, fTexCoords).r;
+	if (depth == 1.0f)
+		discard;
+	// the depth of the scene for the light cubes and the sky drawn forward after this pass
+	gl_FragDepth = depth;
+	fPosEye = inverseProjection * vec4(vec3(fTexCoords, depth) * 2.0f - 1.0f, 1.0f);
+	fPosEye /= fPosEye.w;
+	fPosWorld = inverseView * fPosEye;
+	fNormal = decodeOctahedral(texture(gNormal, fTexCoords).xy);
+	vec4 albedoSpecular = texture(gAlbedoSpecular, fTexCoords);
+#endif
+
+	vec3 initialLight = computeLightComponents();
+#ifdef CLUSTERED_LIGHTS
+	initialLight += computeClusteredLights();
+#endif
 
-	float fogFactor = computeFog();
 	vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
 	vec3 baseColor = vec3(0.9f, 0.35f, 0.0f); //orange
 	
+#ifdef DEFERRED
+	ambient *= albedoSpecular.rgb;
+	diffuse *= albedoSpecular.rgb;
+	specular *= albedoSpecular.a;
+#else
 	ambient *= texture(diffuseTexture, fTexCoords).rgb;
 	diffuse *= texture(diffuseTexture, fTexCoords).rgb;
+#ifdef SPECULAR_TEXTURE
 	specular *= texture(specularTexture, fTexCoords).rgb;
+#else
+	specular = vec3(0.0f);
+#endif
+#endif
 
 	float shadow = computeShadow();
 	vec3 color = min((ambient + (1.0f - shadow)*diffuse) + (1.0f - shadow)*specular, 1.0f);
 	vec4 colorVec = vec4(color * initialLight, 1.0f);
-	fColor = mix(fogColor, colorVec, fogFactor);
+#ifdef FOG
+	fColor = mix(fogColor, colorVec, computeFog());
+#else
+	fColor = colorVec;
+#endif
 }
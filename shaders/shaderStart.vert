@@ -7,20 +7,38 @@ layout(location=2) in vec2 vTexCoords;
 out vec3 fNormal;
 out vec4 fPosEye;
 out vec2 fTexCoords;
-out vec4 fragPosLightSpace;
+// world space position, the shadow cascades are looked up in the fragment shader
+out vec4 fPosWorld;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform	mat3 normalMatrix;
-uniform mat4 lightSpaceTrMatrix;
+
+// compressed vertices: positions in [0, 1] inside the model bounds, octahedral normals in vNormal.xy
+// (offset 0, scale 1 and no octahedral normals for the full float layout)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool octahedralNormals;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
 
 void main() 
 {
+	vec4 position = vec4(positionOffset + positionScale * vPosition, 1.0f);
+	vec3 normal = octahedralNormals ? decodeOctahedral(vNormal.xy) : vNormal;
+
 	//compute eye space coordinates
-	fPosEye = view * model * vec4(vPosition, 1.0f);
-	fNormal = normalize(normalMatrix * vNormal);
+	fPosEye = view * model * position;
+	fNormal = normalize(normalMatrix * normal);
 	fTexCoords = vTexCoords;
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	gl_Position = projection * view * model * position;
+	fPosWorld = model * position;
 }
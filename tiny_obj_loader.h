@@ -228,10 +228,43 @@ namespace tinyobj {
                  std::istream *inStream, MaterialReader *readMatFn = NULL,
                  bool triangulate = true);
     
+    /// Loads .obj from a file like LoadObj(), but splits the file into
+    /// newline-aligned chunks whose `v`, `vn`, `vt` and `f` lines are parsed on
+    /// `num_threads` worker threads (0 = one per hardware thread).
+    /// The .obj and .mtl files are memory mapped and tokenized in place.
+    /// The chunks are merged in file order, so the output is identical to
+    /// LoadObj(), including `usemtl`/`g`/`o` shape boundaries and relative
+    /// (negative) face indices.
+    bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+                         std::vector<material_t> *materials, std::string *err,
+                         const char *filename, const char *mtl_basepath = NULL,
+                         bool triangulate = true, unsigned int num_threads = 0);
+    
+    /// Parallel variant of LoadObj() over an in-memory .obj buffer of `len` bytes.
+    /// The buffer does not need to be NUL terminated.
+    bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+                         std::vector<material_t> *materials, std::string *err,
+                         const char *buf, size_t len,
+                         MaterialReader *readMatFn = NULL,
+                         bool triangulate = true, unsigned int num_threads = 0);
+    
     /// Loads materials into std::map
     void LoadMtl(std::map<std::string, int> *material_map,
                  std::vector<material_t> *materials, std::istream *inStream);
     
+    /// Loads materials from an in-memory .mtl buffer of `len` bytes, which does
+    /// not need to be NUL terminated. Tokens are read in place, without copying
+    /// the buffer line by line.
+    void LoadMtl(std::map<std::string, int> *material_map,
+                 std::vector<material_t> *materials, const char *buf, size_t len);
+    
+    /// Times the number parser of the loader on the `v`, `vn` and `vt` values of
+    /// an in-memory .obj buffer against the digit by digit parser it replaced,
+    /// the best of `runs` passes over the same numbers for each. Returns the
+    /// count of numbers parsed per pass.
+    size_t BenchmarkNumberParsing(const char *buf, size_t len, int runs,
+                                  double *fast_ms, double *digits_ms);
+    
 }  // namespace tinyobj
 
 #ifdef TINYOBJLOADER_IMPLEMENTATION
@@ -243,8 +276,16 @@ namespace tinyobj {
 #include <cstring>
 #include <utility>
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <iterator>
 #include <sstream>
+#include <thread>
+
+// the .obj and .mtl files are memory mapped, so the tokenizers run over the file bytes
+// without copying them into line buffers
+#include "MappedFile.hpp"
 
 namespace tinyobj {
     
@@ -320,47 +361,76 @@ namespace tinyobj {
     static inline std::string parseString(const char **token) {
         std::string s;
         (*token) += strspn((*token), " \t");
-        size_t e = strcspn((*token), " \t\r");
+        size_t e = strcspn((*token), " \t\r\n");
         s = std::string((*token), &(*token)[e]);
         (*token) += e;
         return s;
     }
     
+    // Returns [token, line_end) of a line whose trailing space is already
+    // trimmed. `token` may point one past `line_end` after a keyword.
+    static inline std::string parseRestOfLine(const char *token,
+                                              const char *line_end) {
+        if (token >= line_end) return std::string();
+        return std::string(token, line_end);
+    }
+    
+    // Parses a decimal integer like atoi(): optional sign, then digits up to the
+    // first non-digit. Leading white space must already be skipped.
+    static inline int fastAtoi(const char *s) {
+        bool negative = false;
+        if ((*s) == '-' || (*s) == '+') {
+            negative = ((*s) == '-');
+            s++;
+        }
+        
+        // negative values are accumulated below zero, so INT_MIN does not overflow
+        int value = 0;
+        while (IS_DIGIT(*s)) {
+            int digit = (*s) - '0';
+            value = negative ? value * 10 - digit : value * 10 + digit;
+            s++;
+        }
+        
+        return value;
+    }
+    
     static inline int parseInt(const char **token) {
         (*token) += strspn((*token), " \t");
-        int i = atoi((*token));
-        (*token) += strcspn((*token), " \t\r");
+        int i = fastAtoi((*token));
+        (*token) += strcspn((*token), " \t\r\n");
         return i;
     }
     
-    // Tries to parse a floating point number located at s.
-    //
-    // s_end should be a location in the string where reading should absolutely
-    // stop. For example at the end of the string, to prevent buffer overflows.
-    //
-    // Parses the following EBNF grammar:
-    //   sign    = "+" | "-" ;
-    //   END     = ? anything not in digit ?
-    //   digit   = "0" | "1" | "2" | "3" | "4" | "5" | "6" | "7" | "8" | "9" ;
-    //   integer = [sign] , digit , {digit} ;
-    //   decimal = integer , ["." , integer] ;
-    //   float   = ( decimal , END ) | ( decimal , ("E" | "e") , integer , END ) ;
-    //
-    //  Valid strings are for example:
-    //   -0  +3.1417e+2  -0.0E-3  1.0324  -1.41   11e2
-    //
-    // If the parsing is a success, result is set to the parsed value and true
-    // is returned.
-    //
-    // The function is greedy and will parse until any of the following happens:
-    //  - a non-conforming character is encountered.
-    //  - s_end is reached.
-    //
-    // The following situations triggers a failure:
-    //  - s >= s_end.
-    //  - parse failure.
-    //
-    static bool tryParseDouble(const char *s, const char *s_end, double *result) {
+    // Returns true when the 8 bytes packed in `chunk` (little endian) are all
+    // ASCII digits.
+    static inline bool isEightDigits(unsigned long long chunk) {
+        return (((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+                 (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+                0x3333333333333333ULL);
+    }
+    
+    // Converts 8 ASCII digits packed in `chunk` (little endian) to their value,
+    // using SWAR (SIMD within a register) multiplications instead of a loop.
+    static inline unsigned long long parseEightDigits(unsigned long long chunk) {
+        const unsigned long long mask = 0x000000FF000000FFULL;
+        const unsigned long long mul1 = 0x000F424000000064ULL;  // 100 + (1000000 << 32)
+        const unsigned long long mul2 = 0x0000271000000001ULL;  // 1 + (10000 << 32)
+        chunk -= 0x3030303030303030ULL;
+        chunk = (chunk * 10) + (chunk >> 8);
+        chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+        return chunk;
+    }
+    
+    static inline bool isLittleEndian() {
+        const unsigned int one = 1;
+        return (*reinterpret_cast<const unsigned char *>(&one)) == 1;
+    }
+    
+    // The digit by digit parser the loader used before the fast path below: locale
+    // independent and without a length limit, accurate to a few ulps. Same
+    // grammar and result convention as tryParseDouble().
+    static bool tryParseDoubleDigits(const char *s, const char *s_end, double *result) {
         if (s >= s_end) {
             return false;
         }
@@ -480,10 +550,168 @@ namespace tinyobj {
     fail:
         return false;
     }
+
+    
+    // Tries to parse a floating point number located at s.
+    //
+    // s_end should be a location in the string where reading should absolutely
+    // stop. For example at the end of the string, to prevent buffer overflows.
+    //
+    // Parses the following EBNF grammar:
+    //   sign    = "+" | "-" ;
+    //   END     = ? anything not in digit ?
+    //   digit   = "0" | "1" | "2" | "3" | "4" | "5" | "6" | "7" | "8" | "9" ;
+    //   integer = [sign] , digit , {digit} ;
+    //   decimal = integer , ["." , integer] ;
+    //   float   = ( decimal , END ) | ( decimal , ("E" | "e") , integer , END ) ;
+    //
+    //  Valid strings are for example:
+    //   -0  +3.1417e+2  -0.0E-3  1.0324  -1.41   11e2
+    //
+    // If the parsing is a success, result is set to the parsed value and true
+    // is returned.
+    //
+    // The function is greedy and will parse until any of the following happens:
+    //  - a non-conforming character is encountered.
+    //  - s_end is reached.
+    //
+    // The following situations triggers a failure:
+    //  - s >= s_end.
+    //  - parse failure.
+    //
+    // The digits are gathered into a 64-bit integer mantissa and a decimal
+    // exponent (8 fraction digits at a time when possible). When the mantissa is exact
+    // and fits in 53 bits and the exponent is within [-22, 22], both operands of
+    // the final multiplication/division are exact doubles, so the single IEEE
+    // operation yields the correctly rounded result (Clinger's fast path, as in
+    // fast_float). Anything else - more than 19 significant digits, huge
+    // exponents - falls back to tryParseDoubleDigits(), which unlike strtod()
+    // neither depends on LC_NUMERIC nor needs the token copied.
+    //
+    static bool tryParseDouble(const char *s, const char *s_end, double *result) {
+        if (s >= s_end) {
+            return false;
+        }
+        
+        const char *curr = s;
+        bool negative = false;
+        
+        // Find out what sign we've got.
+        if (*curr == '+' || *curr == '-') {
+            negative = (*curr == '-');
+            curr++;
+        } else if (IS_DIGIT(*curr)) { /* Pass through. */
+        } else {
+            return false;
+        }
+        
+        // Gather all digits into one integer mantissa. It wraps around after 19
+        // digits, such numbers are sent to the slow path below.
+        unsigned long long mantissa = 0;
+        int exponent = 0;
+        
+        // Read the integer part.
+        const char *digits_begin = curr;
+        while (curr != s_end && IS_DIGIT(*curr)) {
+            mantissa = mantissa * 10 + static_cast<unsigned long long>(*curr - '0');
+            curr++;
+        }
+        
+        // We must make sure we actually got something.
+        if (curr == digits_begin) {
+            return false;
+        }
+        int num_digits = static_cast<int>(curr - digits_begin);
+        
+        // Read the decimal part.
+        if (curr != s_end && *curr == '.') {
+            curr++;
+            const char *fraction_begin = curr;
+            
+            // 8 digits at a time, long fractions are common in exported files
+            if (isLittleEndian()) {
+                while (s_end - curr >= 8) {
+                    unsigned long long chunk;
+                    memcpy(&chunk, curr, sizeof(chunk));
+                    if (!isEightDigits(chunk)) break;
+                    mantissa = mantissa * 100000000ULL + parseEightDigits(chunk);
+                    curr += 8;
+                }
+            }
+            
+            while (curr != s_end && IS_DIGIT(*curr)) {
+                mantissa = mantissa * 10 + static_cast<unsigned long long>(*curr - '0');
+                curr++;
+            }
+            
+            exponent = -static_cast<int>(curr - fraction_begin);
+            num_digits += static_cast<int>(curr - fraction_begin);
+        }
+        
+        // Read the exponent part.
+        if (curr != s_end && (*curr == 'e' || *curr == 'E')) {
+            curr++;
+            bool exp_negative = false;
+            if (curr != s_end && (*curr == '+' || *curr == '-')) {
+                exp_negative = (*curr == '-');
+                curr++;
+            }
+            
+            // Empty E is not allowed.
+            if (curr == s_end || !IS_DIGIT(*curr)) {
+                return false;
+            }
+            
+            int exp_value = 0;
+            while (curr != s_end && IS_DIGIT(*curr)) {
+                // saturate, anything this large is 0 or inf anyway
+                if (exp_value < 100000) {
+                    exp_value = exp_value * 10 + static_cast<int>(*curr - '0');
+                }
+                curr++;
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+        }
+        
+        // Leading zeros do not count towards the 19 digits that fit the mantissa.
+        if (num_digits > 19) {
+            const char *p = digits_begin;
+            while (p != curr && (*p == '0' || *p == '.')) {
+                if (*p == '0') num_digits--;
+                p++;
+            }
+        }
+        
+        static const double pow10_lut[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+            1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+            1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+        
+        double value;
+        if (num_digits <= 19 && mantissa == 0) {
+            value = 0.0;
+        } else if (num_digits <= 19 && mantissa <= (1ULL << 53) && exponent >= -22 &&
+                   exponent <= 22) {
+            // mantissa <= 2^53, so the cheaper signed conversion is exact
+            value = static_cast<double>(static_cast<long long>(mantissa));
+            if (exponent < 0) {
+                value /= pow10_lut[-exponent];
+            } else {
+                value *= pow10_lut[exponent];
+            }
+        } else {
+            // Slow path: the text between s and curr is a valid number.
+            return tryParseDoubleDigits(s, curr, result);
+        }
+        
+        *result = negative ? -value : value;
+        return true;
+    }
     
     static inline float parseFloat(const char **token, double default_value = 0.0) {
         (*token) += strspn((*token), " \t");
-        const char *end = (*token) + strcspn((*token), " \t\r");
+        const char *end = (*token) + strcspn((*token), " \t\r\n");
         double val = default_value;
         tryParseDouble((*token), end, &val);
         float f = static_cast<float>(val);
@@ -539,8 +767,8 @@ namespace tinyobj {
                                     int vtsize) {
         vertex_index vi(-1);
         
-        vi.v_idx = fixIndex(atoi((*token)), vsize);
-        (*token) += strcspn((*token), "/ \t\r");
+        vi.v_idx = fixIndex(fastAtoi((*token)), vsize);
+        (*token) += strcspn((*token), "/ \t\r\n");
         if ((*token)[0] != '/') {
             return vi;
         }
@@ -549,22 +777,22 @@ namespace tinyobj {
         // i//k
         if ((*token)[0] == '/') {
             (*token)++;
-            vi.vn_idx = fixIndex(atoi((*token)), vnsize);
-            (*token) += strcspn((*token), "/ \t\r");
+            vi.vn_idx = fixIndex(fastAtoi((*token)), vnsize);
+            (*token) += strcspn((*token), "/ \t\r\n");
             return vi;
         }
         
         // i/j/k or i/j
-        vi.vt_idx = fixIndex(atoi((*token)), vtsize);
-        (*token) += strcspn((*token), "/ \t\r");
+        vi.vt_idx = fixIndex(fastAtoi((*token)), vtsize);
+        (*token) += strcspn((*token), "/ \t\r\n");
         if ((*token)[0] != '/') {
             return vi;
         }
         
         // i/j/k
         (*token)++;  // skip '/'
-        vi.vn_idx = fixIndex(atoi((*token)), vnsize);
-        (*token) += strcspn((*token), "/ \t\r");
+        vi.vn_idx = fixIndex(fastAtoi((*token)), vnsize);
+        (*token) += strcspn((*token), "/ \t\r\n");
         return vi;
     }
     
@@ -572,8 +800,8 @@ namespace tinyobj {
     static vertex_index parseRawTriple(const char **token) {
         vertex_index vi(static_cast<int>(0));  // 0 is an invalid index in OBJ
         
-        vi.v_idx = atoi((*token));
-        (*token) += strcspn((*token), "/ \t\r");
+        vi.v_idx = fastAtoi((*token));
+        (*token) += strcspn((*token), "/ \t\r\n");
         if ((*token)[0] != '/') {
             return vi;
         }
@@ -582,22 +810,22 @@ namespace tinyobj {
         // i//k
         if ((*token)[0] == '/') {
             (*token)++;
-            vi.vn_idx = atoi((*token));
-            (*token) += strcspn((*token), "/ \t\r");
+            vi.vn_idx = fastAtoi((*token));
+            (*token) += strcspn((*token), "/ \t\r\n");
             return vi;
         }
         
         // i/j/k or i/j
-        vi.vt_idx = atoi((*token));
-        (*token) += strcspn((*token), "/ \t\r");
+        vi.vt_idx = fastAtoi((*token));
+        (*token) += strcspn((*token), "/ \t\r\n");
         if ((*token)[0] != '/') {
             return vi;
         }
         
         // i/j/k
         (*token)++;  // skip '/'
-        vi.vn_idx = atoi((*token));
-        (*token) += strcspn((*token), "/ \t\r");
+        vi.vn_idx = fastAtoi((*token));
+        (*token) += strcspn((*token), "/ \t\r\n");
         return vi;
     }
     
@@ -703,41 +931,52 @@ namespace tinyobj {
     
     void LoadMtl(std::map<std::string, int> *material_map,
                  std::vector<material_t> *materials, std::istream *inStream) {
+        std::string buf((std::istreambuf_iterator<char>(*inStream)),
+                        std::istreambuf_iterator<char>());
+        LoadMtl(material_map, materials, buf.data(), buf.size());
+    }
+    
+    void LoadMtl(std::map<std::string, int> *material_map,
+                 std::vector<material_t> *materials, const char *buf,
+                 size_t len) {
         // Create a default material anyway.
         material_t material;
         InitMaterial(&material);
         
-        std::string linebuf;
-        while (inStream->peek() != -1) {
-            safeGetline(*inStream, linebuf);
-            
-            // Trim trailing whitespace.
-            if (linebuf.size() > 0) {
-                linebuf = linebuf.substr(0, linebuf.find_last_not_of(" \t") + 1);
+        const char *buf_end = buf + len;
+        std::string last_line;
+        const char *p = buf;
+        while (p < buf_end) {
+            const char *line = p;
+            const char *line_end = p;
+            while (line_end < buf_end && (*line_end) != '\n' && (*line_end) != '\r') {
+                line_end++;
+            }
+            p = line_end + 1;
+            if (p < buf_end && line_end[0] == '\r' && line_end[1] == '\n') p++;
+            
+            // The tokenizers stop at a line break or NUL, so the last line of an
+            // unterminated buffer is copied to stay inside the buffer.
+            if (line_end == buf_end) {
+                last_line.assign(line, line_end);
+                line = last_line.c_str();
+                line_end = line + last_line.size();
             }
             
-            // Trim newline '\r\n' or '\n'
-            if (linebuf.size() > 0) {
-                if (linebuf[linebuf.size() - 1] == '\n')
-                    linebuf.erase(linebuf.size() - 1);
-            }
-            if (linebuf.size() > 0) {
-                if (linebuf[linebuf.size() - 1] == '\r')
-                    linebuf.erase(linebuf.size() - 1);
+            // Trim trailing whitespace.
+            while (line_end > line && IS_SPACE(line_end[-1])) {
+                line_end--;
             }
             
             // Skip if empty line.
-            if (linebuf.empty()) {
+            if (line_end == line) {
                 continue;
             }
             
             // Skip leading space.
-            const char *token = linebuf.c_str();
+            const char *token = line;
             token += strspn(token, " \t");
             
-            assert(token);
-            if (token[0] == '\0') continue;  // empty line
-            
             if (token[0] == '#') continue;  // comment line
             
             // new mtl
@@ -753,14 +992,9 @@ namespace tinyobj {
                 InitMaterial(&material);
                 
                 // set new mtl name
-                char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+                // (sscanf() would scan the rest of the buffer for a NUL)
                 token += 7;
-#ifdef _MSC_VER
-                sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
-#else
-                sscanf(token, "%s", namebuf);
-#endif
-                material.name = namebuf;
+                material.name = parseString(&token);
                 continue;
             }
             
@@ -906,103 +1140,103 @@ namespace tinyobj {
             // ambient texture
             if ((0 == strncmp(token, "map_Ka", 6)) && IS_SPACE(token[6])) {
                 token += 7;
-                material.ambient_texname = token;
+                material.ambient_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // diffuse texture
             if ((0 == strncmp(token, "map_Kd", 6)) && IS_SPACE(token[6])) {
                 token += 7;
-                material.diffuse_texname = token;
+                material.diffuse_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // specular texture
             if ((0 == strncmp(token, "map_Ks", 6)) && IS_SPACE(token[6])) {
                 token += 7;
-                material.specular_texname = token;
+                material.specular_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // specular highlight texture
             if ((0 == strncmp(token, "map_Ns", 6)) && IS_SPACE(token[6])) {
                 token += 7;
-                material.specular_highlight_texname = token;
+                material.specular_highlight_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // bump texture
             if ((0 == strncmp(token, "map_bump", 8)) && IS_SPACE(token[8])) {
                 token += 9;
-                material.bump_texname = token;
+                material.bump_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // alpha texture
             if ((0 == strncmp(token, "map_d", 5)) && IS_SPACE(token[5])) {
                 token += 6;
-                material.alpha_texname = token;
+                material.alpha_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // bump texture
             if ((0 == strncmp(token, "bump", 4)) && IS_SPACE(token[4])) {
                 token += 5;
-                material.bump_texname = token;
+                material.bump_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // displacement texture
             if ((0 == strncmp(token, "disp", 4)) && IS_SPACE(token[4])) {
                 token += 5;
-                material.displacement_texname = token;
+                material.displacement_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // PBR: roughness texture
             if ((0 == strncmp(token, "map_Pr", 6)) && IS_SPACE(token[6])) {
                 token += 7;
-                material.roughness_texname = token;
+                material.roughness_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // PBR: metallic texture
             if ((0 == strncmp(token, "map_Pm", 6)) && IS_SPACE(token[6])) {
                 token += 7;
-                material.metallic_texname = token;
+                material.metallic_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // PBR: sheen texture
             if ((0 == strncmp(token, "map_Ps", 6)) && IS_SPACE(token[6])) {
                 token += 7;
-                material.sheen_texname = token;
+                material.sheen_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // PBR: emissive texture
             if ((0 == strncmp(token, "map_Ke", 6)) && IS_SPACE(token[6])) {
                 token += 7;
-                material.emissive_texname = token;
+                material.emissive_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // PBR: normal map texture
             if ((0 == strncmp(token, "norm", 4)) && IS_SPACE(token[4])) {
                 token += 5;
-                material.normal_texname = token;
+                material.normal_texname = parseRestOfLine(token, line_end);
                 continue;
             }
             
             // unknown parameter
-            const char *_space = strchr(token, ' ');
-            if (!_space) {
-                _space = strchr(token, '\t');
+            const char *_space = std::find(token, line_end, ' ');
+            if (_space == line_end) {
+                _space = std::find(token, line_end, '\t');
             }
-            if (_space) {
+            if (_space != line_end) {
                 std::ptrdiff_t len = _space - token;
                 std::string key(token, static_cast<size_t>(len));
-                std::string value = _space + 1;
+                std::string value(_space + 1, line_end);
                 material.unknown_parameter.insert(
                                                   std::pair<std::string, std::string>(key, value));
             }
@@ -1025,9 +1259,12 @@ namespace tinyobj {
             filepath = matId;
         }
         
-        std::ifstream matIStream(filepath.c_str());
-        LoadMtl(matMap, materials, &matIStream);
-        if (!matIStream) {
+        gps::MappedFile mtl_file;
+        bool opened = mtl_file.Open(filepath);
+        LoadMtl(matMap, materials,
+                mtl_file.GetSize() ? reinterpret_cast<const char *>(mtl_file.GetData()) : "",
+                mtl_file.GetSize());
+        if (!opened) {
             std::stringstream ss;
             ss << "WARN: Material file [ " << filepath
             << " ] not found. Created a default material.";
@@ -1377,6 +1614,514 @@ namespace tinyobj {
         return true;
     }
     
+    // Marks an element missing from a face triple (e.g. `vt` in `i//k`) for
+    // the parallel loader. Unlike parseRawTriple() it has to be told apart from
+    // every index a file can contain, to reproduce fixIndex() exactly.
+#define TINYOBJ_MISSING_INDEX (-2147483647 - 1)
+    
+    // Parse unresolved triples: i, i/j/k, i//k, i/j
+    static vertex_index parseUnresolvedTriple(const char **token) {
+        vertex_index vi(TINYOBJ_MISSING_INDEX);
+        
+        vi.v_idx = fastAtoi((*token));
+        (*token) += strcspn((*token), "/ \t\r\n");
+        if ((*token)[0] != '/') {
+            return vi;
+        }
+        (*token)++;
+        
+        // i//k
+        if ((*token)[0] == '/') {
+            (*token)++;
+            vi.vn_idx = fastAtoi((*token));
+            (*token) += strcspn((*token), "/ \t\r\n");
+            return vi;
+        }
+        
+        // i/j/k or i/j
+        vi.vt_idx = fastAtoi((*token));
+        (*token) += strcspn((*token), "/ \t\r\n");
+        if ((*token)[0] != '/') {
+            return vi;
+        }
+        
+        // i/j/k
+        (*token)++;  // skip '/'
+        vi.vn_idx = fastAtoi((*token));
+        (*token) += strcspn((*token), "/ \t\r\n");
+        return vi;
+    }
+    
+    // Same as fixIndex() for an index read by parseUnresolvedTriple().
+    static inline int fixUnresolvedIndex(int idx, int n) {
+        if (idx == TINYOBJ_MISSING_INDEX) return -1;
+        return fixIndex(idx, n);
+    }
+    
+    // A line of a chunk which has to be replayed in file order when the
+    // chunks are merged.
+    struct chunk_command {
+        enum command_type { COMMAND_FACE, COMMAND_OTHER };
+        command_type type;
+        
+        // COMMAND_FACE: range in obj_chunk::indices, and the number of
+        // v/vn/vt defined in the chunk before the face (for relative indices)
+        size_t index_begin;
+        size_t num_indices;
+        int num_v, num_vn, num_vt;
+        
+        // COMMAND_OTHER: the whole line (usemtl, mtllib, g, o or t)
+        const char *line;
+        size_t line_len;
+    };
+    
+    struct obj_chunk {
+        std::vector<float> v;
+        std::vector<float> vn;
+        std::vector<float> vt;
+        std::vector<vertex_index> indices;
+        std::vector<chunk_command> commands;
+        std::string last_line;  // copy of an unterminated last line of the buffer
+    };
+    
+    // Parses the lines in [begin, end). `begin` and `end` are aligned to line
+    // starts; `buf_end` is the end of the whole buffer.
+    static void parseObjChunk(const char *begin, const char *end,
+                              const char *buf_end, obj_chunk *chunk) {
+        const char *p = begin;
+        while (p < end) {
+            const char *line = p;
+            const char *line_end = p;
+            while (line_end < end && (*line_end) != '\n' && (*line_end) != '\r') {
+                line_end++;
+            }
+            p = line_end + 1;
+            
+            // Skip if empty line.
+            if (line_end == line) {
+                continue;
+            }
+            
+            // The tokenizers stop at a line break or NUL, so the last line of an
+            // unterminated buffer is copied to stay inside the buffer.
+            if (line_end == buf_end) {
+                chunk->last_line.assign(line, line_end);
+                line = chunk->last_line.c_str();
+                line_end = line + chunk->last_line.size();
+            }
+            
+            // Skip leading space.
+            const char *token = line + strspn(line, " \t");
+            
+            if (IS_NEW_LINE(token[0])) continue;  // empty line
+            
+            if (token[0] == '#') continue;  // comment line
+            
+            // vertex
+            if (token[0] == 'v' && IS_SPACE((token[1]))) {
+                token += 2;
+                float x, y, z;
+                parseFloat3(&x, &y, &z, &token);
+                chunk->v.push_back(x);
+                chunk->v.push_back(y);
+                chunk->v.push_back(z);
+                continue;
+            }
+            
+            // normal
+            if (token[0] == 'v' && token[1] == 'n' && IS_SPACE((token[2]))) {
+                token += 3;
+                float x, y, z;
+                parseFloat3(&x, &y, &z, &token);
+                chunk->vn.push_back(x);
+                chunk->vn.push_back(y);
+                chunk->vn.push_back(z);
+                continue;
+            }
+            
+            // texcoord
+            if (token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2]))) {
+                token += 3;
+                float x, y;
+                parseFloat2(&x, &y, &token);
+                chunk->vt.push_back(x);
+                chunk->vt.push_back(y);
+                continue;
+            }
+            
+            // face
+            if (token[0] == 'f' && IS_SPACE((token[1]))) {
+                token += 2;
+                token += strspn(token, " \t");
+                
+                chunk_command command;
+                command.type = chunk_command::COMMAND_FACE;
+                command.index_begin = chunk->indices.size();
+                command.num_v = static_cast<int>(chunk->v.size() / 3);
+                command.num_vn = static_cast<int>(chunk->vn.size() / 3);
+                command.num_vt = static_cast<int>(chunk->vt.size() / 2);
+                command.line = NULL;
+                command.line_len = 0;
+                
+                while (!IS_NEW_LINE(token[0])) {
+                    chunk->indices.push_back(parseUnresolvedTriple(&token));
+                    size_t n = strspn(token, " \t\r");
+                    token += n;
+                }
+                
+                command.num_indices = chunk->indices.size() - command.index_begin;
+                chunk->commands.push_back(command);
+                continue;
+            }
+            
+            // usemtl, mtllib, group name, object name and tags change the
+            // shape being built, so they are replayed in order while merging
+            if (((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) ||
+                ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) ||
+                ((token[0] == 'g' || token[0] == 'o' || token[0] == 't') &&
+                 IS_SPACE((token[1])))) {
+                chunk_command command;
+                command.type = chunk_command::COMMAND_OTHER;
+                command.index_begin = 0;
+                command.num_indices = 0;
+                command.num_v = command.num_vn = command.num_vt = 0;
+                command.line = line;
+                command.line_len = static_cast<size_t>(line_end - line);
+                chunk->commands.push_back(command);
+            }
+            
+            // Ignore unknown command.
+        }
+    }
+    
+    bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+                         std::vector<material_t> *materials, std::string *err,
+                         const char *filename, const char *mtl_basepath,
+                         bool triangulate, unsigned int num_threads) {
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+        
+        std::stringstream errss;
+        
+        gps::MappedFile obj_file;
+        if (!obj_file.Open(filename)) {
+            errss << "Cannot open file [" << filename << "]" << std::endl;
+            if (err) {
+                (*err) = errss.str();
+            }
+            return false;
+        }
+        
+        std::string basePath;
+        if (mtl_basepath) {
+            basePath = mtl_basepath;
+        }
+        MaterialFileReader matFileReader(basePath);
+        
+        return LoadObjParallel(attrib, shapes, materials, err,
+                               obj_file.GetSize() ? reinterpret_cast<const char *>(obj_file.GetData()) : "",
+                               obj_file.GetSize(), &matFileReader,
+                               triangulate, num_threads);
+    }
+    
+    bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+                         std::vector<material_t> *materials, std::string *err,
+                         const char *buf, size_t len,
+                         MaterialReader *readMatFn /*= NULL*/,
+                         bool triangulate, unsigned int num_threads) {
+        std::stringstream errss;
+        
+        if (num_threads == 0) {
+            num_threads = std::thread::hardware_concurrency();
+        }
+        
+        // Small files are not worth the thread start-up cost.
+        const size_t min_chunk_size = 256 * 1024;
+        size_t num_chunks = len / min_chunk_size;
+        if (num_chunks > num_threads) num_chunks = num_threads;
+        if (num_chunks < 1) num_chunks = 1;
+        
+        std::vector<obj_chunk> chunks(num_chunks);
+        std::vector<std::thread> workers;
+        const char *buf_end = buf + len;
+        const char *chunk_begin = buf;
+        
+        for (size_t i = 0; i < num_chunks; i++) {
+            const char *chunk_end = buf_end;
+            if (i + 1 < num_chunks) {
+                chunk_end = buf + len / num_chunks * (i + 1);
+                if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+                
+                // align the chunk end to the start of the next line
+                while (chunk_end < buf_end && (*chunk_end) != '\n' && (*chunk_end) != '\r') {
+                    chunk_end++;
+                }
+                if (chunk_end < buf_end) chunk_end++;
+            }
+            
+            if (i + 1 < num_chunks) {
+                workers.push_back(std::thread(parseObjChunk, chunk_begin, chunk_end,
+                                              buf_end, &chunks[i]));
+            } else {
+                parseObjChunk(chunk_begin, chunk_end, buf_end, &chunks[i]);
+            }
+            chunk_begin = chunk_end;
+        }
+        
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        
+        // Concatenate the vertex attributes in file order.
+        std::vector<int> v_offset(num_chunks), vn_offset(num_chunks), vt_offset(num_chunks);
+        size_t num_v = 0, num_vn = 0, num_vt = 0;
+        for (size_t i = 0; i < num_chunks; i++) {
+            v_offset[i] = static_cast<int>(num_v / 3);
+            vn_offset[i] = static_cast<int>(num_vn / 3);
+            vt_offset[i] = static_cast<int>(num_vt / 2);
+            num_v += chunks[i].v.size();
+            num_vn += chunks[i].vn.size();
+            num_vt += chunks[i].vt.size();
+        }
+        
+        std::vector<float> v;
+        std::vector<float> vn;
+        std::vector<float> vt;
+        v.reserve(num_v);
+        vn.reserve(num_vn);
+        vt.reserve(num_vt);
+        for (size_t i = 0; i < num_chunks; i++) {
+            v.insert(v.end(), chunks[i].v.begin(), chunks[i].v.end());
+            vn.insert(vn.end(), chunks[i].vn.begin(), chunks[i].vn.end());
+            vt.insert(vt.end(), chunks[i].vt.begin(), chunks[i].vt.end());
+            std::vector<float>().swap(chunks[i].v);
+            std::vector<float>().swap(chunks[i].vn);
+            std::vector<float>().swap(chunks[i].vt);
+        }
+        
+        // Replay faces and grouping commands in file order, exactly as LoadObj()
+        // does while reading the stream.
+        std::vector<tag_t> tags;
+        std::vector<std::vector<vertex_index> > faceGroup;
+        std::string name;
+        
+        // material
+        std::map<std::string, int> material_map;
+        int material = -1;
+        
+        shape_t shape;
+        
+        std::string linebuf;
+        for (size_t c = 0; c < num_chunks; c++) {
+            const obj_chunk &chunk = chunks[c];
+            
+            for (size_t i = 0; i < chunk.commands.size(); i++) {
+                const chunk_command &command = chunk.commands[i];
+                
+                // face
+                if (command.type == chunk_command::COMMAND_FACE) {
+                    faceGroup.push_back(std::vector<vertex_index>());
+                    std::vector<vertex_index> &face = faceGroup[faceGroup.size() - 1];
+                    face.resize(command.num_indices);
+                    
+                    for (size_t k = 0; k < command.num_indices; k++) {
+                        const vertex_index &raw = chunk.indices[command.index_begin + k];
+                        face[k].v_idx = fixUnresolvedIndex(raw.v_idx, v_offset[c] + command.num_v);
+                        face[k].vn_idx = fixUnresolvedIndex(raw.vn_idx, vn_offset[c] + command.num_vn);
+                        face[k].vt_idx = fixUnresolvedIndex(raw.vt_idx, vt_offset[c] + command.num_vt);
+                    }
+                    
+                    continue;
+                }
+                
+                linebuf.assign(command.line, command.line_len);
+                const char *token = linebuf.c_str();
+                token += strspn(token, " \t");
+                
+                // use mtl
+                if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
+                    char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+                    token += 7;
+#ifdef _MSC_VER
+                    sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+                    sscanf(token, "%s", namebuf);
+#endif
+                    
+                    int newMaterialId = -1;
+                    if (material_map.find(namebuf) != material_map.end()) {
+                        newMaterialId = material_map[namebuf];
+                    } else {
+                        // { error!! material not found }
+                    }
+                    
+                    if (newMaterialId != material) {
+                        exportFaceGroupToShape(&shape, faceGroup, tags, material, name,
+                                               triangulate);
+                        faceGroup.clear();
+                        material = newMaterialId;
+                    }
+                    
+                    continue;
+                }
+                
+                // load mtl
+                if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
+                    if (readMatFn) {
+                        char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+                        token += 7;
+#ifdef _MSC_VER
+                        sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+                        sscanf(token, "%s", namebuf);
+#endif
+                        
+                        std::string err_mtl;
+                        bool ok = (*readMatFn)(namebuf, materials, &material_map, &err_mtl);
+                        if (err) {
+                            (*err) += err_mtl;
+                        }
+                        
+                        if (!ok) {
+                            faceGroup.clear();  // for safety
+                            return false;
+                        }
+                    }
+                    
+                    continue;
+                }
+                
+                // group name
+                if (token[0] == 'g' && IS_SPACE((token[1]))) {
+                    // flush previous face group.
+                    bool ret = exportFaceGroupToShape(&shape, faceGroup, tags, material,
+                                                      name, triangulate);
+                    if (ret) {
+                        shapes->push_back(shape);
+                    }
+                    
+                    shape = shape_t();
+                    
+                    faceGroup.clear();
+                    
+                    std::vector<std::string> names;
+                    names.reserve(2);
+                    
+                    while (!IS_NEW_LINE(token[0])) {
+                        std::string str = parseString(&token);
+                        names.push_back(str);
+                        token += strspn(token, " \t\r");  // skip tag
+                    }
+                    
+                    assert(names.size() > 0);
+                    
+                    // names[0] must be 'g', so skip the 0th element.
+                    if (names.size() > 1) {
+                        name = names[1];
+                    } else {
+                        name = "";
+                    }
+                    
+                    continue;
+                }
+                
+                // object name
+                if (token[0] == 'o' && IS_SPACE((token[1]))) {
+                    // flush previous face group.
+                    bool ret = exportFaceGroupToShape(&shape, faceGroup, tags, material,
+                                                      name, triangulate);
+                    if (ret) {
+                        shapes->push_back(shape);
+                    }
+                    
+                    faceGroup.clear();
+                    shape = shape_t();
+                    
+                    // @todo { multiple object name? }
+                    char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+                    token += 2;
+#ifdef _MSC_VER
+                    sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+                    sscanf(token, "%s", namebuf);
+#endif
+                    name = std::string(namebuf);
+                    
+                    continue;
+                }
+                
+                if (token[0] == 't' && IS_SPACE(token[1])) {
+                    tag_t tag;
+                    
+                    char namebuf[4096];
+                    token += 2;
+#ifdef _MSC_VER
+                    sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+                    sscanf(token, "%s", namebuf);
+#endif
+                    tag.name = std::string(namebuf);
+                    
+                    token += tag.name.size() + 1;
+                    
+                    tag_sizes ts = parseTagTriple(&token);
+                    
+                    tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+                    
+                    for (size_t j = 0; j < static_cast<size_t>(ts.num_ints); ++j) {
+                        tag.intValues[j] = atoi(token);
+                        token += strcspn(token, "/ \t\r") + 1;
+                    }
+                    
+                    tag.floatValues.resize(static_cast<size_t>(ts.num_floats));
+                    for (size_t j = 0; j < static_cast<size_t>(ts.num_floats); ++j) {
+                        tag.floatValues[j] = parseFloat(&token);
+                        token += strcspn(token, "/ \t\r") + 1;
+                    }
+                    
+                    tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
+                    for (size_t j = 0; j < static_cast<size_t>(ts.num_strings); ++j) {
+                        char stringValueBuffer[4096];
+                        
+#ifdef _MSC_VER
+                        sscanf_s(token, "%s", stringValueBuffer,
+                                 (unsigned)_countof(stringValueBuffer));
+#else
+                        sscanf(token, "%s", stringValueBuffer);
+#endif
+                        tag.stringValues[j] = stringValueBuffer;
+                        token += tag.stringValues[j].size() + 1;
+                    }
+                    
+                    tags.push_back(tag);
+                }
+            }
+        }
+        
+        bool ret = exportFaceGroupToShape(&shape, faceGroup, tags, material, name,
+                                          triangulate);
+        // exportFaceGroupToShape return false when `usemtl` is called in the last
+        // line.
+        // we also add `shape` to `shapes` when `shape.mesh` has already some
+        // faces(indices)
+        if (ret || shape.mesh.indices.size()) {
+            shapes->push_back(shape);
+        }
+        faceGroup.clear();  // for safety
+        
+        if (err) {
+            (*err) += errss.str();
+        }
+        
+        attrib->vertices.swap(v);
+        attrib->normals.swap(vn);
+        attrib->texcoords.swap(vt);
+        
+        return true;
+    }
+    
     bool LoadObjWithCallback(std::istream &inStream, const callback_t &callback,
                              void *user_data /*= NULL*/,
                              MaterialReader *readMatFn /*= NULL*/,
@@ -1655,6 +2400,57 @@ namespace tinyobj {
         
         return true;
     }
+    
+    size_t BenchmarkNumberParsing(const char *buf, size_t len, int runs,
+                                  double *fast_ms, double *digits_ms) {
+        // the tokens of the vertex lines, found once so both parsers read the same stream
+        std::vector<std::pair<const char *, const char *> > tokens;
+        const char *end = buf + len;
+        const char *line = buf;
+        while (line < end) {
+            const char *line_end = static_cast<const char *>(memchr(line, '\n', static_cast<size_t>(end - line)));
+            if (!line_end) line_end = end;
+            const char *token = line;
+            while (token < line_end && IS_SPACE(*token)) token++;
+            if (line_end - token > 2 && token[0] == 'v' &&
+                (IS_SPACE(token[1]) || ((token[1] == 'n' || token[1] == 't') && IS_SPACE(token[2])))) {
+                token += IS_SPACE(token[1]) ? 1 : 2;
+                for (;;) {
+                    while (token < line_end && IS_SPACE(*token)) token++;
+                    const char *token_end = token;
+                    while (token_end < line_end && !IS_SPACE(*token_end) && *token_end != '\r') token_end++;
+                    if (token_end == token) break;
+                    tokens.push_back(std::make_pair(token, token_end));
+                    token = token_end;
+                }
+            }
+            line = line_end + 1;
+        }
+        
+        // the sums keep the compiler from dropping the parsing
+        volatile double sink = 0.0;
+        for (int parser = 0; parser < 2; parser++) {
+            double best = 0.0;
+            for (int run = 0; run < runs; run++) {
+                double sum = 0.0;
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                for (size_t i = 0; i < tokens.size(); i++) {
+                    double value = 0.0;
+                    if (parser == 0) {
+                        tryParseDouble(tokens[i].first, tokens[i].second, &value);
+                    } else {
+                        tryParseDoubleDigits(tokens[i].first, tokens[i].second, &value);
+                    }
+                    sum += value;
+                }
+                double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                best = run == 0 ? time : std::min(best, time);
+                sink = sink + sum;
+            }
+            (*(parser == 0 ? fast_ms : digits_ms)) = best;
+        }
+        return tokens.size();
+    }
 }  // namespace tinyobj
 
 #endif